@@ -25,7 +25,9 @@
 #include "hdhomerun_debug.h"
 #include "hdhomerun_discover.h"
 #include "hdhomerun_control.h"
+#include "hdhomerun_psi.h"
 #include "hdhomerun_video.h"
+#include "hdhomerun_record.h"
 #include "hdhomerun_channels.h"
 #include "hdhomerun_channelscan.h"
 #include "hdhomerun_device.h"
@@ -377,7 +377,7 @@ static int cmd_scan(const char *tuner_str, const char *filename)
 	return ret;
 }
 
-static void cmd_save_print_stats(void)
+static void cmd_save_print_stats(const struct hdhomerun_record_stats_t *rec_stats)
 {
 	struct hdhomerun_video_stats_t stats;
 	hdhomerun_device_get_video_stats(hd, &stats);
@@ -389,6 +389,17 @@ static void cmd_save_print_stats(void)
 		(unsigned int)stats.transport_error_count, 
 		(unsigned int)stats.sequence_error_count
 	);
+
+	if (rec_stats) {
+		fprintf(stderr, "%llu bytes written, %llu bytes behind, %u write errors, %u sync errors, %llu us average write latency, %llu us max write latency\n",
+			(unsigned long long)rec_stats->bytes_written,
+			(unsigned long long)rec_stats->bytes_behind,
+			(unsigned int)rec_stats->write_error_count,
+			(unsigned int)rec_stats->sync_error_count,
+			(unsigned long long)rec_stats->write_latency_avg,
+			(unsigned long long)rec_stats->write_latency_max
+		);
+	}
 }
 
 static int cmd_save(const char *tuner_str, const char *filename)
@@ -398,55 +409,68 @@ static int cmd_save(const char *tuner_str, const char *filename)
 		return -1;
 	}
 
-	FILE *fp;
+	/* Files are written by a recording sink so disk stalls do not hold up this loop. */
+	FILE *fp = NULL;
+	bool record = false;
 	if (strcmp(filename, "null") == 0) {
 		fp = NULL;
 	} else if (strcmp(filename, "-") == 0) {
 		fp = stdout;
 	} else {
-		fp = fopen(filename, "wb");
-		if (!fp) {
-			fprintf(stderr, "unable to create file %s\n", filename);
-			return -1;
-		}
+		record = true;
 	}
 
 	int ret = hdhomerun_device_stream_start(hd);
 	if (ret <= 0) {
 		fprintf(stderr, "unable to start stream\n");
-		if (fp && fp != stdout) {
-			fclose(fp);
-		}
 		return ret;
 	}
 
+	struct hdhomerun_record_t *rec = NULL;
+	if (record) {
+		rec = hdhomerun_record_create(hdhomerun_device_get_video_sock(hd), filename, NULL, NULL);
+		if (!rec) {
+			fprintf(stderr, "unable to create file %s\n", filename);
+			hdhomerun_device_stream_stop(hd);
+			return -1;
+		}
+	}
+
 	register_signal_handlers(sigabort_handler, sigabort_handler, siginfo_handler);
 
 	struct hdhomerun_video_stats_t stats_old, stats_cur;
 	hdhomerun_device_get_video_stats(hd, &stats_old);
 
+	struct hdhomerun_record_stats_t rec_stats;
+	memset(&rec_stats, 0, sizeof(rec_stats));
+
 	uint64_t next_progress = getcurrenttime() + 1000;
+	ret = 0;
 
 	while (!sigabort_flag) {
 		uint64_t loop_start_time = getcurrenttime();
 
 		if (siginfo_flag) {
 			fprintf(stderr, "\n");
-			cmd_save_print_stats();
+			if (rec) {
+				hdhomerun_record_get_stats(rec, &rec_stats);
+			}
+			cmd_save_print_stats(rec ? &rec_stats : NULL);
 			siginfo_flag = false;
 		}
 
-		size_t actual_size;
-		uint8_t *ptr = hdhomerun_device_stream_recv(hd, VIDEO_DATA_BUFFER_SIZE_1S, &actual_size);
-		if (!ptr) {
-			msleep_approx(64);
-			continue;
-		}
+		if (!rec) {
+			size_t actual_size;
+			uint8_t *ptr = hdhomerun_device_stream_recv_wait(hd, VIDEO_DATA_BUFFER_SIZE_1S, VIDEO_DATA_BUFFER_SIZE_1S / 16, 64, &actual_size);
+			if (!ptr) {
+				continue;
+			}
 
-		if (fp) {
-			if (fwrite(ptr, 1, actual_size, fp) != actual_size) {
-				fprintf(stderr, "error writing output\n");
-				return -1;
+			if (fp) {
+				if (fwrite(ptr, 1, actual_size, fp) != actual_size) {
+					fprintf(stderr, "error writing output\n");
+					return -1;
+				}
 			}
 		}
 
@@ -478,6 +502,16 @@ static int cmd_save(const char *tuner_str, const char *filename)
 
 			stats_old = stats_cur;
 			fflush(stderr);
+
+			/* Recording stats - the sink keeps draining the stream after a failed write, stop here instead. */
+			if (rec) {
+				hdhomerun_record_get_stats(rec, &rec_stats);
+				if (rec_stats.write_error_count > 0) {
+					fprintf(stderr, "\nerror writing %s\n", filename);
+					ret = -1;
+					break;
+				}
+			}
 		}
 
 		int32_t delay = 64 - (int32_t)(getcurrenttime() - loop_start_time);
@@ -488,6 +522,10 @@ static int cmd_save(const char *tuner_str, const char *filename)
 		msleep_approx(delay);
 	}
 
+	if (rec) {
+		hdhomerun_record_get_stats(rec, &rec_stats);
+		hdhomerun_record_destroy(rec);
+	}
 	if (fp) {
 		fclose(fp);
 	}
@@ -496,9 +534,9 @@ static int cmd_save(const char *tuner_str, const char *filename)
 
 	fprintf(stderr, "\n");
 	fprintf(stderr, "-- Video statistics --\n");
-	cmd_save_print_stats();
+	cmd_save_print_stats(rec ? &rec_stats : NULL);
 
-	return 0;
+	return ret;
 }
 
 static int cmd_upgrade(const char *filename)
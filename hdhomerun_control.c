@@ -24,26 +24,174 @@
 #define HDHOMERUN_CONTROL_SEND_TIMEOUT 2500
 #define HDHOMERUN_CONTROL_RECV_TIMEOUT 2500
 #define HDHOMERUN_CONTROL_UPGRADE_TIMEOUT 40000
+#define HDHOMERUN_CONTROL_BATCH_SEND_SIZE 4096
+#define HDHOMERUN_CONTROL_DISCOVER_TIMEOUT 200
+#define HDHOMERUN_CONTROL_CONNECT_CANDIDATES_MAX HDHOMERUN_SOCK_CONNECT_WAIT_MAX
+
+#define HDHOMERUN_CONTROL_ASYNC_STATE_IDLE 0
+#define HDHOMERUN_CONTROL_ASYNC_STATE_DISCOVER 1
+#define HDHOMERUN_CONTROL_ASYNC_STATE_CONNECTING 2
+
+struct hdhomerun_control_request_t {
+	struct hdhomerun_control_request_t *next;
+	hdhomerun_control_callback_t callback;
+	void *callback_arg;
+	uint8_t *frame;
+	size_t frame_length;
+	int send_count;
+};
 
 struct hdhomerun_control_sock_t {
 	uint32_t desired_device_id;
 	uint32_t actual_device_id;
 	struct sockaddr_storage desired_device_addr;
 	struct sockaddr_storage actual_device_addr;
+	struct sockaddr_storage candidate_addrs[HDHOMERUN_CONTROL_CONNECT_CANDIDATES_MAX]; /* all addresses of the device, best first */
+	int candidate_count;
 	struct hdhomerun_sock_t *sock;
+	struct hdhomerun_control_connect_stats_t connect_stats[2]; /* IPv4, IPv6 */
+	uint64_t connect_time_total[2];
+	uint64_t connect_start_ticks;
 	struct hdhomerun_debug_t *dbg;
 	struct hdhomerun_pkt_t tx_pkt;
 	struct hdhomerun_pkt_t rx_pkt;
+
+	/*
+	 * Asynchronous requests, in submission order. Requests before async_unsent have been written to sock and
+	 * are waiting for their replies; async_unsent_offset bytes of async_unsent have been written.
+	 */
+	int async_state;
+	struct hdhomerun_sock_t *discover_sock;
+	struct sockaddr_storage discover_target_addr; /* unspecified for subnet broadcasts */
+	bool discover_cached; /* discover_target_addr is from the discover cache */
+	int discover_attempt;
+	bool async_closing;
+	uint64_t async_timeout_time;
+	struct hdhomerun_control_request_t *async_head;
+	struct hdhomerun_control_request_t *async_tail;
+	struct hdhomerun_control_request_t *async_unsent;
+	size_t async_unsent_offset;
+	struct hdhomerun_pkt_t async_rx_pkt;
+
+	/*
+	 * Shared connections (hdhomerun_control_create_shared). A shared handle keeps its own rx_pkt for responses and
+	 * uses the pooled connection for everything else, holding shared_lock of the connection for each call.
+	 * shared_device_id and shared_device_addr are the device the connection resolved to, copied under the list
+	 * lock so handles created later for the same device by id or by address find the connection.
+	 */
+	struct hdhomerun_control_sock_t *shared;
+	struct hdhomerun_control_sock_t *shared_next;
+	uint32_t shared_refcount;
+	thread_mutex_t shared_lock;
+	uint32_t shared_device_id;
+	struct sockaddr_storage shared_device_addr;
 };
 
+static thread_once_t hdhomerun_control_shared_once = THREAD_ONCE_INIT;
+static thread_mutex_t hdhomerun_control_shared_list_lock;
+static struct hdhomerun_control_sock_t *hdhomerun_control_shared_list = NULL;
+
+static void hdhomerun_control_shared_init(void)
+{
+	thread_mutex_init(&hdhomerun_control_shared_list_lock);
+}
+
+static struct hdhomerun_control_sock_t *hdhomerun_control_lock(struct hdhomerun_control_sock_t *cs)
+{
+	struct hdhomerun_control_sock_t *conn = cs->shared;
+	if (!conn) {
+		return cs;
+	}
+
+	thread_mutex_lock(&conn->shared_lock);
+	conn->dbg = cs->dbg;
+	return conn;
+}
+
+/*
+ * Equal ip address and scope; the port is ignored. Two unspecified addresses are equal.
+ */
+static bool hdhomerun_control_addr_equal(const struct sockaddr *a, const struct sockaddr *b)
+{
+	bool a_is_addr = hdhomerun_sock_sockaddr_is_addr(a);
+	bool b_is_addr = hdhomerun_sock_sockaddr_is_addr(b);
+	if (!a_is_addr || !b_is_addr) {
+		return (a_is_addr == b_is_addr);
+	}
+
+	return hdhomerun_sock_sockaddr_ip_equal(a, b);
+}
+
+static void hdhomerun_control_unlock(struct hdhomerun_control_sock_t *cs)
+{
+	struct hdhomerun_control_sock_t *conn = cs->shared;
+	if (!conn) {
+		return;
+	}
+
+	if ((conn->actual_device_id != conn->shared_device_id) || !hdhomerun_control_addr_equal((struct sockaddr *)&conn->actual_device_addr, (struct sockaddr *)&conn->shared_device_addr)) {
+		thread_mutex_lock(&hdhomerun_control_shared_list_lock);
+		conn->shared_device_id = conn->actual_device_id;
+		conn->shared_device_addr = conn->actual_device_addr;
+		thread_mutex_unlock(&hdhomerun_control_shared_list_lock);
+	}
+
+	thread_mutex_unlock(&conn->shared_lock);
+}
+
 static void hdhomerun_control_close_sock(struct hdhomerun_control_sock_t *cs)
 {
+	if (cs->discover_sock) {
+		hdhomerun_sock_destroy(cs->discover_sock);
+		cs->discover_sock = NULL;
+	}
+
+	cs->async_state = HDHOMERUN_CONTROL_ASYNC_STATE_IDLE;
+
 	if (!cs->sock) {
 		return;
 	}
 
 	hdhomerun_sock_destroy(cs->sock);
 	cs->sock = NULL;
+
+	/* Requests written to the old connection are sent again on the next one (see send_count). */
+	cs->async_unsent = cs->async_head;
+	cs->async_unsent_offset = 0;
+	hdhomerun_pkt_reset(&cs->async_rx_pkt);
+}
+
+static void hdhomerun_control_async_complete(struct hdhomerun_control_sock_t *cs, int result, char *value, char *error)
+{
+	struct hdhomerun_control_request_t *request = cs->async_head;
+	cs->async_head = request->next;
+	if (!cs->async_head) {
+		cs->async_tail = NULL;
+	}
+	if (cs->async_unsent == request) {
+		cs->async_unsent = request->next;
+		cs->async_unsent_offset = 0;
+	}
+
+	request->callback(request->callback_arg, result, value, error);
+	free(request);
+}
+
+static void hdhomerun_control_async_fail_all(struct hdhomerun_control_sock_t *cs)
+{
+	/* Requests submitted from the callbacks are not failed. */
+	struct hdhomerun_control_request_t *request = cs->async_head;
+	cs->async_head = NULL;
+	cs->async_tail = NULL;
+	cs->async_unsent = NULL;
+	cs->async_unsent_offset = 0;
+
+	while (request) {
+		struct hdhomerun_control_request_t *next = request->next;
+		request->callback(request->callback_arg, -1, NULL, NULL);
+		free(request);
+		request = next;
+	}
 }
 
 void hdhomerun_control_set_device(struct hdhomerun_control_sock_t *cs, uint32_t device_id, uint32_t device_ip)
@@ -56,14 +204,24 @@ void hdhomerun_control_set_device(struct hdhomerun_control_sock_t *cs, uint32_t
 	hdhomerun_control_set_device_ex(cs, device_id, (const struct sockaddr *)&device_addr);
 }
 
+static void hdhomerun_control_release_shared(struct hdhomerun_control_sock_t *conn);
+
 void hdhomerun_control_set_device_ex(struct hdhomerun_control_sock_t *cs, uint32_t device_id, const struct sockaddr *device_addr)
 {
+	/* A shared handle leaves the pool and continues with its own connection to the new device. */
+	if (cs->shared) {
+		hdhomerun_control_release_shared(cs->shared);
+		cs->shared = NULL;
+	}
+
 	hdhomerun_control_close_sock(cs);
+	hdhomerun_control_async_fail_all(cs);
 
 	cs->desired_device_id = device_id;
 	cs->actual_device_id = 0;
 	hdhomerun_sock_sockaddr_copy(&cs->desired_device_addr, device_addr);
 	memset(&cs->actual_device_addr, 0, sizeof(cs->actual_device_addr));
+	cs->candidate_count = 0;
 }
 
 struct hdhomerun_control_sock_t *hdhomerun_control_create(uint32_t device_id, uint32_t device_ip, struct hdhomerun_debug_t *dbg)
@@ -85,17 +243,232 @@ struct hdhomerun_control_sock_t *hdhomerun_control_create_ex(uint32_t device_id,
 	}
 
 	cs->dbg = dbg;
+	hdhomerun_pkt_reset(&cs->async_rx_pkt);
 	hdhomerun_control_set_device_ex(cs, device_id, device_addr);
 
 	return cs;
 }
 
+/*
+ * A pooled connection matches the device as it was requested or, once known, the device it resolved to.
+ * Called with the list lock held.
+ */
+static bool hdhomerun_control_shared_match(struct hdhomerun_control_sock_t *conn, uint32_t device_id, const struct sockaddr *device_addr)
+{
+	if (device_id == HDHOMERUN_DEVICE_ID_WILDCARD) {
+		device_id = 0;
+	}
+
+	uint32_t desired_device_id = conn->desired_device_id;
+	if (desired_device_id == HDHOMERUN_DEVICE_ID_WILDCARD) {
+		desired_device_id = 0;
+	}
+
+	if ((desired_device_id == device_id) && hdhomerun_control_addr_equal((struct sockaddr *)&conn->desired_device_addr, device_addr)) {
+		return true;
+	}
+
+	if ((conn->shared_device_id == 0) || (conn->shared_device_id == HDHOMERUN_DEVICE_ID_WILDCARD)) {
+		return false;
+	}
+	if ((device_id != 0) && (device_id != conn->shared_device_id)) {
+		return false;
+	}
+	if (hdhomerun_sock_sockaddr_is_addr(device_addr) && !hdhomerun_control_addr_equal((struct sockaddr *)&conn->shared_device_addr, device_addr)) {
+		return false;
+	}
+
+	return (device_id != 0) || hdhomerun_sock_sockaddr_is_addr(device_addr);
+}
+
+/*
+ * Attach an unshared handle to the pooled connection for its desired device, creating one if there is none.
+ */
+static bool hdhomerun_control_join_shared(struct hdhomerun_control_sock_t *cs)
+{
+	thread_once(&hdhomerun_control_shared_once, hdhomerun_control_shared_init);
+	thread_mutex_lock(&hdhomerun_control_shared_list_lock);
+
+	struct hdhomerun_control_sock_t *conn = hdhomerun_control_shared_list;
+	while (conn) {
+		if (hdhomerun_control_shared_match(conn, cs->desired_device_id, (struct sockaddr *)&cs->desired_device_addr)) {
+			break;
+		}
+		conn = conn->shared_next;
+	}
+
+	if (!conn) {
+		conn = hdhomerun_control_create_ex(cs->desired_device_id, (struct sockaddr *)&cs->desired_device_addr, NULL);
+		if (!conn) {
+			thread_mutex_unlock(&hdhomerun_control_shared_list_lock);
+			return false;
+		}
+
+		thread_mutex_init(&conn->shared_lock);
+		conn->shared_next = hdhomerun_control_shared_list;
+		hdhomerun_control_shared_list = conn;
+	}
+
+	conn->shared_refcount++;
+	thread_mutex_unlock(&hdhomerun_control_shared_list_lock);
+
+	cs->shared = conn;
+	return true;
+}
+
+struct hdhomerun_control_sock_t *hdhomerun_control_create_shared(uint32_t device_id, const struct sockaddr *device_addr, struct hdhomerun_debug_t *dbg)
+{
+	struct hdhomerun_control_sock_t *cs = hdhomerun_control_create_ex(device_id, device_addr, dbg);
+	if (!cs) {
+		return NULL;
+	}
+
+	if (!hdhomerun_control_join_shared(cs)) {
+		hdhomerun_debug_printf(dbg, "hdhomerun_control_create: failed to allocate control object\n");
+		free(cs);
+		return NULL;
+	}
+
+	return cs;
+}
+
+bool hdhomerun_control_set_device_shared(struct hdhomerun_control_sock_t *cs, uint32_t device_id, const struct sockaddr *device_addr)
+{
+	hdhomerun_control_set_device_ex(cs, device_id, device_addr);
+	return hdhomerun_control_join_shared(cs);
+}
+
+struct hdhomerun_control_sock_t *hdhomerun_control_create_unshared(struct hdhomerun_control_sock_t *cs, struct hdhomerun_debug_t *dbg)
+{
+	struct hdhomerun_control_sock_t *conn = hdhomerun_control_lock(cs);
+
+	struct hdhomerun_control_sock_t *result = hdhomerun_control_create_ex(cs->desired_device_id, (struct sockaddr *)&cs->desired_device_addr, dbg);
+	if (result) {
+		/* Start from the device already found so the new connection does not discover it again. */
+		result->actual_device_id = conn->actual_device_id;
+		result->actual_device_addr = conn->actual_device_addr;
+		result->candidate_count = conn->candidate_count;
+		memcpy(result->candidate_addrs, conn->candidate_addrs, sizeof(result->candidate_addrs));
+	}
+
+	hdhomerun_control_unlock(cs);
+	return result;
+}
+
+static void hdhomerun_control_release_shared(struct hdhomerun_control_sock_t *conn)
+{
+	thread_mutex_lock(&hdhomerun_control_shared_list_lock);
+
+	conn->shared_refcount--;
+	if (conn->shared_refcount > 0) {
+		thread_mutex_unlock(&hdhomerun_control_shared_list_lock);
+		return;
+	}
+
+	struct hdhomerun_control_sock_t **pprev = &hdhomerun_control_shared_list;
+	while (*pprev != conn) {
+		pprev = &(*pprev)->shared_next;
+	}
+	*pprev = conn->shared_next;
+
+	thread_mutex_unlock(&hdhomerun_control_shared_list_lock);
+
+	thread_mutex_dispose(&conn->shared_lock);
+	hdhomerun_control_destroy(conn);
+}
+
 void hdhomerun_control_destroy(struct hdhomerun_control_sock_t *cs)
 {
+	if (cs->shared) {
+		hdhomerun_control_release_shared(cs->shared);
+	}
+
+	/* Callbacks of the failed requests cannot queue new ones. */
+	cs->async_closing = true;
 	hdhomerun_control_close_sock(cs);
+	hdhomerun_control_async_fail_all(cs);
 	free(cs);
 }
 
+/*
+ * Targeted discover on a single UDP socket, without the interface enumeration of a discover object. Uses its own
+ * packet buffers as a get/set request may already be waiting in cs->tx_pkt.
+ */
+static bool hdhomerun_control_discover_send(struct hdhomerun_sock_t *sock, const struct sockaddr *target_addr, uint32_t device_id)
+{
+	struct hdhomerun_pkt_t pkt;
+	struct hdhomerun_pkt_t *tx_pkt = &pkt;
+	hdhomerun_pkt_reset(tx_pkt);
+
+	hdhomerun_pkt_write_u8(tx_pkt, HDHOMERUN_TAG_DEVICE_TYPE);
+	hdhomerun_pkt_write_var_length(tx_pkt, 4);
+	hdhomerun_pkt_write_u32(tx_pkt, HDHOMERUN_DEVICE_TYPE_WILDCARD);
+
+	if ((device_id != 0) && (device_id != HDHOMERUN_DEVICE_ID_WILDCARD)) {
+		hdhomerun_pkt_write_u8(tx_pkt, HDHOMERUN_TAG_DEVICE_ID);
+		hdhomerun_pkt_write_var_length(tx_pkt, 4);
+		hdhomerun_pkt_write_u32(tx_pkt, device_id);
+	}
+
+	hdhomerun_pkt_seal_frame(tx_pkt, HDHOMERUN_TYPE_DISCOVER_REQ);
+
+	struct sockaddr_storage remote_addr;
+	hdhomerun_sock_sockaddr_copy(&remote_addr, target_addr);
+	hdhomerun_sock_sockaddr_set_port((struct sockaddr *)&remote_addr, HDHOMERUN_DISCOVER_UDP_PORT);
+	return hdhomerun_sock_sendto_ex(sock, (struct sockaddr *)&remote_addr, tx_pkt->start, tx_pkt->end - tx_pkt->start, 0);
+}
+
+static bool hdhomerun_control_discover_recv(struct hdhomerun_sock_t *sock, uint32_t device_id_match, uint64_t recv_timeout, uint32_t *pdevice_id, struct sockaddr_storage *remote_addr)
+{
+	struct hdhomerun_pkt_t pkt;
+	struct hdhomerun_pkt_t *rx_pkt = &pkt;
+	uint64_t stop_time = getcurrenttime() + recv_timeout;
+
+	while (1) {
+		uint64_t current_time = getcurrenttime();
+		uint64_t timeout = (stop_time > current_time) ? stop_time - current_time : 0;
+
+		hdhomerun_pkt_reset(rx_pkt);
+		size_t length = rx_pkt->limit - rx_pkt->end;
+		if (!hdhomerun_sock_recvfrom_ex(sock, remote_addr, rx_pkt->end, &length, timeout)) {
+			return false;
+		}
+		rx_pkt->end += length;
+
+		uint16_t type;
+		if (hdhomerun_pkt_open_frame(rx_pkt, &type) <= 0) {
+			continue;
+		}
+		if (type != HDHOMERUN_TYPE_DISCOVER_RPY) {
+			continue;
+		}
+
+		uint32_t device_id = 0;
+		while (1) {
+			uint8_t tag;
+			size_t len;
+			uint8_t *next = hdhomerun_pkt_read_tlv(rx_pkt, &tag, &len);
+			if (!next) {
+				break;
+			}
+
+			if ((tag == HDHOMERUN_TAG_DEVICE_ID) && (len == 4)) {
+				device_id = hdhomerun_pkt_read_u32(rx_pkt);
+			}
+
+			rx_pkt->pos = next;
+		}
+
+		if ((device_id_match != 0) && (device_id_match != HDHOMERUN_DEVICE_ID_WILDCARD) && (device_id != device_id_match)) {
+			continue;
+		}
+
+		hdhomerun_discover_cache_add(device_id, (struct sockaddr *)remote_addr);
+		*pdevice_id = device_id;
+		return true;
+	}
+}
+
 static bool hdhomerun_control_connect_sock_discover(struct hdhomerun_control_sock_t *cs)
 {
 	struct hdhomerun_discover_t *ds = hdhomerun_discover_create(cs->dbg);
@@ -138,10 +511,169 @@ static bool hdhomerun_control_connect_sock_discover(struct hdhomerun_control_soc
 	struct hdhomerun_discover2_device_if_t *device_if = hdhomerun_discover2_iter_device_if_first(device);
 	hdhomerun_discover2_device_if_get_ip_addr(device_if, &cs->actual_device_addr);
 
+	cs->candidate_count = 0;
+	while (device_if && (cs->candidate_count < HDHOMERUN_CONTROL_CONNECT_CANDIDATES_MAX)) {
+		hdhomerun_discover2_device_if_get_ip_addr(device_if, &cs->candidate_addrs[cs->candidate_count++]);
+		device_if = hdhomerun_discover2_iter_device_if_next(device_if);
+	}
+
 	hdhomerun_discover_destroy(ds);
 	return true;
 }
 
+static int hdhomerun_control_connect_stats_index(int af)
+{
+	return (af == AF_INET6) ? 1 : 0;
+}
+
+static void hdhomerun_control_connect_stats_attempt(struct hdhomerun_control_sock_t *cs, int af)
+{
+	cs->connect_stats[hdhomerun_control_connect_stats_index(af)].attempt_count++;
+}
+
+static void hdhomerun_control_connect_stats_fail(struct hdhomerun_control_sock_t *cs, int af)
+{
+	cs->connect_stats[hdhomerun_control_connect_stats_index(af)].fail_count++;
+}
+
+static void hdhomerun_control_connect_stats_success(struct hdhomerun_control_sock_t *cs, int af, uint64_t start_ticks)
+{
+	int index = hdhomerun_control_connect_stats_index(af);
+	struct hdhomerun_control_connect_stats_t *stats = &cs->connect_stats[index];
+
+	uint64_t ticks = timer_get_hires_ticks() - start_ticks;
+	uint64_t frequency = timer_get_hires_frequency();
+	uint64_t connect_time = (ticks / frequency) * 1000000 + ((ticks % frequency) * 1000000) / frequency;
+
+	stats->success_count++;
+	stats->connect_time_last = connect_time;
+	if (connect_time > stats->connect_time_max) {
+		stats->connect_time_max = connect_time;
+	}
+
+	cs->connect_time_total[index] += connect_time;
+	stats->connect_time_avg = cs->connect_time_total[index] / stats->success_count;
+}
+
+/*
+ * Race TCP connections to the candidate addresses (happy eyeballs): each attempt starts
+ * HDHOMERUN_CONTROL_CONNECT_ATTEMPT_DELAY after the previous one, or immediately if the previous one failed. The
+ * first connection to complete is kept as cs->sock and its address becomes cs->actual_device_addr.
+ */
+static bool hdhomerun_control_connect_sock_addr(struct hdhomerun_control_sock_t *cs)
+{
+	struct hdhomerun_sock_t *socks[HDHOMERUN_CONTROL_CONNECT_CANDIDATES_MAX];
+	int candidate_index[HDHOMERUN_CONTROL_CONNECT_CANDIDATES_MAX];
+	uint64_t start_ticks[HDHOMERUN_CONTROL_CONNECT_CANDIDATES_MAX];
+	int active_count = 0;
+	int next_candidate = 0;
+
+	uint64_t current_time = getcurrenttime();
+	uint64_t stop_time = current_time + HDHOMERUN_CONTROL_CONNECT_TIMEOUT;
+	uint64_t next_start_time = current_time;
+
+	while (1) {
+		current_time = getcurrenttime();
+
+		if ((next_candidate < cs->candidate_count) && ((current_time >= next_start_time) || (active_count == 0))) {
+			struct sockaddr *candidate_addr = (struct sockaddr *)&cs->candidate_addrs[next_candidate];
+			hdhomerun_sock_sockaddr_set_port(candidate_addr, HDHOMERUN_CONTROL_TCP_PORT);
+			hdhomerun_control_connect_stats_attempt(cs, candidate_addr->sa_family);
+
+			struct hdhomerun_sock_t *sock = hdhomerun_sock_create_tcp_ex(candidate_addr->sa_family);
+			if (!sock) {
+				hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_connect_sock: failed to create socket (%d)\n", hdhomerun_sock_getlasterror());
+				hdhomerun_control_connect_stats_fail(cs, candidate_addr->sa_family);
+			} else if (!hdhomerun_sock_connect_start(sock, candidate_addr)) {
+				hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_connect_sock: failed to connect (%d)\n", hdhomerun_sock_getlasterror());
+				hdhomerun_control_connect_stats_fail(cs, candidate_addr->sa_family);
+				hdhomerun_sock_destroy(sock);
+			} else {
+				socks[active_count] = sock;
+				candidate_index[active_count] = next_candidate;
+				start_ticks[active_count] = timer_get_hires_ticks();
+				active_count++;
+			}
+
+			next_candidate++;
+			next_start_time = current_time + HDHOMERUN_CONTROL_CONNECT_ATTEMPT_DELAY;
+			continue;
+		}
+
+		if ((active_count == 0) || (current_time >= stop_time)) {
+			break;
+		}
+
+		uint64_t wait_time = stop_time - current_time;
+		if ((next_candidate < cs->candidate_count) && (next_start_time - current_time < wait_time)) {
+			wait_time = next_start_time - current_time;
+		}
+
+		int i = hdhomerun_sock_connect_wait(socks, active_count, wait_time);
+		if (i < 0) {
+			continue;
+		}
+
+		struct sockaddr *candidate_addr = (struct sockaddr *)&cs->candidate_addrs[candidate_index[i]];
+		if (!hdhomerun_sock_connect_finish(socks[i])) {
+			char ip_str[64];
+			hdhomerun_sock_sockaddr_to_ip_str(ip_str, candidate_addr, true);
+			hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_connect_sock: failed to connect to %s (%d)\n", ip_str, hdhomerun_sock_getlasterror());
+			hdhomerun_control_connect_stats_fail(cs, candidate_addr->sa_family);
+
+			hdhomerun_sock_destroy(socks[i]);
+			active_count--;
+			socks[i] = socks[active_count];
+			candidate_index[i] = candidate_index[active_count];
+			start_ticks[i] = start_ticks[active_count];
+
+			next_start_time = current_time;
+			continue;
+		}
+
+		hdhomerun_control_connect_stats_success(cs, candidate_addr->sa_family, start_ticks[i]);
+		cs->sock = socks[i];
+		hdhomerun_sock_sockaddr_copy(&cs->actual_device_addr, candidate_addr);
+
+		/* Later connects look up the winning address first. */
+		hdhomerun_discover_cache_add(cs->actual_device_id, candidate_addr);
+
+		int j;
+		for (j = 0; j < active_count; j++) {
+			if (j != i) {
+				hdhomerun_sock_destroy(socks[j]);
+			}
+		}
+
+		return true;
+	}
+
+	int j;
+	for (j = 0; j < active_count; j++) {
+		hdhomerun_control_connect_stats_fail(cs, cs->candidate_addrs[candidate_index[j]].ss_family);
+		hdhomerun_sock_destroy(socks[j]);
+	}
+
+	hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_connect_sock: failed to connect\n");
+	return false;
+}
+
+static bool hdhomerun_control_connect_sock_verify(struct hdhomerun_control_sock_t *cs)
+{
+	struct hdhomerun_sock_t *sock = hdhomerun_sock_create_udp_ex(cs->actual_device_addr.ss_family);
+	if (!sock) {
+		return false;
+	}
+
+	uint32_t device_id;
+	struct sockaddr_storage remote_addr;
+	bool verified = hdhomerun_control_discover_send(sock, (struct sockaddr *)&cs->actual_device_addr, cs->actual_device_id);
+	verified = verified && hdhomerun_control_discover_recv(sock, cs->actual_device_id, HDHOMERUN_CONTROL_DISCOVER_TIMEOUT, &device_id, &remote_addr);
+
+	hdhomerun_sock_destroy(sock);
+	return verified;
+}
+
 static bool hdhomerun_control_connect_sock(struct hdhomerun_control_sock_t *cs)
 {
 	if (cs->sock) {
@@ -157,64 +689,73 @@ static bool hdhomerun_control_connect_sock(struct hdhomerun_control_sock_t *cs)
 		return false;
 	}
 
-	/* Find device. */
-	if (!hdhomerun_control_connect_sock_discover(cs)) {
-		return false;
-	}
+	/* Race the addresses of a recent discover first, checking that the same device still answers on the winner. */
+	cs->candidate_count = hdhomerun_discover_cache_lookup_all(cs->desired_device_id, (struct sockaddr *)&cs->desired_device_addr, &cs->actual_device_id, cs->candidate_addrs, HDHOMERUN_CONTROL_CONNECT_CANDIDATES_MAX);
+	if (cs->candidate_count > 0) {
+		cs->actual_device_addr = cs->candidate_addrs[0];
 
-	/* Create socket. */
-	cs->sock = hdhomerun_sock_create_tcp_ex(cs->actual_device_addr.ss_family);
-	if (!cs->sock) {
-		hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_connect_sock: failed to create socket (%d)\n", hdhomerun_sock_getlasterror());
-		return false;
-	}
+		if (hdhomerun_control_connect_sock_addr(cs) && hdhomerun_control_connect_sock_verify(cs)) {
+			return true;
+		}
 
-	/* Initiate connection. */
-	hdhomerun_sock_sockaddr_set_port((struct sockaddr *)&cs->actual_device_addr, HDHOMERUN_CONTROL_TCP_PORT);
-	if (!hdhomerun_sock_connect_ex(cs->sock, (struct sockaddr *)&cs->actual_device_addr, HDHOMERUN_CONTROL_CONNECT_TIMEOUT)) {
-		hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_connect_sock: failed to connect (%d)\n", hdhomerun_sock_getlasterror());
+		hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_connect_sock: cached addresses not valid\n");
+		int i;
+		for (i = 0; i < cs->candidate_count; i++) {
+			hdhomerun_discover_cache_invalidate(cs->actual_device_id, (struct sockaddr *)&cs->candidate_addrs[i]);
+		}
 		hdhomerun_control_close_sock(cs);
+	}
+
+	/* Find device. */
+	if (!hdhomerun_control_connect_sock_discover(cs)) {
 		return false;
 	}
 
-	/* Success. */
-	return true;
+	return hdhomerun_control_connect_sock_addr(cs);
 }
 
 uint32_t hdhomerun_control_get_device_id(struct hdhomerun_control_sock_t *cs)
 {
-	if (!hdhomerun_control_connect_sock(cs)) {
-		hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_get_device_id: connect failed\n");
-		return 0;
+	struct hdhomerun_control_sock_t *conn = hdhomerun_control_lock(cs);
+	uint32_t device_id = 0;
+
+	if (hdhomerun_control_connect_sock(conn)) {
+		device_id = conn->actual_device_id;
+	} else {
+		hdhomerun_debug_printf(conn->dbg, "hdhomerun_control_get_device_id: connect failed\n");
 	}
 
-	return cs->actual_device_id;
+	hdhomerun_control_unlock(cs);
+	return device_id;
 }
 
 uint32_t hdhomerun_control_get_device_ip(struct hdhomerun_control_sock_t *cs)
 {
-	if (!hdhomerun_control_connect_sock(cs)) {
-		hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_get_device_ip: connect failed\n");
+	struct sockaddr_storage device_addr;
+	if (!hdhomerun_control_get_device_addr(cs, &device_addr)) {
 		return 0;
 	}
 
-	if (cs->actual_device_addr.ss_family != AF_INET) {
+	if (device_addr.ss_family != AF_INET) {
 		return 0;
 	}
 
-	struct sockaddr_in *actual_device_addr_in = (struct sockaddr_in *)&cs->actual_device_addr;
-	return ntohl(actual_device_addr_in->sin_addr.s_addr);
+	struct sockaddr_in *device_addr_in = (struct sockaddr_in *)&device_addr;
+	return ntohl(device_addr_in->sin_addr.s_addr);
 }
 
 bool hdhomerun_control_get_device_addr(struct hdhomerun_control_sock_t *cs, struct sockaddr_storage *result)
 {
-	if (!hdhomerun_control_connect_sock(cs)) {
-		hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_get_device_ip: connect failed\n");
+	struct hdhomerun_control_sock_t *conn = hdhomerun_control_lock(cs);
+
+	if (hdhomerun_control_connect_sock(conn)) {
+		*result = conn->actual_device_addr;
+	} else {
+		hdhomerun_debug_printf(conn->dbg, "hdhomerun_control_get_device_ip: connect failed\n");
 		memset(result, 0, sizeof(struct sockaddr_storage));
-		return false;
 	}
 
-	*result = cs->actual_device_addr;
+	hdhomerun_control_unlock(cs);
 	return hdhomerun_sock_sockaddr_is_addr((struct sockaddr *)result);
 }
 
@@ -253,19 +794,28 @@ uint32_t hdhomerun_control_get_local_addr(struct hdhomerun_control_sock_t *cs)
 	return ntohl(local_addr_in->sin_addr.s_addr);
 }
 
+void hdhomerun_control_get_connect_stats(struct hdhomerun_control_sock_t *cs, int af, struct hdhomerun_control_connect_stats_t *stats)
+{
+	struct hdhomerun_control_sock_t *conn = hdhomerun_control_lock(cs);
+	*stats = conn->connect_stats[hdhomerun_control_connect_stats_index(af)];
+	hdhomerun_control_unlock(cs);
+}
+
 bool hdhomerun_control_get_local_addr_ex(struct hdhomerun_control_sock_t *cs, struct sockaddr_storage *result)
 {
-	if (!hdhomerun_control_connect_sock(cs)) {
-		hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_get_local_addr: connect failed\n");
-		return false;
-	}
+	struct hdhomerun_control_sock_t *conn = hdhomerun_control_lock(cs);
+	bool success = false;
 
-	if (!hdhomerun_sock_getsockname_addr_ex(cs->sock, result)) {
-		hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_get_local_addr: getsockname failed (%d)\n", hdhomerun_sock_getlasterror());
-		return false;
+	if (!hdhomerun_control_connect_sock(conn)) {
+		hdhomerun_debug_printf(conn->dbg, "hdhomerun_control_get_local_addr: connect failed\n");
+	} else if (!hdhomerun_sock_getsockname_addr_ex(conn->sock, result)) {
+		hdhomerun_debug_printf(conn->dbg, "hdhomerun_control_get_local_addr: getsockname failed (%d)\n", hdhomerun_sock_getlasterror());
+	} else {
+		success = true;
 	}
 
-	return true;
+	hdhomerun_control_unlock(cs);
+	return success;
 }
 
 static bool hdhomerun_control_send_sock(struct hdhomerun_control_sock_t *cs, struct hdhomerun_pkt_t *tx_pkt)
@@ -279,19 +829,39 @@ static bool hdhomerun_control_send_sock(struct hdhomerun_control_sock_t *cs, str
 	return true;
 }
 
-static bool hdhomerun_control_recv_sock(struct hdhomerun_control_sock_t *cs, struct hdhomerun_pkt_t *rx_pkt, uint16_t *ptype, uint64_t recv_timeout)
+/*
+ * Receive one frame into rx_pkt, which may already hold the start of the stream. If next_pkt is given, any data
+ * received beyond the end of the frame is moved to next_pkt (pipelined replies).
+ */
+static bool hdhomerun_control_recv_sock_ex(struct hdhomerun_control_sock_t *cs, struct hdhomerun_pkt_t *rx_pkt, struct hdhomerun_pkt_t *next_pkt, uint16_t *ptype, uint64_t recv_timeout)
 {
 	uint64_t stop_time = getcurrenttime() + recv_timeout;
-	hdhomerun_pkt_reset(rx_pkt);
 
 	while (1) {
-		uint64_t current_time = getcurrenttime();
-		if (current_time >= stop_time) {
-			hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_recv_sock: timeout\n");
+		uint8_t *stream_end = rx_pkt->end;
+		int ret = hdhomerun_pkt_open_frame(rx_pkt, ptype);
+		if (ret < 0) {
+			hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_recv_sock: frame error\n");
 			hdhomerun_control_close_sock(cs);
 			return false;
 		}
-
+		if (ret > 0) {
+			/* The frame ends with a 4 byte crc after rx_pkt->end. */
+			uint8_t *frame_end = rx_pkt->end + 4;
+			if (next_pkt && (stream_end > frame_end)) {
+				hdhomerun_pkt_reset(next_pkt);
+				hdhomerun_pkt_write_mem(next_pkt, frame_end, stream_end - frame_end);
+			}
+			return true;
+		}
+
+		uint64_t current_time = getcurrenttime();
+		if (current_time >= stop_time) {
+			hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_recv_sock: timeout\n");
+			hdhomerun_control_close_sock(cs);
+			return false;
+		}
+
 		size_t length = rx_pkt->limit - rx_pkt->end;
 		if (!hdhomerun_sock_recv(cs->sock, rx_pkt->end, &length, stop_time - current_time)) {
 			hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_recv_sock: recv failed (%d)\n", hdhomerun_sock_getlasterror());
@@ -300,19 +870,15 @@ static bool hdhomerun_control_recv_sock(struct hdhomerun_control_sock_t *cs, str
 		}
 
 		rx_pkt->end += length;
-
-		int ret = hdhomerun_pkt_open_frame(rx_pkt, ptype);
-		if (ret < 0) {
-			hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_recv_sock: frame error\n");
-			hdhomerun_control_close_sock(cs);
-			return false;
-		}
-		if (ret > 0) {
-			return true;
-		}
 	}
 }
 
+static bool hdhomerun_control_recv_sock(struct hdhomerun_control_sock_t *cs, struct hdhomerun_pkt_t *rx_pkt, uint16_t *ptype, uint64_t recv_timeout)
+{
+	hdhomerun_pkt_reset(rx_pkt);
+	return hdhomerun_control_recv_sock_ex(cs, rx_pkt, NULL, ptype, recv_timeout);
+}
+
 static int hdhomerun_control_send_recv_internal(struct hdhomerun_control_sock_t *cs, struct hdhomerun_pkt_t *tx_pkt, struct hdhomerun_pkt_t *rx_pkt, uint16_t type, uint64_t recv_timeout)
 {
 	hdhomerun_pkt_seal_frame(tx_pkt, type);
@@ -352,21 +918,20 @@ static int hdhomerun_control_send_recv_internal(struct hdhomerun_control_sock_t
 
 int hdhomerun_control_send_recv(struct hdhomerun_control_sock_t *cs, struct hdhomerun_pkt_t *tx_pkt, struct hdhomerun_pkt_t *rx_pkt, uint16_t type)
 {
-	return hdhomerun_control_send_recv_internal(cs, tx_pkt, rx_pkt, type, HDHOMERUN_CONTROL_RECV_TIMEOUT);
+	struct hdhomerun_control_sock_t *conn = hdhomerun_control_lock(cs);
+	int ret = hdhomerun_control_send_recv_internal(conn, tx_pkt, rx_pkt, type, HDHOMERUN_CONTROL_RECV_TIMEOUT);
+	hdhomerun_control_unlock(cs);
+	return ret;
 }
 
-static int hdhomerun_control_get_set(struct hdhomerun_control_sock_t *cs, const char *name, const char *value, uint32_t lockkey, char **pvalue, char **perror)
+static bool hdhomerun_control_get_set_request(struct hdhomerun_control_sock_t *cs, struct hdhomerun_pkt_t *tx_pkt, const char *name, const char *value, uint32_t lockkey)
 {
-	struct hdhomerun_pkt_t *tx_pkt = &cs->tx_pkt;
-	struct hdhomerun_pkt_t *rx_pkt = &cs->rx_pkt;
-
-	/* Request. */
 	hdhomerun_pkt_reset(tx_pkt);
 
 	size_t name_len = strlen(name) + 1;
 	if (tx_pkt->end + 3 + name_len > tx_pkt->limit) {
 		hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_get_set: request too long\n");
-		return -1;
+		return false;
 	}
 	hdhomerun_pkt_write_u8(tx_pkt, HDHOMERUN_TAG_GETSET_NAME);
 	hdhomerun_pkt_write_var_length(tx_pkt, name_len);
@@ -376,7 +941,7 @@ static int hdhomerun_control_get_set(struct hdhomerun_control_sock_t *cs, const
 		size_t value_len = strlen(value) + 1;
 		if (tx_pkt->end + 3 + value_len > tx_pkt->limit) {
 			hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_get_set: request too long\n");
-			return -1;
+			return false;
 		}
 		hdhomerun_pkt_write_u8(tx_pkt, HDHOMERUN_TAG_GETSET_VALUE);
 		hdhomerun_pkt_write_var_length(tx_pkt, value_len);
@@ -386,20 +951,18 @@ static int hdhomerun_control_get_set(struct hdhomerun_control_sock_t *cs, const
 	if (lockkey != 0) {
 		if (tx_pkt->end + 6 > tx_pkt->limit) {
 			hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_get_set: request too long\n");
-			return -1;
+			return false;
 		}
 		hdhomerun_pkt_write_u8(tx_pkt, HDHOMERUN_TAG_GETSET_LOCKKEY);
 		hdhomerun_pkt_write_var_length(tx_pkt, 4);
 		hdhomerun_pkt_write_u32(tx_pkt, lockkey);
 	}
 
-	/* Send/Recv. */
-	if (hdhomerun_control_send_recv_internal(cs, tx_pkt, rx_pkt, HDHOMERUN_TYPE_GETSET_REQ, HDHOMERUN_CONTROL_RECV_TIMEOUT) < 0) {
-		hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_get_set: send/recv error\n");
-		return -1;
-	}
+	return true;
+}
 
-	/* Response. */
+static int hdhomerun_control_get_set_response(struct hdhomerun_control_sock_t *cs, struct hdhomerun_pkt_t *rx_pkt, char **pvalue, char **perror)
+{
 	while (1) {
 		uint8_t tag;
 		size_t len;
@@ -443,31 +1006,637 @@ static int hdhomerun_control_get_set(struct hdhomerun_control_sock_t *cs, const
 	return -1;
 }
 
+static int hdhomerun_control_get_set(struct hdhomerun_control_sock_t *cs, struct hdhomerun_pkt_t *rx_pkt, const char *name, const char *value, uint32_t lockkey, char **pvalue, char **perror)
+{
+	struct hdhomerun_pkt_t *tx_pkt = &cs->tx_pkt;
+
+	/* Request. */
+	if (!hdhomerun_control_get_set_request(cs, tx_pkt, name, value, lockkey)) {
+		return -1;
+	}
+
+	/* Send/Recv. */
+	if (hdhomerun_control_send_recv_internal(cs, tx_pkt, rx_pkt, HDHOMERUN_TYPE_GETSET_REQ, HDHOMERUN_CONTROL_RECV_TIMEOUT) < 0) {
+		hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_get_set: send/recv error\n");
+		return -1;
+	}
+
+	/* Response. */
+	return hdhomerun_control_get_set_response(cs, rx_pkt, pvalue, perror);
+}
+
+static int hdhomerun_control_get_set_locked(struct hdhomerun_control_sock_t *cs, const char *name, const char *value, uint32_t lockkey, char **pvalue, char **perror)
+{
+	struct hdhomerun_control_sock_t *conn = hdhomerun_control_lock(cs);
+	int ret = hdhomerun_control_get_set(conn, &cs->rx_pkt, name, value, lockkey, pvalue, perror);
+	hdhomerun_control_unlock(cs);
+	return ret;
+}
+
 int hdhomerun_control_get(struct hdhomerun_control_sock_t *cs, const char *name, char **pvalue, char **perror)
 {
-	return hdhomerun_control_get_set(cs, name, NULL, 0, pvalue, perror);
+	return hdhomerun_control_get_set_locked(cs, name, NULL, 0, pvalue, perror);
 }
 
 int hdhomerun_control_set(struct hdhomerun_control_sock_t *cs, const char *name, const char *value, char **pvalue, char **perror)
 {
-	return hdhomerun_control_get_set(cs, name, value, 0, pvalue, perror);
+	return hdhomerun_control_get_set_locked(cs, name, value, 0, pvalue, perror);
 }
 
 int hdhomerun_control_set_with_lockkey(struct hdhomerun_control_sock_t *cs, const char *name, const char *value, uint32_t lockkey, char **pvalue, char **perror)
 {
-	return hdhomerun_control_get_set(cs, name, value, lockkey, pvalue, perror);
+	return hdhomerun_control_get_set_locked(cs, name, value, lockkey, pvalue, perror);
 }
 
-int hdhomerun_control_upgrade(struct hdhomerun_control_sock_t *cs, FILE *upgrade_file)
+/*
+ * Write the requests back-to-back, coalescing the frames so that a typical batch leaves in one segment.
+ */
+static bool hdhomerun_control_get_set_batch_send(struct hdhomerun_control_sock_t *cs, struct hdhomerun_control_get_set_batch_t batch[], size_t count)
+{
+	struct hdhomerun_pkt_t *tx_pkt = &cs->tx_pkt;
+	uint8_t buffer[HDHOMERUN_CONTROL_BATCH_SEND_SIZE];
+	size_t length = 0;
+
+	size_t i;
+	for (i = 0; i < count; i++) {
+		hdhomerun_control_get_set_request(cs, tx_pkt, batch[i].name, batch[i].value, batch[i].lockkey);
+		hdhomerun_pkt_seal_frame(tx_pkt, HDHOMERUN_TYPE_GETSET_REQ);
+
+		size_t frame_length = tx_pkt->end - tx_pkt->start;
+		if (length + frame_length > sizeof(buffer)) {
+			if (!hdhomerun_sock_send(cs->sock, buffer, length, HDHOMERUN_CONTROL_SEND_TIMEOUT)) {
+				break;
+			}
+			length = 0;
+		}
+
+		memcpy(buffer + length, tx_pkt->start, frame_length);
+		length += frame_length;
+	}
+
+	if ((i < count) || !hdhomerun_sock_send(cs->sock, buffer, length, HDHOMERUN_CONTROL_SEND_TIMEOUT)) {
+		hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_get_set_batch: send failed (%d)\n", hdhomerun_sock_getlasterror());
+		hdhomerun_control_close_sock(cs);
+		return false;
+	}
+
+	return true;
+}
+
+static int hdhomerun_control_get_set_batch_internal(struct hdhomerun_control_sock_t *cs, struct hdhomerun_control_get_set_batch_t batch[], size_t count)
+{
+	size_t i;
+	for (i = 0; i < count; i++) {
+		batch[i].result = -1;
+		batch[i].response_value = NULL;
+		batch[i].response_error = NULL;
+
+		/* Reject oversized requests before anything is sent. */
+		if (!hdhomerun_control_get_set_request(cs, &cs->tx_pkt, batch[i].name, batch[i].value, batch[i].lockkey)) {
+			return -1;
+		}
+	}
+
+	size_t done = 0;
+	int attempt;
+	for (attempt = 0; (attempt < 2) && (done < count); attempt++) {
+		if (!cs->sock) {
+			if (!hdhomerun_control_connect_sock(cs)) {
+				hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_get_set_batch: connect failed\n");
+				return -1;
+			}
+		}
+
+		/* Requests already answered on a previous connection are not sent again. */
+		if (!hdhomerun_control_get_set_batch_send(cs, batch + done, count - done)) {
+			continue;
+		}
+
+		hdhomerun_pkt_reset(&batch[done].rx_pkt);
+
+		while (done < count) {
+			struct hdhomerun_pkt_t *rx_pkt = &batch[done].rx_pkt;
+			struct hdhomerun_pkt_t *next_pkt = NULL;
+			if (done + 1 < count) {
+				next_pkt = &batch[done + 1].rx_pkt;
+				hdhomerun_pkt_reset(next_pkt);
+			}
+
+			uint16_t rsp_type;
+			if (!hdhomerun_control_recv_sock_ex(cs, rx_pkt, next_pkt, &rsp_type, HDHOMERUN_CONTROL_RECV_TIMEOUT)) {
+				break;
+			}
+			if (rsp_type != HDHOMERUN_TYPE_GETSET_RPY) {
+				hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_get_set_batch: unexpected frame type\n");
+				hdhomerun_control_close_sock(cs);
+				break;
+			}
+
+			batch[done].result = hdhomerun_control_get_set_response(cs, rx_pkt, &batch[done].response_value, &batch[done].response_error);
+			done++;
+		}
+	}
+
+	if (done < count) {
+		hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_get_set_batch: failed\n");
+		return -1;
+	}
+
+	return 1;
+}
+
+int hdhomerun_control_get_set_batch(struct hdhomerun_control_sock_t *cs, struct hdhomerun_control_get_set_batch_t batch[], size_t count)
+{
+	struct hdhomerun_control_sock_t *conn = hdhomerun_control_lock(cs);
+	int ret = hdhomerun_control_get_set_batch_internal(conn, batch, count);
+	hdhomerun_control_unlock(cs);
+	return ret;
+}
+
+static bool hdhomerun_control_async_submit(struct hdhomerun_control_sock_t *cs, const char *name, const char *value, uint32_t lockkey, hdhomerun_control_callback_t callback, void *callback_arg)
+{
+	if (cs->shared) {
+		hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_async: not supported on a shared control object\n");
+		return false;
+	}
+	if (cs->async_closing) {
+		hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_async: control object is being destroyed\n");
+		return false;
+	}
+
+	struct hdhomerun_pkt_t *tx_pkt = &cs->tx_pkt;
+	if (!hdhomerun_control_get_set_request(cs, tx_pkt, name, value, lockkey)) {
+		return false;
+	}
+	hdhomerun_pkt_seal_frame(tx_pkt, HDHOMERUN_TYPE_GETSET_REQ);
+
+	size_t frame_length = tx_pkt->end - tx_pkt->start;
+	struct hdhomerun_control_request_t *request = (struct hdhomerun_control_request_t *)malloc(sizeof(struct hdhomerun_control_request_t) + frame_length);
+	if (!request) {
+		hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_async: failed to allocate request\n");
+		return false;
+	}
+
+	request->next = NULL;
+	request->callback = callback;
+	request->callback_arg = callback_arg;
+	request->frame = (uint8_t *)(request + 1);
+	request->frame_length = frame_length;
+	request->send_count = 0;
+	memcpy(request->frame, tx_pkt->start, frame_length);
+
+	if (cs->async_tail) {
+		cs->async_tail->next = request;
+	} else {
+		cs->async_head = request;
+	}
+	cs->async_tail = request;
+
+	if (!cs->async_unsent) {
+		cs->async_unsent = request;
+		cs->async_unsent_offset = 0;
+	}
+
+	return true;
+}
+
+bool hdhomerun_control_get_async(struct hdhomerun_control_sock_t *cs, const char *name, hdhomerun_control_callback_t callback, void *callback_arg)
+{
+	return hdhomerun_control_async_submit(cs, name, NULL, 0, callback, callback_arg);
+}
+
+bool hdhomerun_control_set_async(struct hdhomerun_control_sock_t *cs, const char *name, const char *value, hdhomerun_control_callback_t callback, void *callback_arg)
+{
+	return hdhomerun_control_async_submit(cs, name, value, 0, callback, callback_arg);
+}
+
+bool hdhomerun_control_set_with_lockkey_async(struct hdhomerun_control_sock_t *cs, const char *name, const char *value, uint32_t lockkey, hdhomerun_control_callback_t callback, void *callback_arg)
+{
+	return hdhomerun_control_async_submit(cs, name, value, lockkey, callback, callback_arg);
+}
+
+static bool hdhomerun_control_async_outstanding(struct hdhomerun_control_sock_t *cs)
+{
+	return cs->async_head && ((cs->async_head != cs->async_unsent) || (cs->async_unsent_offset > 0));
+}
+
+/*
+ * Forget the address that failed so the next request goes through discovery again, as the blocking connect does.
+ */
+static void hdhomerun_control_async_connect_fail(struct hdhomerun_control_sock_t *cs)
+{
+	hdhomerun_discover_cache_invalidate(cs->actual_device_id, (struct sockaddr *)&cs->actual_device_addr);
+	memset(&cs->actual_device_addr, 0, sizeof(cs->actual_device_addr));
+	cs->candidate_count = 0;
+
+	hdhomerun_control_close_sock(cs);
+	hdhomerun_control_async_fail_all(cs);
+}
+
+static void hdhomerun_control_async_connect_tcp(struct hdhomerun_control_sock_t *cs, uint64_t current_time)
+{
+	hdhomerun_control_connect_stats_attempt(cs, cs->actual_device_addr.ss_family);
+
+	cs->sock = hdhomerun_sock_create_tcp_ex(cs->actual_device_addr.ss_family);
+	if (!cs->sock) {
+		hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_async: failed to create socket (%d)\n", hdhomerun_sock_getlasterror());
+		hdhomerun_control_connect_stats_fail(cs, cs->actual_device_addr.ss_family);
+		hdhomerun_control_async_fail_all(cs);
+		return;
+	}
+
+	hdhomerun_sock_sockaddr_set_port((struct sockaddr *)&cs->actual_device_addr, HDHOMERUN_CONTROL_TCP_PORT);
+	cs->connect_start_ticks = timer_get_hires_ticks();
+	if (!hdhomerun_sock_connect_start(cs->sock, (struct sockaddr *)&cs->actual_device_addr)) {
+		hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_async: failed to connect (%d)\n", hdhomerun_sock_getlasterror());
+		hdhomerun_control_connect_stats_fail(cs, cs->actual_device_addr.ss_family);
+		hdhomerun_control_async_connect_fail(cs);
+		return;
+	}
+
+	cs->async_state = HDHOMERUN_CONTROL_ASYNC_STATE_CONNECTING;
+	cs->async_timeout_time = current_time + HDHOMERUN_CONTROL_CONNECT_TIMEOUT;
+}
+
+struct hdhomerun_control_async_broadcast_t {
+	struct hdhomerun_control_sock_t *cs;
+	bool sent;
+};
+
+static void hdhomerun_control_async_broadcast_local_ip(void *arg, uint32_t ifindex, const struct sockaddr *local_ip, uint8_t cidr)
+{
+	struct hdhomerun_control_async_broadcast_t *broadcast = (struct hdhomerun_control_async_broadcast_t *)arg;
+	if ((local_ip->sa_family != AF_INET) || (cidr == 0) || (cidr >= 31)) {
+		return;
+	}
+
+	uint32_t local_ip_val = ntohl(((const struct sockaddr_in *)local_ip)->sin_addr.s_addr);
+	uint32_t subnet_broadcast = local_ip_val | (0xFFFFFFFF >> cidr);
+	if ((subnet_broadcast == 0) || (subnet_broadcast >= 0xE0000000)) {
+		return;
+	}
+
+	struct sockaddr_in target_addr;
+	memset(&target_addr, 0, sizeof(target_addr));
+	target_addr.sin_family = AF_INET;
+	target_addr.sin_addr.s_addr = htonl(subnet_broadcast);
+
+	struct hdhomerun_control_sock_t *cs = broadcast->cs;
+	if (hdhomerun_control_discover_send(cs->discover_sock, (const struct sockaddr *)&target_addr, cs->desired_device_id)) {
+		broadcast->sent = true;
+	}
+}
+
+/*
+ * A device given only by id is found by sending to the broadcast address of each local IPv4 subnet from the one
+ * socket, so the replies can be waited on without blocking.
+ */
+static bool hdhomerun_control_async_discover_send(struct hdhomerun_control_sock_t *cs)
+{
+	if (hdhomerun_sock_sockaddr_is_addr((struct sockaddr *)&cs->discover_target_addr)) {
+		return hdhomerun_control_discover_send(cs->discover_sock, (struct sockaddr *)&cs->discover_target_addr, cs->desired_device_id);
+	}
+
+	struct hdhomerun_control_async_broadcast_t broadcast;
+	broadcast.cs = cs;
+	broadcast.sent = false;
+	hdhomerun_local_ip_info2(AF_INET, hdhomerun_control_async_broadcast_local_ip, &broadcast);
+
+	struct sockaddr_in target_addr;
+	memset(&target_addr, 0, sizeof(target_addr));
+	target_addr.sin_family = AF_INET;
+	target_addr.sin_addr.s_addr = htonl(0xFFFFFFFF);
+	if (hdhomerun_control_discover_send(cs->discover_sock, (const struct sockaddr *)&target_addr, cs->desired_device_id)) {
+		broadcast.sent = true;
+	}
+
+	return broadcast.sent;
+}
+
+static bool hdhomerun_control_async_discover_start(struct hdhomerun_control_sock_t *cs, const struct sockaddr *target_addr, bool cached, uint64_t current_time)
+{
+	if (target_addr) {
+		hdhomerun_sock_sockaddr_copy(&cs->discover_target_addr, target_addr);
+	} else {
+		memset(&cs->discover_target_addr, 0, sizeof(cs->discover_target_addr));
+		cs->discover_target_addr.ss_family = AF_INET;
+	}
+	cs->discover_cached = cached;
+
+	cs->discover_sock = hdhomerun_sock_create_udp_ex(cs->discover_target_addr.ss_family);
+	if (!cs->discover_sock) {
+		hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_async: failed to create discover socket (%d)\n", hdhomerun_sock_getlasterror());
+		return false;
+	}
+
+	cs->async_state = HDHOMERUN_CONTROL_ASYNC_STATE_DISCOVER;
+	cs->discover_attempt = 0;
+	cs->async_timeout_time = current_time + HDHOMERUN_CONTROL_DISCOVER_TIMEOUT;
+	hdhomerun_control_async_discover_send(cs);
+	return true;
+}
+
+/*
+ * Discover the device from the given address, or by broadcast if the device was given only by id.
+ */
+static bool hdhomerun_control_async_discover_desired(struct hdhomerun_control_sock_t *cs, uint64_t current_time)
+{
+	if (hdhomerun_sock_sockaddr_is_addr((struct sockaddr *)&cs->desired_device_addr)) {
+		return hdhomerun_control_async_discover_start(cs, (struct sockaddr *)&cs->desired_device_addr, false, current_time);
+	}
+
+	return hdhomerun_control_async_discover_start(cs, NULL, false, current_time);
+}
+
+static void hdhomerun_control_async_discover_recv(struct hdhomerun_control_sock_t *cs, uint64_t current_time)
+{
+	uint32_t device_id;
+	struct sockaddr_storage remote_addr;
+	if (!hdhomerun_control_discover_recv(cs->discover_sock, cs->desired_device_id, 0, &device_id, &remote_addr)) {
+		return;
+	}
+
+	hdhomerun_sock_destroy(cs->discover_sock);
+	cs->discover_sock = NULL;
+	cs->async_state = HDHOMERUN_CONTROL_ASYNC_STATE_IDLE;
+
+	cs->actual_device_id = device_id;
+	cs->actual_device_addr = remote_addr;
+	hdhomerun_control_async_connect_tcp(cs, current_time);
+}
+
+static void hdhomerun_control_async_connect(struct hdhomerun_control_sock_t *cs, uint64_t current_time)
+{
+	/* Requests already sent on two connections fail, as with hdhomerun_control_send_recv. */
+	while (cs->async_head && (cs->async_head->send_count >= 2)) {
+		hdhomerun_control_async_complete(cs, -1, NULL, NULL);
+	}
+	if (!cs->async_head) {
+		return;
+	}
+
+	if ((cs->desired_device_id == 0) && !hdhomerun_sock_sockaddr_is_addr((struct sockaddr *)&cs->desired_device_addr)) {
+		hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_async: no device specified\n");
+		hdhomerun_control_async_fail_all(cs);
+		return;
+	}
+	if (hdhomerun_sock_sockaddr_is_multicast((struct sockaddr *)&cs->desired_device_addr)) {
+		hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_async: cannot use multicast ip address for device operations\n");
+		hdhomerun_control_async_fail_all(cs);
+		return;
+	}
+
+	if (hdhomerun_sock_sockaddr_is_addr((struct sockaddr *)&cs->actual_device_addr)) {
+		hdhomerun_control_async_connect_tcp(cs, current_time);
+		return;
+	}
+
+	/* Check a recent discover result with a targeted discover before falling back to the usual discovery. */
+	uint32_t cached_device_id;
+	struct sockaddr_storage cached_addr;
+	bool success;
+	if (hdhomerun_discover_cache_lookup(cs->desired_device_id, (struct sockaddr *)&cs->desired_device_addr, &cached_device_id, &cached_addr)) {
+		success = hdhomerun_control_async_discover_start(cs, (struct sockaddr *)&cached_addr, true, current_time);
+	} else {
+		success = hdhomerun_control_async_discover_desired(cs, current_time);
+	}
+
+	if (!success) {
+		hdhomerun_control_async_fail_all(cs);
+	}
+}
+
+static bool hdhomerun_control_async_write(struct hdhomerun_control_sock_t *cs, uint64_t current_time)
+{
+	while (cs->async_unsent) {
+		struct hdhomerun_control_request_t *request = cs->async_unsent;
+		size_t length = request->frame_length - cs->async_unsent_offset;
+
+		int ret = hdhomerun_sock_send_nonblocking(cs->sock, request->frame + cs->async_unsent_offset, &length);
+		if (ret < 0) {
+			hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_async: send failed (%d)\n", hdhomerun_sock_getlasterror());
+			hdhomerun_control_close_sock(cs);
+			return false;
+		}
+		if ((ret == 0) || (length == 0)) {
+			return true;
+		}
+
+		if (!hdhomerun_control_async_outstanding(cs)) {
+			cs->async_timeout_time = current_time + HDHOMERUN_CONTROL_RECV_TIMEOUT;
+		}
+		if (cs->async_unsent_offset == 0) {
+			request->send_count++;
+		}
+
+		cs->async_unsent_offset += length;
+		if (cs->async_unsent_offset >= request->frame_length) {
+			cs->async_unsent = request->next;
+			cs->async_unsent_offset = 0;
+		}
+	}
+
+	return true;
+}
+
+static bool hdhomerun_control_async_read(struct hdhomerun_control_sock_t *cs, uint64_t current_time)
+{
+	struct hdhomerun_pkt_t *rx_pkt = &cs->async_rx_pkt;
+
+	while (1) {
+		if (rx_pkt->end >= rx_pkt->limit) {
+			hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_async: frame error\n");
+			hdhomerun_control_close_sock(cs);
+			return false;
+		}
+
+		size_t length = rx_pkt->limit - rx_pkt->end;
+		int ret = hdhomerun_sock_recv_nonblocking(cs->sock, rx_pkt->end, &length);
+		if (ret < 0) {
+			hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_async: recv failed (%d)\n", hdhomerun_sock_getlasterror());
+			hdhomerun_control_close_sock(cs);
+			return false;
+		}
+		if (ret == 0) {
+			return true;
+		}
+
+		rx_pkt->end += length;
+		cs->async_timeout_time = current_time + HDHOMERUN_CONTROL_RECV_TIMEOUT;
+
+		while (1) {
+			uint8_t *stream_end = rx_pkt->end;
+			uint16_t type;
+			int frame = hdhomerun_pkt_open_frame(rx_pkt, &type);
+			if (frame < 0) {
+				hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_async: frame error\n");
+				hdhomerun_control_close_sock(cs);
+				return false;
+			}
+			if (frame == 0) {
+				break;
+			}
+
+			if ((cs->async_head == cs->async_unsent) || (type != HDHOMERUN_TYPE_GETSET_RPY)) {
+				hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_async: unexpected frame type\n");
+				hdhomerun_control_close_sock(cs);
+				return false;
+			}
+
+			char *value = NULL;
+			char *error = NULL;
+			int result = hdhomerun_control_get_set_response(cs, rx_pkt, &value, &error);
+			hdhomerun_control_async_complete(cs, result, value, error);
+
+			/* Keep any data received beyond the end of the frame (4 byte crc after rx_pkt->end). */
+			uint8_t *frame_end = rx_pkt->end + 4;
+			size_t remaining = stream_end - frame_end;
+			hdhomerun_pkt_reset(rx_pkt);
+			memmove(rx_pkt->start, frame_end, remaining);
+			rx_pkt->end += remaining;
+		}
+	}
+}
+
+void hdhomerun_control_process(struct hdhomerun_control_sock_t *cs, int revents)
+{
+	uint64_t current_time = getcurrenttime();
+
+	switch (cs->async_state) {
+	case HDHOMERUN_CONTROL_ASYNC_STATE_DISCOVER:
+		if (revents) {
+			hdhomerun_control_async_discover_recv(cs, current_time);
+		}
+		if ((cs->async_state == HDHOMERUN_CONTROL_ASYNC_STATE_DISCOVER) && (current_time >= cs->async_timeout_time)) {
+			cs->discover_attempt++;
+			if (cs->discover_cached && (cs->discover_attempt >= 2)) {
+				hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_async: cached address not valid\n");
+				hdhomerun_discover_cache_invalidate(cs->desired_device_id, (struct sockaddr *)&cs->discover_target_addr);
+				hdhomerun_control_close_sock(cs);
+				if (!hdhomerun_control_async_discover_desired(cs, current_time)) {
+					hdhomerun_control_async_fail_all(cs);
+				}
+				return;
+			}
+			if ((cs->discover_attempt >= 2) || !hdhomerun_control_async_discover_send(cs)) {
+				hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_async: device not found\n");
+				hdhomerun_control_close_sock(cs);
+				hdhomerun_control_async_fail_all(cs);
+				return;
+			}
+			cs->async_timeout_time = current_time + HDHOMERUN_CONTROL_DISCOVER_TIMEOUT;
+		}
+		return;
+
+	case HDHOMERUN_CONTROL_ASYNC_STATE_CONNECTING:
+		if (!revents) {
+			if (current_time >= cs->async_timeout_time) {
+				hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_async: connect timeout\n");
+				hdhomerun_control_connect_stats_fail(cs, cs->actual_device_addr.ss_family);
+				hdhomerun_control_async_connect_fail(cs);
+			}
+			return;
+		}
+		if (!hdhomerun_sock_connect_finish(cs->sock)) {
+			hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_async: failed to connect (%d)\n", hdhomerun_sock_getlasterror());
+			hdhomerun_control_connect_stats_fail(cs, cs->actual_device_addr.ss_family);
+			hdhomerun_control_async_connect_fail(cs);
+			return;
+		}
+		hdhomerun_control_connect_stats_success(cs, cs->actual_device_addr.ss_family, cs->connect_start_ticks);
+		cs->async_state = HDHOMERUN_CONTROL_ASYNC_STATE_IDLE;
+		revents = 0;
+		break;
+
+	default:
+		break;
+	}
+
+	if (!cs->sock) {
+		hdhomerun_control_async_connect(cs, current_time);
+		return;
+	}
+
+	if (revents & (HDHOMERUN_CONTROL_EVENT_READ | HDHOMERUN_CONTROL_EVENT_ERROR)) {
+		if (!hdhomerun_control_async_read(cs, current_time)) {
+			return;
+		}
+	}
+
+	if (!hdhomerun_control_async_write(cs, current_time)) {
+		return;
+	}
+
+	if (hdhomerun_control_async_outstanding(cs) && (current_time >= cs->async_timeout_time)) {
+		hdhomerun_debug_printf(cs->dbg, "hdhomerun_control_async: timeout\n");
+		hdhomerun_control_close_sock(cs);
+	}
+}
+
+hdhomerun_sock_fd_t hdhomerun_control_get_fd(struct hdhomerun_control_sock_t *cs)
+{
+	if (cs->discover_sock) {
+		return hdhomerun_sock_get_fd(cs->discover_sock);
+	}
+	if (cs->sock) {
+		return hdhomerun_sock_get_fd(cs->sock);
+	}
+
+	return HDHOMERUN_SOCK_FD_INVALID;
+}
+
+int hdhomerun_control_get_poll_events(struct hdhomerun_control_sock_t *cs)
+{
+	switch (cs->async_state) {
+	case HDHOMERUN_CONTROL_ASYNC_STATE_DISCOVER:
+		return HDHOMERUN_CONTROL_EVENT_READ;
+
+	case HDHOMERUN_CONTROL_ASYNC_STATE_CONNECTING:
+		return HDHOMERUN_CONTROL_EVENT_WRITE;
+
+	default:
+		break;
+	}
+
+	if (!cs->sock) {
+		return 0;
+	}
+
+	if (cs->async_unsent) {
+		return HDHOMERUN_CONTROL_EVENT_READ | HDHOMERUN_CONTROL_EVENT_WRITE;
+	}
+
+	return HDHOMERUN_CONTROL_EVENT_READ;
+}
+
+int64_t hdhomerun_control_get_timeout(struct hdhomerun_control_sock_t *cs)
+{
+	if (cs->async_state == HDHOMERUN_CONTROL_ASYNC_STATE_IDLE) {
+		if (!cs->sock) {
+			return (cs->async_head) ? 0 : -1;
+		}
+		if (!hdhomerun_control_async_outstanding(cs)) {
+			return -1;
+		}
+	}
+
+	uint64_t current_time = getcurrenttime();
+	if (current_time >= cs->async_timeout_time) {
+		return 0;
+	}
+
+	return (int64_t)(cs->async_timeout_time - current_time);
+}
+
+static int hdhomerun_control_upgrade_internal(struct hdhomerun_control_sock_t *cs, struct hdhomerun_pkt_t *rx_pkt, FILE *upgrade_file)
 {
 	struct hdhomerun_pkt_t *tx_pkt = &cs->tx_pkt;
-	struct hdhomerun_pkt_t *rx_pkt = &cs->rx_pkt;
 	bool upload_delay = false;
 	uint32_t sequence = 0;
 
 	/* Special case detection. */
 	char *version_str;
-	int ret = hdhomerun_control_get(cs, "/sys/version", &version_str, NULL);
+	int ret = hdhomerun_control_get_set(cs, rx_pkt, "/sys/version", NULL, 0, &version_str, NULL);
 	if (ret > 0) {
 		upload_delay = strcmp(version_str, "20120704beta1") == 0;
 	}
@@ -535,3 +1704,11 @@ int hdhomerun_control_upgrade(struct hdhomerun_control_sock_t *cs, FILE *upgrade
 
 	return 1;
 }
+
+int hdhomerun_control_upgrade(struct hdhomerun_control_sock_t *cs, FILE *upgrade_file)
+{
+	struct hdhomerun_control_sock_t *conn = hdhomerun_control_lock(cs);
+	int ret = hdhomerun_control_upgrade_internal(conn, &cs->rx_pkt, upgrade_file);
+	hdhomerun_control_unlock(cs);
+	return ret;
+}
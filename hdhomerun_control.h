@@ -41,6 +41,29 @@ extern LIBHDHOMERUN_API struct hdhomerun_control_sock_t *hdhomerun_control_creat
 extern LIBHDHOMERUN_API struct hdhomerun_control_sock_t *hdhomerun_control_create_ex(uint32_t device_id, const struct sockaddr *device_addr, struct hdhomerun_debug_t *dbg);
 extern LIBHDHOMERUN_API void hdhomerun_control_destroy(struct hdhomerun_control_sock_t *cs);
 
+/*
+ * Create a control socket that shares one connection with every other shared control socket for the same device
+ * in this process. A connection is reused when device_id and device_addr match those it was created with or,
+ * once it has connected, the device id and address it found.
+ *
+ * Each shared control socket may be used from a different thread. Calls are serialized on the connection and
+ * the strings returned by hdhomerun_control_get/set remain valid until the next call on the same control socket.
+ * The connection is closed when the last shared control socket is destroyed.
+ *
+ * Changing the device of a shared control socket (hdhomerun_control_set_device) takes it out of the pool and
+ * gives it a connection of its own. The asynchronous API is not available on a shared control socket.
+ *
+ * hdhomerun_control_set_device_shared: Change the device of a control socket (shared or not) and move it to the
+ * pooled connection for the new device. The control socket pointer stays valid. Returns false if no pooled
+ * connection could be allocated; the control socket then continues with a connection of its own.
+ *
+ * hdhomerun_control_create_unshared: Create a control socket with its own connection to the same device as cs
+ * (shared or not), for example for the asynchronous API. Starts from the address already found by cs.
+ */
+extern LIBHDHOMERUN_API struct hdhomerun_control_sock_t *hdhomerun_control_create_shared(uint32_t device_id, const struct sockaddr *device_addr, struct hdhomerun_debug_t *dbg);
+extern LIBHDHOMERUN_API struct hdhomerun_control_sock_t *hdhomerun_control_create_unshared(struct hdhomerun_control_sock_t *cs, struct hdhomerun_debug_t *dbg);
+extern LIBHDHOMERUN_API bool hdhomerun_control_set_device_shared(struct hdhomerun_control_sock_t *cs, uint32_t device_id, const struct sockaddr *device_addr);
+
 /*
  * Get the actual device id or ip of the device.
  *
@@ -66,6 +89,26 @@ extern LIBHDHOMERUN_API void hdhomerun_control_set_device_ex(struct hdhomerun_co
 extern LIBHDHOMERUN_API uint32_t hdhomerun_control_get_local_addr(struct hdhomerun_control_sock_t *cs);
 extern LIBHDHOMERUN_API bool hdhomerun_control_get_local_addr_ex(struct hdhomerun_control_sock_t *cs, struct sockaddr_storage *result);
 
+/*
+ * Connection statistics for one address family (AF_INET or AF_INET6).
+ *
+ * When the device has several addresses (IPv4, IPv6 global, IPv6 link-local) TCP connections to them are raced,
+ * each starting HDHOMERUN_CONTROL_CONNECT_ATTEMPT_DELAY ms after the previous one unless it has already failed.
+ * The first to complete is used; attempts abandoned because another address won are not counted as failures.
+ */
+#define HDHOMERUN_CONTROL_CONNECT_ATTEMPT_DELAY 250
+
+struct hdhomerun_control_connect_stats_t {
+	uint32_t attempt_count;
+	uint32_t success_count;
+	uint32_t fail_count; /* refused, unreachable or timed out */
+	uint64_t connect_time_last; /* microseconds */
+	uint64_t connect_time_avg;
+	uint64_t connect_time_max;
+};
+
+extern LIBHDHOMERUN_API void hdhomerun_control_get_connect_stats(struct hdhomerun_control_sock_t *cs, int af, struct hdhomerun_control_connect_stats_t *stats);
+
 /*
  * Low-level communication.
  */
@@ -92,6 +135,80 @@ extern LIBHDHOMERUN_API int hdhomerun_control_get(struct hdhomerun_control_sock_
 extern LIBHDHOMERUN_API int hdhomerun_control_set(struct hdhomerun_control_sock_t *cs, const char *name, const char *value, char **pvalue, char **perror);
 extern LIBHDHOMERUN_API int hdhomerun_control_set_with_lockkey(struct hdhomerun_control_sock_t *cs, const char *name, const char *value, uint32_t lockkey, char **pvalue, char **perror);
 
+/*
+ * Get/set several control variables in one round trip.
+ *
+ * All requests are written to the connection back-to-back and the replies are read in order. Each entry holds
+ * its own reply so the strings remain valid until the entry is reused.
+ *
+ * Set by the caller:
+ * const char *name, const char *value: As hdhomerun_control_set. value NULL for a get.
+ * uint32_t lockkey: As hdhomerun_control_set_with_lockkey. 0 for none.
+ *
+ * Set by hdhomerun_control_get_set_batch:
+ * int result: As hdhomerun_control_get: 1 (response_value set), 0 (response_error set) or -1.
+ *
+ * If the connection fails part way through, it is re-established once and the requests that have not been
+ * answered are sent again.
+ *
+ * Returns 1 if every request was answered (individual results may still be 0).
+ * Returns -1 if a communication error occurs; unanswered entries have result -1.
+ */
+struct hdhomerun_control_get_set_batch_t {
+	const char *name;
+	const char *value;
+	uint32_t lockkey;
+	int result;
+	char *response_value;
+	char *response_error;
+	struct hdhomerun_pkt_t rx_pkt;
+};
+
+extern LIBHDHOMERUN_API int hdhomerun_control_get_set_batch(struct hdhomerun_control_sock_t *cs, struct hdhomerun_control_get_set_batch_t batch[], size_t count);
+
+/*
+ * Asynchronous get/set for event loops.
+ *
+ * hdhomerun_control_get_async / hdhomerun_control_set_async / hdhomerun_control_set_with_lockkey_async queue a
+ * request and return immediately. Queued requests are written back-to-back as soon as the connection allows and
+ * each callback is called from hdhomerun_control_process with the same result, value and error as
+ * hdhomerun_control_get. The strings are only valid during the callback. Returns false if the request is too
+ * long or cannot be allocated; the callback is not called in that case.
+ *
+ * After submitting requests and after each call to hdhomerun_control_process, query:
+ * hdhomerun_control_get_fd: the socket to wait on, or HDHOMERUN_SOCK_FD_INVALID. It changes as the connection
+ *		moves from discovery to TCP and when the connection is re-established.
+ * hdhomerun_control_get_poll_events: HDHOMERUN_CONTROL_EVENT_READ and/or HDHOMERUN_CONTROL_EVENT_WRITE.
+ * hdhomerun_control_get_timeout: milliseconds until hdhomerun_control_process must be called even without an
+ *		event, 0 to call it now, or -1 for no timeout.
+ * Then call hdhomerun_control_process with the events that occurred (HDHOMERUN_CONTROL_EVENT_ERROR for
+ * POLLERR/POLLHUP), or 0 on timeout.
+ *
+ * Discovery, the TCP connection and all timeouts are part of the state machine, with the same timeouts and single
+ * retry as the blocking calls. An address from the discover cache is checked with a targeted discover first. A
+ * device given only by device id is otherwise found by a discover sent to the broadcast address of each local
+ * IPv4 subnet.
+ *
+ * Callbacks may submit further requests but must not call any other control function on the same socket.
+ * Blocking calls must not be made while asynchronous requests are outstanding. Requests still queued when the
+ * device is changed or the socket is destroyed complete with -1; requests submitted from those callbacks are
+ * rejected while the socket is being destroyed.
+ */
+#define HDHOMERUN_CONTROL_EVENT_READ 0x01
+#define HDHOMERUN_CONTROL_EVENT_WRITE 0x02
+#define HDHOMERUN_CONTROL_EVENT_ERROR 0x04
+
+typedef void (*hdhomerun_control_callback_t)(void *arg, int result, char *value, char *error);
+
+extern LIBHDHOMERUN_API bool hdhomerun_control_get_async(struct hdhomerun_control_sock_t *cs, const char *name, hdhomerun_control_callback_t callback, void *callback_arg);
+extern LIBHDHOMERUN_API bool hdhomerun_control_set_async(struct hdhomerun_control_sock_t *cs, const char *name, const char *value, hdhomerun_control_callback_t callback, void *callback_arg);
+extern LIBHDHOMERUN_API bool hdhomerun_control_set_with_lockkey_async(struct hdhomerun_control_sock_t *cs, const char *name, const char *value, uint32_t lockkey, hdhomerun_control_callback_t callback, void *callback_arg);
+
+extern LIBHDHOMERUN_API hdhomerun_sock_fd_t hdhomerun_control_get_fd(struct hdhomerun_control_sock_t *cs);
+extern LIBHDHOMERUN_API int hdhomerun_control_get_poll_events(struct hdhomerun_control_sock_t *cs);
+extern LIBHDHOMERUN_API int64_t hdhomerun_control_get_timeout(struct hdhomerun_control_sock_t *cs);
+extern LIBHDHOMERUN_API void hdhomerun_control_process(struct hdhomerun_control_sock_t *cs, int revents);
+
 /*
  * Upload new firmware to the device.
  *
@@ -82,7 +82,11 @@ struct hdhomerun_debug_t *hdhomerun_debug_create(void)
 	thread_mutex_init(&dbg->send_lock);
 	thread_cond_init(&dbg->queue_cond);
 
-	if (!thread_task_create(&dbg->thread, &hdhomerun_debug_thread_execute, dbg)) {
+	struct thread_task_attr_t thread_attr;
+	memset(&thread_attr, 0, sizeof(thread_attr));
+	thread_attr.name = "hdhr-debug";
+
+	if (!thread_task_create_ex(&dbg->thread, &hdhomerun_debug_thread_execute, dbg, &thread_attr)) {
 		free(dbg);
 		return NULL;
 	}
@@ -55,16 +55,17 @@ int hdhomerun_device_set_device_ex(struct hdhomerun_device_t *hd, uint32_t devic
 		return -1;
 	}
 
+	/* Device objects for the tuners of one device share a single control connection. */
 	if (!hd->cs) {
-		hd->cs = hdhomerun_control_create(0, 0, hd->dbg);
+		hd->cs = hdhomerun_control_create_shared(device_id, device_addr, hd->dbg);
 		if (!hd->cs) {
 			hdhomerun_debug_printf(hd->dbg, "hdhomerun_device_set_device: failed to create control object\n");
 			return -1;
 		}
+	} else if (!hdhomerun_control_set_device_shared(hd->cs, device_id, device_addr)) {
+		hdhomerun_debug_printf(hd->dbg, "hdhomerun_device_set_device: failed to share control object\n");
 	}
 
-	hdhomerun_control_set_device_ex(hd->cs, device_id, device_addr);
-
 	if ((device_id == 0) || (device_id == HDHOMERUN_DEVICE_ID_WILDCARD)) {
 		device_id = hdhomerun_control_get_device_id(hd->cs);
 	}
@@ -1418,6 +1419,16 @@ uint8_t *hdhomerun_device_stream_recv(struct hdhomerun_device_t *hd, size_t max_
 	return hdhomerun_video_recv(hd->vs, max_size, pactual_size);
 }
 
+uint8_t *hdhomerun_device_stream_recv_wait(struct hdhomerun_device_t *hd, size_t max_size, size_t min_size, uint64_t timeout, size_t *pactual_size)
+{
+	if (!hd->vs) {
+		hdhomerun_debug_printf(hd->dbg, "hdhomerun_device_stream_recv_wait: video not initialized\n");
+		return NULL;
+	}
+
+	return hdhomerun_video_recv_wait(hd->vs, max_size, min_size, timeout, pactual_size);
+}
+
 void hdhomerun_device_stream_flush(struct hdhomerun_device_t *hd)
 {
 	if (!hd->vs) {
@@ -1589,12 +1600,17 @@ void hdhomerun_device_debug_print_video_stats(struct hdhomerun_device_t *hd)
 }
 
 void hdhomerun_device_get_video_stats(struct hdhomerun_device_t *hd, struct hdhomerun_video_stats_t *stats)
+{
+	hdhomerun_device_get_video_stats_ex(hd, stats, HDHOMERUN_VIDEO_STATS_SIZE_V1);
+}
+
+void hdhomerun_device_get_video_stats_ex(struct hdhomerun_device_t *hd, struct hdhomerun_video_stats_t *stats, size_t stats_size)
 {
 	if (!hd->vs) {
 		hdhomerun_debug_printf(hd->dbg, "hdhomerun_device_stream_flush: video not initialized\n");
-		memset(stats, 0, sizeof(struct hdhomerun_video_stats_t));
+		memset(stats, 0, stats_size);
 		return;
 	}
 
-	hdhomerun_video_get_stats(hd->vs, stats);
+	hdhomerun_video_get_stats_ex(hd->vs, stats, stats_size);
 }
@@ -221,11 +221,13 @@ extern LIBHDHOMERUN_API int hdhomerun_device_wait_for_lock(struct hdhomerun_devi
  *
  * The hdhomerun_device_stream_recv function should be called periodically to receive the stream data.
  * The buffer can losslessly store 1 second of data, however a more typical call rate would be every 15ms.
+ * Alternatively hdhomerun_device_stream_recv_wait sleeps until data is available (see hdhomerun_video_recv_wait).
  *
  * The hdhomerun_device_stream_stop function tells the device to stop streaming data.
  */
 extern LIBHDHOMERUN_API int hdhomerun_device_stream_start(struct hdhomerun_device_t *hd);
 extern LIBHDHOMERUN_API uint8_t *hdhomerun_device_stream_recv(struct hdhomerun_device_t *hd, size_t max_size, size_t *pactual_size);
+extern LIBHDHOMERUN_API uint8_t *hdhomerun_device_stream_recv_wait(struct hdhomerun_device_t *hd, size_t max_size, size_t min_size, uint64_t timeout, size_t *pactual_size);
 extern LIBHDHOMERUN_API void hdhomerun_device_stream_flush(struct hdhomerun_device_t *hd);
 extern LIBHDHOMERUN_API void hdhomerun_device_stream_stop(struct hdhomerun_device_t *hd);
 
@@ -250,6 +252,10 @@ extern LIBHDHOMERUN_API int hdhomerun_device_upgrade(struct hdhomerun_device_t *
 
 /*
  * Low level accessor functions. 
+ *
+ * The control socket is shared with other device objects for the same device (see hdhomerun_control_create_shared),
+ * so the asynchronous control API returns false on it; use hdhomerun_control_create_unshared to get one for that.
+ * The control socket stays the same object across hdhomerun_device_set_device.
  */
 extern LIBHDHOMERUN_API struct hdhomerun_control_sock_t *hdhomerun_device_get_control_sock(struct hdhomerun_device_t *hd);
 extern LIBHDHOMERUN_API struct hdhomerun_video_sock_t *hdhomerun_device_get_video_sock(struct hdhomerun_device_t *hd);
@@ -259,6 +265,7 @@ extern LIBHDHOMERUN_API struct hdhomerun_video_sock_t *hdhomerun_device_get_vide
  */
 extern LIBHDHOMERUN_API void hdhomerun_device_debug_print_video_stats(struct hdhomerun_device_t *hd);
 extern LIBHDHOMERUN_API void hdhomerun_device_get_video_stats(struct hdhomerun_device_t *hd, struct hdhomerun_video_stats_t *stats);
+extern LIBHDHOMERUN_API void hdhomerun_device_get_video_stats_ex(struct hdhomerun_device_t *hd, struct hdhomerun_video_stats_t *stats, size_t stats_size);
 
 #ifdef __cplusplus
 }
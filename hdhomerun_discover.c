@@ -65,6 +65,18 @@ struct hdhomerun_discover_t {
 	struct hdhomerun_debug_t *dbg;
 };
 
+#define HDHOMERUN_DISCOVER_CACHE_MAX 32
+
+struct hdhomerun_discover_cache_entry_t {
+	uint32_t device_id;
+	struct sockaddr_storage ip_addr;
+	uint64_t expire_time;
+};
+
+static thread_once_t hdhomerun_discover_cache_once = THREAD_ONCE_INIT;
+static thread_mutex_t hdhomerun_discover_cache_lock;
+static struct hdhomerun_discover_cache_entry_t hdhomerun_discover_cache[HDHOMERUN_DISCOVER_CACHE_MAX];
+
 static uint8_t hdhomerun_discover_ipv6_linklocal_multicast_ip[16] = { 0xFF, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x76 };
 static uint8_t hdhomerun_discover_ipv6_sitelocal_multicast_ip[16] = { 0xFF, 0x05, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x76 };
 
@@ -1153,6 +1165,119 @@ static void hdhomerun_discover_recv_merge_device(struct hdhomerun_discover_t *ds
 	*pprev = device;
 }
 
+static void hdhomerun_discover_cache_init(void)
+{
+	thread_mutex_init(&hdhomerun_discover_cache_lock);
+}
+
+void hdhomerun_discover_cache_add(uint32_t device_id, const struct sockaddr *ip_addr)
+{
+	if ((device_id == 0) || (device_id == HDHOMERUN_DEVICE_ID_WILDCARD)) {
+		return;
+	}
+	if (!hdhomerun_sock_sockaddr_is_addr(ip_addr)) {
+		return;
+	}
+
+	thread_once(&hdhomerun_discover_cache_once, hdhomerun_discover_cache_init);
+	thread_mutex_lock(&hdhomerun_discover_cache_lock);
+
+	/* Refresh the existing entry, otherwise replace the entry closest to expiring. */
+	struct hdhomerun_discover_cache_entry_t *entry = &hdhomerun_discover_cache[0];
+	int i;
+	for (i = 0; i < HDHOMERUN_DISCOVER_CACHE_MAX; i++) {
+		struct hdhomerun_discover_cache_entry_t *p = &hdhomerun_discover_cache[i];
+		if ((p->device_id == device_id) && hdhomerun_sock_sockaddr_ip_equal((const struct sockaddr *)&p->ip_addr, ip_addr)) {
+			entry = p;
+			break;
+		}
+		if (p->expire_time < entry->expire_time) {
+			entry = p;
+		}
+	}
+
+	entry->device_id = device_id;
+	hdhomerun_sock_sockaddr_copy(&entry->ip_addr, ip_addr);
+	entry->expire_time = getcurrenttime() + HDHOMERUN_DISCOVER_CACHE_TTL;
+
+	thread_mutex_unlock(&hdhomerun_discover_cache_lock);
+}
+
+int hdhomerun_discover_cache_lookup_all(uint32_t device_id, const struct sockaddr *target_addr, uint32_t *pdevice_id, struct sockaddr_storage result[], int max_count)
+{
+	bool match_device_id = (device_id != 0) && (device_id != HDHOMERUN_DEVICE_ID_WILDCARD);
+	bool match_addr = target_addr && hdhomerun_sock_sockaddr_is_addr(target_addr);
+	if (!match_device_id && !match_addr) {
+		return 0;
+	}
+
+	thread_once(&hdhomerun_discover_cache_once, hdhomerun_discover_cache_init);
+	thread_mutex_lock(&hdhomerun_discover_cache_lock);
+
+	uint64_t current_time = getcurrenttime();
+	struct hdhomerun_discover_cache_entry_t *entries[HDHOMERUN_DISCOVER_CACHE_MAX];
+	int count = 0;
+
+	/* Collect the live matches, most recently seen first. */
+	int i;
+	for (i = 0; i < HDHOMERUN_DISCOVER_CACHE_MAX; i++) {
+		struct hdhomerun_discover_cache_entry_t *p = &hdhomerun_discover_cache[i];
+		if (p->expire_time <= current_time) {
+			continue;
+		}
+		if (match_device_id && (p->device_id != device_id)) {
+			continue;
+		}
+		if (match_addr && !hdhomerun_sock_sockaddr_ip_equal((const struct sockaddr *)&p->ip_addr, target_addr)) {
+			continue;
+		}
+
+		int j = count++;
+		while ((j > 0) && (entries[j - 1]->expire_time < p->expire_time)) {
+			entries[j] = entries[j - 1];
+			j--;
+		}
+		entries[j] = p;
+	}
+
+	/* Only return addresses of the device that was seen most recently. */
+	int result_count = 0;
+	for (i = 0; (i < count) && (result_count < max_count); i++) {
+		if (entries[i]->device_id != entries[0]->device_id) {
+			continue;
+		}
+		result[result_count++] = entries[i]->ip_addr;
+	}
+
+	if (result_count > 0) {
+		*pdevice_id = entries[0]->device_id;
+	}
+
+	thread_mutex_unlock(&hdhomerun_discover_cache_lock);
+	return result_count;
+}
+
+bool hdhomerun_discover_cache_lookup(uint32_t device_id, const struct sockaddr *target_addr, uint32_t *pdevice_id, struct sockaddr_storage *result)
+{
+	return hdhomerun_discover_cache_lookup_all(device_id, target_addr, pdevice_id, result, 1) > 0;
+}
+
+void hdhomerun_discover_cache_invalidate(uint32_t device_id, const struct sockaddr *ip_addr)
+{
+	thread_once(&hdhomerun_discover_cache_once, hdhomerun_discover_cache_init);
+	thread_mutex_lock(&hdhomerun_discover_cache_lock);
+
+	int i;
+	for (i = 0; i < HDHOMERUN_DISCOVER_CACHE_MAX; i++) {
+		struct hdhomerun_discover_cache_entry_t *p = &hdhomerun_discover_cache[i];
+		if ((p->device_id == device_id) && hdhomerun_sock_sockaddr_ip_equal((const struct sockaddr *)&p->ip_addr, ip_addr)) {
+			memset(p, 0, sizeof(struct hdhomerun_discover_cache_entry_t));
+		}
+	}
+
+	thread_mutex_unlock(&hdhomerun_discover_cache_lock);
+}
+
 static bool hdhomerun_discover_recvfrom_match_flags(const struct sockaddr *remote_addr, uint32_t flags)
 {
 	if (remote_addr->sa_family == AF_INET6) {
@@ -1251,6 +1376,8 @@ static bool hdhomerun_discover_recvfrom(struct hdhomerun_discover_t *ds, struct
 		return activity;
 	}
 
+	hdhomerun_discover_cache_add(device->device_id, (const struct sockaddr *)&remote_addr);
+
 	if (!hdhomerun_discover_recvfrom_match_device_type(device, device_types_match, device_types_count)) {
 		hdhomerun_discover_device_free(device);
 		return activity;
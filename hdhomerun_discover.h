@@ -112,6 +112,28 @@ extern LIBHDHOMERUN_API bool hdhomerun_discover_validate_device_id(uint32_t devi
 extern LIBHDHOMERUN_API bool hdhomerun_discover_is_ip_multicast(uint32_t ip_addr);
 extern LIBHDHOMERUN_API bool hdhomerun_discover_is_ip_multicast_ex(const struct sockaddr *ip_addr);
 
+/*
+ * Discover cache.
+ *
+ * Every discover reply (any discover object, and control socket discovery) records device id -> ip address in a
+ * process-wide cache for HDHOMERUN_DISCOVER_CACHE_TTL ms.
+ *
+ * hdhomerun_discover_cache_lookup: device_id may be HDHOMERUN_DEVICE_ID_WILDCARD (or 0) to look up by address;
+ * target_addr may be unspecified (or NULL) to look up by device id. If both are given both must match. The most
+ * recently seen match is returned.
+ *
+ * hdhomerun_discover_cache_lookup_all: as hdhomerun_discover_cache_lookup, but returns up to max_count live addresses
+ * of the matching device, most recently seen first. Returns the number of addresses.
+ *
+ * hdhomerun_discover_cache_invalidate: remove the entry once it is known to be stale.
+ */
+#define HDHOMERUN_DISCOVER_CACHE_TTL 60000
+
+extern LIBHDHOMERUN_API void hdhomerun_discover_cache_add(uint32_t device_id, const struct sockaddr *ip_addr);
+extern LIBHDHOMERUN_API bool hdhomerun_discover_cache_lookup(uint32_t device_id, const struct sockaddr *target_addr, uint32_t *pdevice_id, struct sockaddr_storage *result);
+extern LIBHDHOMERUN_API int hdhomerun_discover_cache_lookup_all(uint32_t device_id, const struct sockaddr *target_addr, uint32_t *pdevice_id, struct sockaddr_storage result[], int max_count);
+extern LIBHDHOMERUN_API void hdhomerun_discover_cache_invalidate(uint32_t device_id, const struct sockaddr *ip_addr);
+
 /*
  * Legacy API - not for new applications.
  *
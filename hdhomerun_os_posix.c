@@ -18,7 +18,24 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include "hdhomerun_os.h"
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+#endif
 
 #if defined(__APPLE__)
 
@@ -100,6 +117,13 @@ uint64_t getcurrenttime(void)
 	return ((uint64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
 }
 
+uint64_t getcurrenttime_realtime_ns(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return ((uint64_t)tv.tv_sec * 1000000000) + ((uint64_t)tv.tv_usec * 1000);
+}
+
 uint64_t timer_get_hires_ticks(void)
 {
 	struct timespec ts;
@@ -143,19 +167,80 @@ void msleep_minimum(uint64_t ms)
 struct thread_task_execute_args_t {
 	thread_task_func_t func;
 	void *arg;
+	int nice;
+	char name[16];
 };
 
+static void thread_task_apply_self(struct thread_task_execute_args_t *execute_args)
+{
+	if (execute_args->name[0]) {
+#if defined(__linux__)
+		prctl(PR_SET_NAME, execute_args->name, 0, 0, 0);
+#elif defined(__APPLE__)
+		pthread_setname_np(execute_args->name);
+#endif
+	}
+
+#if defined(__linux__)
+	/* Linux applies nice per thread. */
+	if (execute_args->nice) {
+		setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), execute_args->nice);
+	}
+#endif
+}
+
 static void *thread_task_execute(void *arg)
 {
 	struct thread_task_execute_args_t *execute_args = (struct thread_task_execute_args_t *)arg;
+	thread_task_apply_self(execute_args);
 	execute_args->func(execute_args->arg);
 	free(execute_args);
 	return NULL;
 }
 
-bool thread_task_create(thread_task_t *tid, thread_task_func_t func, void *arg)
+static bool thread_task_attr_init(pthread_attr_t *pattr, const struct thread_task_attr_t *attr)
 {
-	struct thread_task_execute_args_t *execute_args = (struct thread_task_execute_args_t *)malloc(sizeof(struct thread_task_execute_args_t));
+	if (pthread_attr_init(pattr) != 0) {
+		return false;
+	}
+
+#if defined(__linux__) && !defined(__ANDROID__)
+	if (attr->cpu_affinity_mask) {
+		cpu_set_t cpu_set;
+		CPU_ZERO(&cpu_set);
+
+		int cpu;
+		for (cpu = 0; cpu < 64; cpu++) {
+			if (attr->cpu_affinity_mask & ((uint64_t)1 << cpu)) {
+				CPU_SET(cpu, &cpu_set);
+			}
+		}
+
+		if (pthread_attr_setaffinity_np(pattr, sizeof(cpu_set), &cpu_set) != 0) {
+			pthread_attr_destroy(pattr);
+			return false;
+		}
+	}
+#endif
+
+	if (attr->sched_policy != THREAD_TASK_SCHED_DEFAULT) {
+		struct sched_param param;
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = attr->sched_priority;
+
+		int policy = (attr->sched_policy == THREAD_TASK_SCHED_RR) ? SCHED_RR : SCHED_FIFO;
+		if ((pthread_attr_setinheritsched(pattr, PTHREAD_EXPLICIT_SCHED) != 0) || (pthread_attr_setschedpolicy(pattr, policy) != 0) || (pthread_attr_setschedparam(pattr, &param) != 0)) {
+			pthread_attr_destroy(pattr);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool thread_task_create_ex(thread_task_t *tid, thread_task_func_t func, void *arg, const struct thread_task_attr_t *attr)
+{
+	struct thread_task_execute_args_t *execute_args = (struct thread_task_execute_args_t *)calloc(1, sizeof(struct thread_task_execute_args_t));
 	if (!execute_args) {
 		return false;
 	}
@@ -163,7 +248,31 @@ bool thread_task_create(thread_task_t *tid, thread_task_func_t func, void *arg)
 	execute_args->func = func;
 	execute_args->arg = arg;
 
-	if (pthread_create(tid, NULL, thread_task_execute, execute_args) != 0) {
+	if (!attr) {
+		if (pthread_create(tid, NULL, thread_task_execute, execute_args) != 0) {
+			free(execute_args);
+			return false;
+		}
+
+		return true;
+	}
+
+	execute_args->nice = attr->nice;
+	if (attr->name) {
+		strncpy(execute_args->name, attr->name, sizeof(execute_args->name) - 1);
+	}
+
+	pthread_attr_t pattr;
+	if (!thread_task_attr_init(&pattr, attr)) {
+		free(execute_args);
+		return false;
+	}
+
+	/* Fails with EPERM if the scheduling policy is not permitted. */
+	int ret = pthread_create(tid, &pattr, thread_task_execute, execute_args);
+	pthread_attr_destroy(&pattr);
+
+	if (ret != 0) {
 		free(execute_args);
 		return false;
 	}
@@ -171,11 +280,21 @@ bool thread_task_create(thread_task_t *tid, thread_task_func_t func, void *arg)
 	return true;
 }
 
+bool thread_task_create(thread_task_t *tid, thread_task_func_t func, void *arg)
+{
+	return thread_task_create_ex(tid, func, arg, NULL);
+}
+
 void thread_task_join(thread_task_t tid)
 {
 	pthread_join(tid, NULL);
 }
 
+void thread_yield(void)
+{
+	sched_yield();
+}
+
 void thread_mutex_init(thread_mutex_t *mutex)
 {
 	pthread_mutex_init(mutex, NULL);
@@ -195,6 +314,11 @@ void thread_mutex_unlock(thread_mutex_t *mutex)
 	pthread_mutex_unlock(mutex);
 }
 
+void thread_once(thread_once_t *once, void (*func)(void))
+{
+	pthread_once(once, func);
+}
+
 void thread_cond_init(thread_cond_t *cond)
 {
 	cond->signaled = false;
@@ -251,6 +375,877 @@ bool thread_cond_wait_with_timeout(thread_cond_t *cond, uint64_t max_wait_time)
 	return true;
 }
 
+#if defined(__linux__)
+
+bool thread_notify_init(thread_notify_t *notify)
+{
+	int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+
+	notify->read_fd = fd;
+	notify->write_fd = fd;
+	return true;
+}
+
+void thread_notify_dispose(thread_notify_t *notify)
+{
+	close(notify->read_fd);
+}
+
+void thread_notify_signal(thread_notify_t *notify)
+{
+	uint64_t v = 1;
+	if (write(notify->write_fd, &v, sizeof(v)) != sizeof(v)) {
+		return;
+	}
+}
+
+#else
+
+bool thread_notify_init(thread_notify_t *notify)
+{
+	int fds[2];
+	if (pipe(fds) != 0) {
+		return false;
+	}
+
+	int i;
+	for (i = 0; i < 2; i++) {
+		fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+		fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+	}
+
+	notify->read_fd = fds[0];
+	notify->write_fd = fds[1];
+	return true;
+}
+
+void thread_notify_dispose(thread_notify_t *notify)
+{
+	close(notify->read_fd);
+	close(notify->write_fd);
+}
+
+void thread_notify_signal(thread_notify_t *notify)
+{
+	uint8_t v = 1;
+	if (write(notify->write_fd, &v, sizeof(v)) != sizeof(v)) {
+		return; /* pipe full - already signaled */
+	}
+}
+
+#endif
+
+void thread_notify_clear(thread_notify_t *notify)
+{
+	uint64_t v[8];
+	while (read(notify->read_fd, v, sizeof(v)) > 0) {
+	}
+}
+
+thread_notify_handle_t thread_notify_get_handle(thread_notify_t *notify)
+{
+	return notify->read_fd;
+}
+
+size_t memory_get_page_size(void)
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+	if (page_size <= 0) {
+		return 4096;
+	}
+
+	return (size_t)page_size;
+}
+
+#if defined(__linux__)
+
+size_t memory_get_huge_page_size(void)
+{
+	FILE *fp = fopen("/proc/meminfo", "r");
+	if (!fp) {
+		return 0;
+	}
+
+	size_t huge_page_size = 0;
+	char line[128];
+	while (fgets(line, sizeof(line), fp)) {
+		unsigned long size_kb;
+		if (sscanf(line, "Hugepagesize: %lu kB", &size_kb) == 1) {
+			huge_page_size = (size_t)size_kb * 1024;
+			break;
+		}
+	}
+
+	fclose(fp);
+	return huge_page_size;
+}
+
+#else
+
+size_t memory_get_huge_page_size(void)
+{
+	return 0;
+}
+
+#endif
+
+static void memory_map_advise_huge_pages(void *ptr, size_t size)
+{
+#if defined(MADV_HUGEPAGE)
+	madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+}
+
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+
+static void *memory_map_alloc_mirrored(size_t size)
+{
+	int fd = memfd_create("hdhomerun", MFD_CLOEXEC);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	if (ftruncate(fd, (off_t)size) != 0) {
+		close(fd);
+		return NULL;
+	}
+
+	/* Reserve address space for both views then map the same pages into each half. */
+	uint8_t *ptr = (uint8_t *)mmap(NULL, size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ptr == MAP_FAILED) {
+		close(fd);
+		return NULL;
+	}
+
+	if (mmap(ptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+		munmap(ptr, size * 2);
+		close(fd);
+		return NULL;
+	}
+
+	if (mmap(ptr + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+		munmap(ptr, size * 2);
+		close(fd);
+		return NULL;
+	}
+
+	close(fd);
+	return ptr;
+}
+
+#else
+
+static void *memory_map_alloc_mirrored(size_t size)
+{
+	return NULL;
+}
+
+#endif
+
+void *memory_map_alloc(size_t size, uint32_t flags)
+{
+	if ((size == 0) || (size % memory_get_page_size())) {
+		return NULL;
+	}
+
+	if (flags & MEMORY_MAP_MIRRORED) {
+		void *ptr = memory_map_alloc_mirrored(size);
+		if (ptr && (flags & MEMORY_MAP_HUGE_PAGES)) {
+			memory_map_advise_huge_pages(ptr, size * 2);
+		}
+		return ptr;
+	}
+
+#if defined(MAP_HUGETLB)
+	/* Explicit huge pages if the pool has them, otherwise fall back to transparent huge pages. */
+	if (flags & MEMORY_MAP_HUGE_PAGES) {
+		size_t huge_page_size = memory_get_huge_page_size();
+		if ((huge_page_size > 0) && (size % huge_page_size == 0)) {
+			void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			if (ptr != MAP_FAILED) {
+				return ptr;
+			}
+		}
+	}
+#endif
+
+	void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ptr == MAP_FAILED) {
+		return NULL;
+	}
+
+	if (flags & MEMORY_MAP_HUGE_PAGES) {
+		memory_map_advise_huge_pages(ptr, size);
+	}
+
+	return ptr;
+}
+
+void memory_map_free(void *ptr, size_t size, uint32_t flags)
+{
+	if (flags & MEMORY_MAP_MIRRORED) {
+		size *= 2;
+	}
+
+	munmap(ptr, size);
+}
+
+void memory_map_prefault(void *ptr, size_t size)
+{
+	/* Write to every page so the receive thread does not take the faults. */
+	volatile uint8_t *p = (volatile uint8_t *)ptr;
+	volatile uint8_t *end = p + size;
+	size_t page_size = memory_get_page_size();
+
+	while (p < end) {
+		*p = 0;
+		p += page_size;
+	}
+}
+
+bool memory_map_lock(void *ptr, size_t size)
+{
+	return (mlock(ptr, size) == 0);
+}
+
+#if defined(__linux__) && defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(__NR_io_uring_register) && defined(IORING_OFF_SQES)
+void uring_dispose(struct uring_t *uring)
+{
+	if (uring->sqes) {
+		munmap(uring->sqes, uring->sqes_size);
+	}
+	if (uring->cq_ring && (uring->cq_ring != uring->sq_ring)) {
+		munmap(uring->cq_ring, uring->cq_ring_size);
+	}
+	if (uring->sq_ring) {
+		munmap(uring->sq_ring, uring->sq_ring_size);
+	}
+	if (uring->fd >= 0) {
+		close(uring->fd);
+	}
+
+	memset(uring, 0, sizeof(struct uring_t));
+	uring->fd = -1;
+}
+
+bool uring_init(struct uring_t *uring, uint32_t entries, struct io_uring_params *params)
+{
+	memset(uring, 0, sizeof(struct uring_t));
+
+	uring->fd = (int)syscall(__NR_io_uring_setup, entries, params);
+	if (uring->fd < 0) {
+		uring->fd = -1;
+		return false;
+	}
+
+	uring->sq_ring_size = params->sq_off.array + params->sq_entries * sizeof(uint32_t);
+	uring->cq_ring_size = params->cq_off.cqes + params->cq_entries * sizeof(struct io_uring_cqe);
+	if (params->features & IORING_FEAT_SINGLE_MMAP) {
+		if (uring->cq_ring_size > uring->sq_ring_size) {
+			uring->sq_ring_size = uring->cq_ring_size;
+		}
+		uring->cq_ring_size = uring->sq_ring_size;
+	}
+
+	uring->sq_ring = mmap(NULL, uring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQ_RING);
+	if (uring->sq_ring == MAP_FAILED) {
+		uring->sq_ring = NULL;
+		uring_dispose(uring);
+		return false;
+	}
+
+	if (params->features & IORING_FEAT_SINGLE_MMAP) {
+		uring->cq_ring = uring->sq_ring;
+	} else {
+		uring->cq_ring = mmap(NULL, uring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_CQ_RING);
+		if (uring->cq_ring == MAP_FAILED) {
+			uring->cq_ring = NULL;
+			uring_dispose(uring);
+			return false;
+		}
+	}
+
+	uring->sqes_size = params->sq_entries * sizeof(struct io_uring_sqe);
+	uring->sqes = (struct io_uring_sqe *)mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQES);
+	if (uring->sqes == MAP_FAILED) {
+		uring->sqes = NULL;
+		uring_dispose(uring);
+		return false;
+	}
+
+	uint8_t *sq_ring = (uint8_t *)uring->sq_ring;
+	uint8_t *cq_ring = (uint8_t *)uring->cq_ring;
+	uring->sq_head = (volatile uint32_t *)(sq_ring + params->sq_off.head);
+	uring->sq_tail = (volatile uint32_t *)(sq_ring + params->sq_off.tail);
+	uring->sq_mask = *(uint32_t *)(sq_ring + params->sq_off.ring_mask);
+	uring->sq_entries = params->sq_entries;
+	uring->sq_array = (uint32_t *)(sq_ring + params->sq_off.array);
+	uring->cq_head = (volatile uint32_t *)(cq_ring + params->cq_off.head);
+	uring->cq_tail = (volatile uint32_t *)(cq_ring + params->cq_off.tail);
+	uring->cq_mask = *(uint32_t *)(cq_ring + params->cq_off.ring_mask);
+	uring->cqes = (struct io_uring_cqe *)(cq_ring + params->cq_off.cqes);
+	return true;
+}
+
+int uring_enter(struct uring_t *uring, uint32_t to_submit, uint32_t min_complete, uint32_t flags, void *arg, size_t arg_size)
+{
+	return (int)syscall(__NR_io_uring_enter, uring->fd, to_submit, min_complete, flags, arg, arg_size);
+}
+
+int uring_register(struct uring_t *uring, uint32_t opcode, void *arg, uint32_t nr_args)
+{
+	return (int)syscall(__NR_io_uring_register, uring->fd, opcode, arg, nr_args);
+}
+
+struct io_uring_sqe *uring_get_sqe(struct uring_t *uring)
+{
+	uint32_t tail = *uring->sq_tail;
+	if (tail - __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE) >= uring->sq_entries) {
+		return NULL;
+	}
+
+	uint32_t index = tail & uring->sq_mask;
+	struct io_uring_sqe *sqe = &uring->sqes[index];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+
+	/* The kernel only reads the entry during uring_submit, so it may be filled in after being queued. */
+	uring->sq_array[index] = index;
+	__atomic_store_n(uring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	return sqe;
+}
+
+bool uring_submit(struct uring_t *uring)
+{
+	while (1) {
+		uint32_t pending = *uring->sq_tail - __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE);
+		if (pending == 0) {
+			return true;
+		}
+
+		if (uring_enter(uring, pending, 0, 0, NULL, 0) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+	}
+}
+
+void uring_withdraw(struct uring_t *uring)
+{
+	__atomic_store_n(uring->sq_tail, __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+}
+
+struct io_uring_cqe *uring_peek_cqe(struct uring_t *uring)
+{
+	uint32_t head = *uring->cq_head;
+	if (head == __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE)) {
+		return NULL;
+	}
+
+	return &uring->cqes[head & uring->cq_mask];
+}
+
+void uring_cqe_seen(struct uring_t *uring)
+{
+	__atomic_store_n(uring->cq_head, *uring->cq_head + 1, __ATOMIC_RELEASE);
+}
+#else
+bool uring_init(struct uring_t *uring, uint32_t entries, struct io_uring_params *params)
+{
+	memset(uring, 0, sizeof(struct uring_t));
+	uring->fd = -1;
+	return false;
+}
+
+void uring_dispose(struct uring_t *uring)
+{
+}
+
+int uring_enter(struct uring_t *uring, uint32_t to_submit, uint32_t min_complete, uint32_t flags, void *arg, size_t arg_size)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+int uring_register(struct uring_t *uring, uint32_t opcode, void *arg, uint32_t nr_args)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+struct io_uring_sqe *uring_get_sqe(struct uring_t *uring)
+{
+	return NULL;
+}
+
+bool uring_submit(struct uring_t *uring)
+{
+	return false;
+}
+
+void uring_withdraw(struct uring_t *uring)
+{
+}
+
+struct io_uring_cqe *uring_peek_cqe(struct uring_t *uring)
+{
+	return NULL;
+}
+
+void uring_cqe_seen(struct uring_t *uring)
+{
+}
+#endif
+
+#if defined(__linux__) && defined(__NR_io_uring_setup) && defined(__NR_io_uring_register) && defined(IORING_FEAT_RW_CUR_POS) && defined(IO_URING_OP_SUPPORTED)
+#define FILE_WRITER_IO_URING 1
+#define FILE_WRITER_URING_TIMEOUT_TAG UINT64_MAX
+#endif
+
+#define FILE_WRITER_DIRECT_IO_ALIGNMENT 4096
+
+struct file_writer_op_t {
+	const void *data;
+	size_t length;
+	uint64_t offset;
+	void *tag;
+	bool success;
+	bool active;
+};
+
+#if defined(FILE_WRITER_IO_URING)
+struct file_writer_uring_t {
+	struct uring_t ring;
+	struct __kernel_timespec timeout_ts;
+	bool timeout_pending;
+};
+#endif
+
+struct file_writer_t {
+	int fd;
+	uint32_t flags;
+	uint32_t queue_depth;
+	struct file_writer_op_t *ops;
+	size_t complete_head;
+	size_t complete_tail;
+	size_t *complete_queue;
+#if defined(FILE_WRITER_IO_URING)
+	struct file_writer_uring_t uring;
+#endif
+};
+
+static bool file_writer_pwrite(struct file_writer_t *fw, const void *data, size_t length, uint64_t offset)
+{
+	const uint8_t *ptr = (const uint8_t *)data;
+
+	while (length > 0) {
+		ssize_t ret = pwrite(fw->fd, ptr, length, (off_t)offset);
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		if (ret == 0) {
+			return false;
+		}
+
+		ptr += ret;
+		length -= (size_t)ret;
+		offset += (uint64_t)ret;
+	}
+
+	return true;
+}
+
+#if defined(FILE_WRITER_IO_URING)
+/*
+ * Kernels from before IORING_OP_WRITE accept the ring but fail every write, so check the opcodes once up front.
+ */
+static bool file_writer_uring_probe(struct file_writer_uring_t *uring)
+{
+	size_t probe_size = sizeof(struct io_uring_probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+	struct io_uring_probe *probe = (struct io_uring_probe *)calloc(1, probe_size);
+	if (!probe) {
+		return false;
+	}
+
+	bool success = false;
+	if (uring_register(&uring->ring, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) == 0) {
+		success = (probe->last_op >= IORING_OP_WRITE) && (probe->last_op >= IORING_OP_TIMEOUT);
+		success = success && (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED);
+		success = success && (probe->ops[IORING_OP_TIMEOUT].flags & IO_URING_OP_SUPPORTED);
+	}
+
+	free(probe);
+	return success;
+}
+
+static bool file_writer_uring_init(struct file_writer_uring_t *uring, uint32_t entries)
+{
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+
+	if (!uring_init(&uring->ring, entries, &params)) {
+		return false;
+	}
+
+	if (!file_writer_uring_probe(uring)) {
+		uring_dispose(&uring->ring);
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Passes the queued entry to the kernel, withdrawing it if the kernel did not take it.
+ */
+static bool file_writer_uring_push_sqe(struct file_writer_uring_t *uring)
+{
+	if (uring_submit(&uring->ring)) {
+		return true;
+	}
+
+	uring_withdraw(&uring->ring);
+	return false;
+}
+
+static bool file_writer_uring_submit(struct file_writer_t *fw, size_t index)
+{
+	struct file_writer_uring_t *uring = &fw->uring;
+	struct file_writer_op_t *op = &fw->ops[index];
+
+	struct io_uring_sqe *sqe = uring_get_sqe(&uring->ring);
+	if (!sqe) {
+		return false;
+	}
+
+	sqe->opcode = IORING_OP_WRITE;
+	sqe->fd = fw->fd;
+	sqe->addr = (uint64_t)(uintptr_t)op->data;
+	sqe->len = (uint32_t)op->length;
+	sqe->off = op->offset;
+	sqe->user_data = (uint64_t)index;
+
+	return file_writer_uring_push_sqe(uring);
+}
+
+static bool file_writer_uring_submit_timeout(struct file_writer_uring_t *uring, uint64_t timeout)
+{
+	uring->timeout_ts.tv_sec = (int64_t)(timeout / 1000);
+	uring->timeout_ts.tv_nsec = (long long)(timeout % 1000) * 1000000;
+
+	struct io_uring_sqe *sqe = uring_get_sqe(&uring->ring);
+	if (!sqe) {
+		return false;
+	}
+
+	sqe->opcode = IORING_OP_TIMEOUT;
+	sqe->fd = -1;
+	sqe->addr = (uint64_t)(uintptr_t)&uring->timeout_ts;
+	sqe->len = 1;
+	sqe->user_data = FILE_WRITER_URING_TIMEOUT_TAG;
+
+	if (!file_writer_uring_push_sqe(uring)) {
+		return false;
+	}
+
+	uring->timeout_pending = true;
+	return true;
+}
+
+/*
+ * Moves one write completion from the CQ to the complete queue, discarding timer completions.
+ */
+static bool file_writer_uring_reap(struct file_writer_t *fw)
+{
+	struct file_writer_uring_t *uring = &fw->uring;
+
+	while (1) {
+		struct io_uring_cqe *cqe = uring_peek_cqe(&uring->ring);
+		if (!cqe) {
+			return false;
+		}
+
+		uint64_t user_data = cqe->user_data;
+		int res = cqe->res;
+		uring_cqe_seen(&uring->ring);
+
+		if (user_data == FILE_WRITER_URING_TIMEOUT_TAG) {
+			uring->timeout_pending = false;
+			continue;
+		}
+
+		size_t index = (size_t)user_data;
+		struct file_writer_op_t *op = &fw->ops[index];
+		if (res < 0) {
+			op->success = false;
+		} else {
+			/* Complete a short write synchronously. */
+			op->success = file_writer_pwrite(fw, (const uint8_t *)op->data + res, op->length - (size_t)res, op->offset + (uint64_t)res);
+		}
+
+		fw->complete_queue[fw->complete_tail] = index;
+		fw->complete_tail = (fw->complete_tail + 1) % (fw->queue_depth + 1);
+		return true;
+	}
+}
+
+static bool file_writer_uring_complete(struct file_writer_t *fw, bool wait)
+{
+	while (1) {
+		if (file_writer_uring_reap(fw)) {
+			return true;
+		}
+		if (!wait) {
+			return false;
+		}
+
+		if ((uring_enter(&fw->uring.ring, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0) && (errno != EINTR)) {
+			return false;
+		}
+	}
+}
+#endif
+
+struct file_writer_t *file_writer_open(const char *filename, uint32_t flags, uint32_t queue_depth)
+{
+	struct file_writer_t *fw = (struct file_writer_t *)calloc(1, sizeof(struct file_writer_t));
+	if (!fw) {
+		return NULL;
+	}
+
+	fw->fd = -1;
+#if defined(FILE_WRITER_IO_URING)
+	fw->uring.ring.fd = -1;
+#endif
+
+	if (queue_depth == 0) {
+		queue_depth = 1;
+	}
+	fw->queue_depth = queue_depth;
+
+	fw->ops = (struct file_writer_op_t *)calloc(queue_depth, sizeof(struct file_writer_op_t));
+	fw->complete_queue = (size_t *)calloc(queue_depth + 1, sizeof(size_t));
+	if (!fw->ops || !fw->complete_queue) {
+		goto error;
+	}
+
+	int open_flags = O_WRONLY | O_CREAT | O_TRUNC;
+#if defined(O_CLOEXEC)
+	open_flags |= O_CLOEXEC;
+#endif
+
+#if defined(O_DIRECT)
+	if (flags & FILE_WRITER_DIRECT_IO) {
+		fw->fd = open(filename, open_flags | O_DIRECT, 0644);
+		if (fw->fd >= 0) {
+			fw->flags |= FILE_WRITER_DIRECT_IO;
+		}
+	}
+#endif
+
+	if (fw->fd < 0) {
+		/* Filesystems such as tmpfs reject O_DIRECT. */
+		fw->fd = open(filename, open_flags, 0644);
+		if (fw->fd < 0) {
+			goto error;
+		}
+
+#if defined(__APPLE__)
+		if (flags & FILE_WRITER_DIRECT_IO) {
+			fcntl(fw->fd, F_NOCACHE, 1);
+		}
+#endif
+	}
+
+#if defined(FILE_WRITER_IO_URING)
+	if (flags & FILE_WRITER_ASYNC) {
+		/* One extra entry for the timer used by file_writer_wait. */
+		if (file_writer_uring_init(&fw->uring, queue_depth + 1)) {
+			fw->flags |= FILE_WRITER_ASYNC;
+		}
+	}
+#endif
+
+	return fw;
+
+error:
+	if (fw->fd >= 0) {
+		close(fw->fd);
+	}
+	if (fw->complete_queue) {
+		free(fw->complete_queue);
+	}
+	if (fw->ops) {
+		free(fw->ops);
+	}
+	free(fw);
+	return NULL;
+}
+
+uint32_t file_writer_get_flags(struct file_writer_t *fw)
+{
+	return fw->flags;
+}
+
+size_t file_writer_get_alignment(struct file_writer_t *fw)
+{
+	if (fw->flags & FILE_WRITER_DIRECT_IO) {
+		return FILE_WRITER_DIRECT_IO_ALIGNMENT;
+	}
+
+	return 1;
+}
+
+bool file_writer_preallocate(struct file_writer_t *fw, uint64_t offset, uint64_t length)
+{
+#if defined(__linux__)
+	/* Allocate without changing the file size so readers only see data that has been written. */
+	return (fallocate(fw->fd, FALLOC_FL_KEEP_SIZE, (off_t)offset, (off_t)length) == 0);
+#else
+	return false;
+#endif
+}
+
+bool file_writer_submit(struct file_writer_t *fw, const void *data, size_t length, uint64_t offset, void *tag)
+{
+	size_t index;
+	for (index = 0; index < fw->queue_depth; index++) {
+		if (!fw->ops[index].active) {
+			break;
+		}
+	}
+	if (index >= fw->queue_depth) {
+		return false;
+	}
+
+	struct file_writer_op_t *op = &fw->ops[index];
+	op->data = data;
+	op->length = length;
+	op->offset = offset;
+	op->tag = tag;
+	op->active = true;
+
+#if defined(FILE_WRITER_IO_URING)
+	if (fw->flags & FILE_WRITER_ASYNC) {
+		if (file_writer_uring_submit(fw, index)) {
+			return true;
+		}
+	}
+#endif
+
+	op->success = file_writer_pwrite(fw, data, length, offset);
+
+	fw->complete_queue[fw->complete_tail] = index;
+	fw->complete_tail = (fw->complete_tail + 1) % (fw->queue_depth + 1);
+	return true;
+}
+
+void *file_writer_complete(struct file_writer_t *fw, bool wait, bool *psuccess)
+{
+#if defined(FILE_WRITER_IO_URING)
+	if ((fw->complete_head == fw->complete_tail) && (fw->uring.ring.fd >= 0)) {
+		file_writer_uring_complete(fw, wait);
+	}
+#endif
+
+	if (fw->complete_head == fw->complete_tail) {
+		return NULL;
+	}
+
+	size_t index = fw->complete_queue[fw->complete_head];
+	fw->complete_head = (fw->complete_head + 1) % (fw->queue_depth + 1);
+
+	struct file_writer_op_t *op = &fw->ops[index];
+	op->active = false;
+	*psuccess = op->success;
+	return op->tag;
+}
+
+bool file_writer_wait(struct file_writer_t *fw, uint64_t timeout)
+{
+	if (fw->complete_head != fw->complete_tail) {
+		return true;
+	}
+
+#if defined(FILE_WRITER_IO_URING)
+	if (fw->uring.ring.fd >= 0) {
+		if (file_writer_uring_reap(fw)) {
+			return true;
+		}
+
+		/*
+		 * A timer left over from an earlier call fires before this one would, which only ends the wait early,
+		 * so only one is kept outstanding.
+		 */
+		if (!fw->uring.timeout_pending) {
+			if (!file_writer_uring_submit_timeout(&fw->uring, timeout)) {
+				return false;
+			}
+		}
+
+		uring_enter(&fw->uring.ring, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+		return file_writer_uring_reap(fw);
+	}
+#endif
+
+	return false;
+}
+
+bool file_writer_sync(struct file_writer_t *fw)
+{
+#if defined(__linux__)
+	return (fdatasync(fw->fd) == 0);
+#else
+	return (fsync(fw->fd) == 0);
+#endif
+}
+
+bool file_writer_close(struct file_writer_t *fw, uint64_t final_size)
+{
+	bool success = true;
+
+	/* Wait for writes still in flight; their buffers are owned by the caller. */
+	size_t index;
+	for (index = 0; index < fw->queue_depth; index++) {
+		while (fw->ops[index].active) {
+			bool write_success;
+			if (!file_writer_complete(fw, true, &write_success)) {
+				break;
+			}
+			if (!write_success) {
+				success = false;
+			}
+		}
+	}
+
+	/* Trim padding of the final direct write and any preallocated space. */
+	if (ftruncate(fw->fd, (off_t)final_size) != 0) {
+		success = false;
+	}
+
+	if (close(fw->fd) != 0) {
+		success = false;
+	}
+
+#if defined(FILE_WRITER_IO_URING)
+	if (fw->uring.ring.fd >= 0) {
+		uring_dispose(&fw->uring.ring);
+	}
+#endif
+
+	free(fw->complete_queue);
+	free(fw->ops);
+	free(fw);
+	return success;
+}
+
 bool hdhomerun_vsprintf(char *buffer, char *end, const char *fmt, va_list ap)
 {
 	if (buffer >= end) {
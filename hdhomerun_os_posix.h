@@ -39,11 +39,14 @@
 #include <poll.h>
 #include <netdb.h>
 #include <pthread.h>
+#include <sched.h>
 
 typedef void (*sig_t)(int);
 typedef void (*thread_task_func_t)(void *arg);
 typedef pthread_t thread_task_t;
 typedef pthread_mutex_t thread_mutex_t;
+typedef pthread_once_t thread_once_t;
+#define THREAD_ONCE_INIT PTHREAD_ONCE_INIT
 
 typedef struct {
 	volatile bool signaled;
@@ -51,6 +54,17 @@ typedef struct {
 	pthread_cond_t cond;
 } thread_cond_t;
 
+typedef struct {
+	int read_fd;
+	int write_fd;
+} thread_notify_t;
+
+typedef int thread_notify_handle_t;
+#define THREAD_NOTIFY_HANDLE_INVALID (-1)
+
+typedef int hdhomerun_sock_fd_t;
+#define HDHOMERUN_SOCK_FD_INVALID (-1)
+
 #define LIBHDHOMERUN_API
 
 #define LIBHDHOMERUN_PACKED(x) x __attribute__((packed))
@@ -59,6 +73,30 @@ typedef struct {
 #define alignas(n) __attribute__((aligned(n)))
 #endif
 
+/*
+ * Thread attributes for thread_task_create_ex. Zero-initialize for defaults.
+ *
+ * cpu_affinity_mask: bit n allows CPU n (first 64 CPUs). 0 to leave unset. Linux and Windows only.
+ * sched_policy, sched_priority: THREAD_TASK_SCHED_FIFO or THREAD_TASK_SCHED_RR with a priority of 1-99
+ *		(Windows maps these to the time critical or highest thread priority).
+ * nice: nice value for THREAD_TASK_SCHED_DEFAULT threads. Linux and Windows only.
+ * name: thread name shown by debuggers and ps/top, truncated to 15 characters. NULL to leave unset.
+ *
+ * thread_task_create_ex fails if the affinity or scheduling policy cannot be applied (for example
+ * without CAP_SYS_NICE); nice and name are best effort.
+ */
+#define THREAD_TASK_SCHED_DEFAULT 0
+#define THREAD_TASK_SCHED_FIFO 1
+#define THREAD_TASK_SCHED_RR 2
+
+struct thread_task_attr_t {
+	uint64_t cpu_affinity_mask;
+	uint32_t sched_policy;
+	int sched_priority;
+	int nice;
+	const char *name;
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -66,28 +104,122 @@ extern "C" {
 extern LIBHDHOMERUN_API void random_getbytes(uint8_t *out, size_t length);
 extern LIBHDHOMERUN_API uint32_t random_get32(void);
 extern LIBHDHOMERUN_API uint64_t getcurrenttime(void);
+extern LIBHDHOMERUN_API uint64_t getcurrenttime_realtime_ns(void);
 extern LIBHDHOMERUN_API uint64_t timer_get_hires_ticks(void);
 extern LIBHDHOMERUN_API uint64_t timer_get_hires_frequency(void);
 extern LIBHDHOMERUN_API void msleep_approx(uint64_t ms);
 extern LIBHDHOMERUN_API void msleep_minimum(uint64_t ms);
 
 extern LIBHDHOMERUN_API bool thread_task_create(thread_task_t *tid, thread_task_func_t func, void *arg);
+extern LIBHDHOMERUN_API bool thread_task_create_ex(thread_task_t *tid, thread_task_func_t func, void *arg, const struct thread_task_attr_t *attr);
 extern LIBHDHOMERUN_API void thread_task_join(thread_task_t tid);
+extern LIBHDHOMERUN_API void thread_yield(void);
 
 extern LIBHDHOMERUN_API void thread_mutex_init(thread_mutex_t *mutex);
 extern LIBHDHOMERUN_API void thread_mutex_dispose(thread_mutex_t *mutex);
 extern LIBHDHOMERUN_API void thread_mutex_lock(thread_mutex_t *mutex);
 extern LIBHDHOMERUN_API void thread_mutex_unlock(thread_mutex_t *mutex);
 
+extern LIBHDHOMERUN_API void thread_once(thread_once_t *once, void (*func)(void));
+
 extern LIBHDHOMERUN_API void thread_cond_init(thread_cond_t *cond);
 extern LIBHDHOMERUN_API void thread_cond_dispose(thread_cond_t *cond);
 extern LIBHDHOMERUN_API void thread_cond_signal(thread_cond_t *cond);
 extern LIBHDHOMERUN_API void thread_cond_wait(thread_cond_t *cond);
 extern LIBHDHOMERUN_API bool thread_cond_wait_with_timeout(thread_cond_t *cond, uint64_t max_wait_time);
 
+#define MEMORY_MAP_MIRRORED 0x00000001
+#define MEMORY_MAP_HUGE_PAGES 0x00000002
+
+extern LIBHDHOMERUN_API bool thread_notify_init(thread_notify_t *notify);
+extern LIBHDHOMERUN_API void thread_notify_dispose(thread_notify_t *notify);
+extern LIBHDHOMERUN_API void thread_notify_signal(thread_notify_t *notify);
+extern LIBHDHOMERUN_API void thread_notify_clear(thread_notify_t *notify);
+extern LIBHDHOMERUN_API thread_notify_handle_t thread_notify_get_handle(thread_notify_t *notify);
+
+extern LIBHDHOMERUN_API size_t memory_get_page_size(void);
+extern LIBHDHOMERUN_API size_t memory_get_huge_page_size(void);
+extern LIBHDHOMERUN_API void *memory_map_alloc(size_t size, uint32_t flags);
+extern LIBHDHOMERUN_API void memory_map_free(void *ptr, size_t size, uint32_t flags);
+extern LIBHDHOMERUN_API void memory_map_prefault(void *ptr, size_t size);
+extern LIBHDHOMERUN_API bool memory_map_lock(void *ptr, size_t size);
+
+/*
+ * Minimal io_uring ring (Linux) used by the file writer and the socket layer. Callers include <linux/io_uring.h>
+ * to fill in entries. Not thread safe.
+ *
+ * uring_init: params is passed to io_uring_setup (flags and cq_entries in, features out). Returns false if io_uring
+ * is not available. uring_dispose may also be called after a failed uring_init.
+ * uring_get_sqe: a zeroed entry queued at the tail of the SQ, or NULL if the SQ is full. Queued entries are passed
+ * to the kernel by uring_submit; uring_withdraw drops any that have not been.
+ * uring_peek_cqe: the completion at the head of the CQ, or NULL if there is none; uring_cqe_seen consumes it.
+ */
+struct io_uring_params;
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+struct uring_t {
+	int fd;
+	void *sq_ring;
+	size_t sq_ring_size;
+	void *cq_ring;
+	size_t cq_ring_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+	volatile uint32_t *sq_head;
+	volatile uint32_t *sq_tail;
+	uint32_t sq_mask;
+	uint32_t sq_entries;
+	uint32_t *sq_array;
+	volatile uint32_t *cq_head;
+	volatile uint32_t *cq_tail;
+	uint32_t cq_mask;
+	struct io_uring_cqe *cqes;
+};
+
+extern LIBHDHOMERUN_API bool uring_init(struct uring_t *uring, uint32_t entries, struct io_uring_params *params);
+extern LIBHDHOMERUN_API void uring_dispose(struct uring_t *uring);
+extern LIBHDHOMERUN_API int uring_enter(struct uring_t *uring, uint32_t to_submit, uint32_t min_complete, uint32_t flags, void *arg, size_t arg_size);
+extern LIBHDHOMERUN_API int uring_register(struct uring_t *uring, uint32_t opcode, void *arg, uint32_t nr_args);
+extern LIBHDHOMERUN_API struct io_uring_sqe *uring_get_sqe(struct uring_t *uring);
+extern LIBHDHOMERUN_API bool uring_submit(struct uring_t *uring);
+extern LIBHDHOMERUN_API void uring_withdraw(struct uring_t *uring);
+extern LIBHDHOMERUN_API struct io_uring_cqe *uring_peek_cqe(struct uring_t *uring);
+extern LIBHDHOMERUN_API void uring_cqe_seen(struct uring_t *uring);
+
+#define FILE_WRITER_DIRECT_IO 0x00000001
+#define FILE_WRITER_ASYNC 0x00000002
+
+struct file_writer_t;
+
+extern LIBHDHOMERUN_API struct file_writer_t *file_writer_open(const char *filename, uint32_t flags, uint32_t queue_depth);
+extern LIBHDHOMERUN_API uint32_t file_writer_get_flags(struct file_writer_t *fw);
+extern LIBHDHOMERUN_API size_t file_writer_get_alignment(struct file_writer_t *fw);
+extern LIBHDHOMERUN_API bool file_writer_preallocate(struct file_writer_t *fw, uint64_t offset, uint64_t length);
+extern LIBHDHOMERUN_API bool file_writer_submit(struct file_writer_t *fw, const void *data, size_t length, uint64_t offset, void *tag);
+extern LIBHDHOMERUN_API void *file_writer_complete(struct file_writer_t *fw, bool wait, bool *psuccess);
+extern LIBHDHOMERUN_API bool file_writer_wait(struct file_writer_t *fw, uint64_t timeout);
+extern LIBHDHOMERUN_API bool file_writer_sync(struct file_writer_t *fw);
+extern LIBHDHOMERUN_API bool file_writer_close(struct file_writer_t *fw, uint64_t final_size);
+
 extern LIBHDHOMERUN_API bool hdhomerun_vsprintf(char *buffer, char *end, const char *fmt, va_list ap);
 extern LIBHDHOMERUN_API bool hdhomerun_sprintf(char *buffer, char *end, const char *fmt, ...);
 
+static inline size_t thread_atomic_load_acquire_size(volatile size_t *ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+static inline void thread_atomic_store_release_size(volatile size_t *ptr, size_t v)
+{
+	__atomic_store_n(ptr, v, __ATOMIC_RELEASE);
+}
+
+static inline void thread_atomic_fence(void)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -37,6 +37,15 @@ uint64_t getcurrenttime(void)
 	return GetTickCount64();
 }
 
+uint64_t getcurrenttime_realtime_ns(void)
+{
+	/* FILETIME is 100ns units since 1601. */
+	FILETIME ft;
+	GetSystemTimeAsFileTime(&ft);
+	uint64_t t = ((uint64_t)ft.dwHighDateTime << 32) | (uint64_t)ft.dwLowDateTime;
+	return (t - 116444736000000000ULL) * 100;
+}
+
 uint64_t timer_get_hires_ticks(void)
 {
 	LARGE_INTEGER count;
@@ -87,7 +96,37 @@ static DWORD WINAPI thread_task_execute(void *arg)
 	return 0;
 }
 
-bool thread_task_create(thread_task_t *tid, thread_task_func_t func, void *arg)
+static bool thread_task_apply(HANDLE thread, const struct thread_task_attr_t *attr)
+{
+	if (attr->cpu_affinity_mask) {
+		if (SetThreadAffinityMask(thread, (DWORD_PTR)attr->cpu_affinity_mask) == 0) {
+			return false;
+		}
+	}
+
+	if (attr->sched_policy != THREAD_TASK_SCHED_DEFAULT) {
+		int priority = (attr->sched_priority >= 50) ? THREAD_PRIORITY_TIME_CRITICAL : THREAD_PRIORITY_HIGHEST;
+		if (!SetThreadPriority(thread, priority)) {
+			return false;
+		}
+	} else if (attr->nice) {
+		int priority;
+		if (attr->nice <= -10) {
+			priority = THREAD_PRIORITY_HIGHEST;
+		} else if (attr->nice < 0) {
+			priority = THREAD_PRIORITY_ABOVE_NORMAL;
+		} else if (attr->nice < 10) {
+			priority = THREAD_PRIORITY_BELOW_NORMAL;
+		} else {
+			priority = THREAD_PRIORITY_LOWEST;
+		}
+		SetThreadPriority(thread, priority);
+	}
+
+	return true;
+}
+
+bool thread_task_create_ex(thread_task_t *tid, thread_task_func_t func, void *arg, const struct thread_task_attr_t *attr)
 {
 	struct thread_task_execute_args_t *execute_args = (struct thread_task_execute_args_t *)malloc(sizeof(struct thread_task_execute_args_t));
 	if (!execute_args) {
@@ -97,21 +136,43 @@ bool thread_task_create(thread_task_t *tid, thread_task_func_t func, void *arg)
 	execute_args->func = func;
 	execute_args->arg = arg;
 
-	*tid = CreateThread(NULL, 0, thread_task_execute, execute_args, 0, NULL);
+	/* Start suspended so the attributes are in place before the thread runs. */
+	*tid = CreateThread(NULL, 0, thread_task_execute, execute_args, attr ? CREATE_SUSPENDED : 0, NULL);
 	if (!*tid) {
 		free(execute_args);
 		return false;
 	}
 
+	if (attr) {
+		if (!thread_task_apply(*tid, attr)) {
+			TerminateThread(*tid, 0);
+			CloseHandle(*tid);
+			free(execute_args);
+			return false;
+		}
+
+		ResumeThread(*tid);
+	}
+
 	return true;
 }
 
+bool thread_task_create(thread_task_t *tid, thread_task_func_t func, void *arg)
+{
+	return thread_task_create_ex(tid, func, arg, NULL);
+}
+
 void thread_task_join(thread_task_t tid)
 {
 	WaitForSingleObject(tid, INFINITE);
 	CloseHandle(tid);
 }
 
+void thread_yield(void)
+{
+	SwitchToThread();
+}
+
 void thread_mutex_init(thread_mutex_t *mutex)
 {
 	*mutex = CreateMutex(NULL, false, NULL);
@@ -132,6 +193,24 @@ void thread_mutex_unlock(thread_mutex_t *mutex)
 	ReleaseMutex(*mutex);
 }
 
+struct thread_once_context_t {
+	void (*func)(void);
+};
+
+static BOOL CALLBACK thread_once_execute(PINIT_ONCE once, PVOID param, PVOID *context)
+{
+	struct thread_once_context_t *once_context = (struct thread_once_context_t *)param;
+	once_context->func();
+	return TRUE;
+}
+
+void thread_once(thread_once_t *once, void (*func)(void))
+{
+	struct thread_once_context_t once_context;
+	once_context.func = func;
+	InitOnceExecuteOnce(once, thread_once_execute, &once_context, NULL);
+}
+
 void thread_cond_init(thread_cond_t *cond)
 {
 	*cond = CreateEvent(NULL, false, false, NULL);
@@ -157,6 +236,269 @@ bool thread_cond_wait_with_timeout(thread_cond_t *cond, uint64_t max_wait_time)
 	return (WaitForSingleObject(*cond, (DWORD)max_wait_time) == WAIT_OBJECT_0);
 }
 
+bool thread_notify_init(thread_notify_t *notify)
+{
+	*notify = CreateEvent(NULL, true, false, NULL);
+	return (*notify != NULL);
+}
+
+void thread_notify_dispose(thread_notify_t *notify)
+{
+	CloseHandle(*notify);
+}
+
+void thread_notify_signal(thread_notify_t *notify)
+{
+	SetEvent(*notify);
+}
+
+void thread_notify_clear(thread_notify_t *notify)
+{
+	ResetEvent(*notify);
+}
+
+thread_notify_handle_t thread_notify_get_handle(thread_notify_t *notify)
+{
+	return *notify;
+}
+
+size_t memory_get_page_size(void)
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (size_t)info.dwPageSize;
+}
+
+size_t memory_get_huge_page_size(void)
+{
+	return (size_t)GetLargePageMinimum();
+}
+
+void *memory_map_alloc(size_t size, uint32_t flags)
+{
+	if ((size == 0) || (size % memory_get_page_size())) {
+		return NULL;
+	}
+
+	if (flags & MEMORY_MAP_MIRRORED) {
+		return NULL;
+	}
+
+	/* Large pages require SeLockMemoryPrivilege - fall back to standard pages. */
+	if (flags & MEMORY_MAP_HUGE_PAGES) {
+		size_t huge_page_size = memory_get_huge_page_size();
+		if ((huge_page_size > 0) && (size % huge_page_size == 0)) {
+			void *ptr = VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+			if (ptr) {
+				return ptr;
+			}
+		}
+	}
+
+	return VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+}
+
+void memory_map_free(void *ptr, size_t size, uint32_t flags)
+{
+	VirtualFree(ptr, 0, MEM_RELEASE);
+}
+
+void memory_map_prefault(void *ptr, size_t size)
+{
+	volatile uint8_t *p = (volatile uint8_t *)ptr;
+	volatile uint8_t *end = p + size;
+	size_t page_size = memory_get_page_size();
+
+	while (p < end) {
+		*p = 0;
+		p += page_size;
+	}
+}
+
+bool memory_map_lock(void *ptr, size_t size)
+{
+	/* Limited by the process minimum working set size. */
+	return (VirtualLock(ptr, size) != 0);
+}
+
+#define FILE_WRITER_DIRECT_IO_ALIGNMENT 4096
+
+struct file_writer_op_t {
+	void *tag;
+	bool success;
+	bool active;
+};
+
+struct file_writer_t {
+	HANDLE file;
+	uint32_t flags;
+	uint32_t queue_depth;
+	struct file_writer_op_t *ops;
+	size_t complete_head;
+	size_t complete_tail;
+	size_t *complete_queue;
+};
+
+struct file_writer_t *file_writer_open(const char *filename, uint32_t flags, uint32_t queue_depth)
+{
+	struct file_writer_t *fw = (struct file_writer_t *)calloc(1, sizeof(struct file_writer_t));
+	if (!fw) {
+		return NULL;
+	}
+
+	fw->file = INVALID_HANDLE_VALUE;
+
+	if (queue_depth == 0) {
+		queue_depth = 1;
+	}
+	fw->queue_depth = queue_depth;
+
+	fw->ops = (struct file_writer_op_t *)calloc(queue_depth, sizeof(struct file_writer_op_t));
+	fw->complete_queue = (size_t *)calloc(queue_depth + 1, sizeof(size_t));
+	if (!fw->ops || !fw->complete_queue) {
+		goto error;
+	}
+
+	if (flags & FILE_WRITER_DIRECT_IO) {
+		fw->file = CreateFileA(filename, GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING, NULL);
+		if (fw->file != INVALID_HANDLE_VALUE) {
+			fw->flags |= FILE_WRITER_DIRECT_IO;
+		}
+	}
+
+	if (fw->file == INVALID_HANDLE_VALUE) {
+		fw->file = CreateFileA(filename, GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (fw->file == INVALID_HANDLE_VALUE) {
+			goto error;
+		}
+	}
+
+	return fw;
+
+error:
+	if (fw->complete_queue) {
+		free(fw->complete_queue);
+	}
+	if (fw->ops) {
+		free(fw->ops);
+	}
+	free(fw);
+	return NULL;
+}
+
+uint32_t file_writer_get_flags(struct file_writer_t *fw)
+{
+	return fw->flags;
+}
+
+size_t file_writer_get_alignment(struct file_writer_t *fw)
+{
+	if (fw->flags & FILE_WRITER_DIRECT_IO) {
+		return FILE_WRITER_DIRECT_IO_ALIGNMENT;
+	}
+
+	return 1;
+}
+
+bool file_writer_preallocate(struct file_writer_t *fw, uint64_t offset, uint64_t length)
+{
+	FILE_ALLOCATION_INFO info;
+	info.AllocationSize.QuadPart = (LONGLONG)(offset + length);
+	return (SetFileInformationByHandle(fw->file, FileAllocationInfo, &info, sizeof(info)) != 0);
+}
+
+static bool file_writer_write(struct file_writer_t *fw, const void *data, size_t length, uint64_t offset)
+{
+	const uint8_t *ptr = (const uint8_t *)data;
+
+	while (length > 0) {
+		OVERLAPPED overlapped;
+		memset(&overlapped, 0, sizeof(overlapped));
+		overlapped.Offset = (DWORD)offset;
+		overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+		DWORD chunk = (length > 0x40000000) ? 0x40000000 : (DWORD)length;
+		DWORD written = 0;
+		if (!WriteFile(fw->file, ptr, chunk, &written, &overlapped) || (written == 0)) {
+			return false;
+		}
+
+		ptr += written;
+		length -= written;
+		offset += written;
+	}
+
+	return true;
+}
+
+bool file_writer_submit(struct file_writer_t *fw, const void *data, size_t length, uint64_t offset, void *tag)
+{
+	size_t index;
+	for (index = 0; index < fw->queue_depth; index++) {
+		if (!fw->ops[index].active) {
+			break;
+		}
+	}
+	if (index >= fw->queue_depth) {
+		return false;
+	}
+
+	struct file_writer_op_t *op = &fw->ops[index];
+	op->tag = tag;
+	op->active = true;
+	op->success = file_writer_write(fw, data, length, offset);
+
+	fw->complete_queue[fw->complete_tail] = index;
+	fw->complete_tail = (fw->complete_tail + 1) % (fw->queue_depth + 1);
+	return true;
+}
+
+void *file_writer_complete(struct file_writer_t *fw, bool wait, bool *psuccess)
+{
+	if (fw->complete_head == fw->complete_tail) {
+		return NULL;
+	}
+
+	size_t index = fw->complete_queue[fw->complete_head];
+	fw->complete_head = (fw->complete_head + 1) % (fw->queue_depth + 1);
+
+	struct file_writer_op_t *op = &fw->ops[index];
+	op->active = false;
+	*psuccess = op->success;
+	return op->tag;
+}
+
+bool file_writer_wait(struct file_writer_t *fw, uint64_t timeout)
+{
+	return (fw->complete_head != fw->complete_tail);
+}
+
+bool file_writer_sync(struct file_writer_t *fw)
+{
+	return (FlushFileBuffers(fw->file) != 0);
+}
+
+bool file_writer_close(struct file_writer_t *fw, uint64_t final_size)
+{
+	bool success = true;
+
+	/* Trim padding of the final direct write and any preallocated space. */
+	LARGE_INTEGER position;
+	position.QuadPart = (LONGLONG)final_size;
+	if (!SetFilePointerEx(fw->file, position, NULL, FILE_BEGIN) || !SetEndOfFile(fw->file)) {
+		success = false;
+	}
+
+	if (!CloseHandle(fw->file)) {
+		success = false;
+	}
+
+	free(fw->complete_queue);
+	free(fw->ops);
+	free(fw);
+	return success;
+}
+
 bool hdhomerun_vsprintf(char *buffer, char *end, const char *fmt, va_list ap)
 {
 	if (buffer >= end) {
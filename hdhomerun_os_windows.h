@@ -70,7 +70,15 @@ typedef void (*sig_t)(int);
 typedef void (*thread_task_func_t)(void *arg);
 typedef HANDLE thread_task_t;
 typedef HANDLE thread_mutex_t;
+typedef INIT_ONCE thread_once_t;
+#define THREAD_ONCE_INIT INIT_ONCE_STATIC_INIT
 typedef HANDLE thread_cond_t;
+typedef HANDLE thread_notify_t;
+typedef HANDLE thread_notify_handle_t;
+#define THREAD_NOTIFY_HANDLE_INVALID NULL
+
+typedef SOCKET hdhomerun_sock_fd_t;
+#define HDHOMERUN_SOCK_FD_INVALID INVALID_SOCKET
 
 #if !defined(va_copy)
 #define va_copy(x, y) x = y
@@ -83,6 +91,30 @@ typedef HANDLE thread_cond_t;
 #define fseeko _fseeki64
 #define ftello _ftelli64
 
+/*
+ * Thread attributes for thread_task_create_ex. Zero-initialize for defaults.
+ *
+ * cpu_affinity_mask: bit n allows CPU n (first 64 CPUs). 0 to leave unset. Linux and Windows only.
+ * sched_policy, sched_priority: THREAD_TASK_SCHED_FIFO or THREAD_TASK_SCHED_RR with a priority of 1-99
+ *		(Windows maps these to the time critical or highest thread priority).
+ * nice: nice value for THREAD_TASK_SCHED_DEFAULT threads. Linux and Windows only.
+ * name: thread name shown by debuggers and ps/top, truncated to 15 characters. NULL to leave unset.
+ *
+ * thread_task_create_ex fails if the affinity or scheduling policy cannot be applied (for example
+ * without CAP_SYS_NICE); nice and name are best effort.
+ */
+#define THREAD_TASK_SCHED_DEFAULT 0
+#define THREAD_TASK_SCHED_FIFO 1
+#define THREAD_TASK_SCHED_RR 2
+
+struct thread_task_attr_t {
+	uint64_t cpu_affinity_mask;
+	uint32_t sched_policy;
+	int sched_priority;
+	int nice;
+	const char *name;
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -90,28 +122,82 @@ extern "C" {
 extern LIBHDHOMERUN_API void random_getbytes(uint8_t *out, size_t length);
 extern LIBHDHOMERUN_API uint32_t random_get32(void);
 extern LIBHDHOMERUN_API uint64_t getcurrenttime(void);
+extern LIBHDHOMERUN_API uint64_t getcurrenttime_realtime_ns(void);
 extern LIBHDHOMERUN_API uint64_t timer_get_hires_ticks(void);
 extern LIBHDHOMERUN_API uint64_t timer_get_hires_frequency(void);
 extern LIBHDHOMERUN_API void msleep_approx(uint64_t ms);
 extern LIBHDHOMERUN_API void msleep_minimum(uint64_t ms);
 
 extern LIBHDHOMERUN_API bool thread_task_create(thread_task_t *tid, thread_task_func_t func, void *arg);
+extern LIBHDHOMERUN_API bool thread_task_create_ex(thread_task_t *tid, thread_task_func_t func, void *arg, const struct thread_task_attr_t *attr);
 extern LIBHDHOMERUN_API void thread_task_join(thread_task_t tid);
+extern LIBHDHOMERUN_API void thread_yield(void);
 
 extern LIBHDHOMERUN_API void thread_mutex_init(thread_mutex_t *mutex);
 extern LIBHDHOMERUN_API void thread_mutex_dispose(thread_mutex_t *mutex);
 extern LIBHDHOMERUN_API void thread_mutex_lock(thread_mutex_t *mutex);
 extern LIBHDHOMERUN_API void thread_mutex_unlock(thread_mutex_t *mutex);
 
+extern LIBHDHOMERUN_API void thread_once(thread_once_t *once, void (*func)(void));
+
 extern LIBHDHOMERUN_API void thread_cond_init(thread_cond_t *cond);
 extern LIBHDHOMERUN_API void thread_cond_dispose(thread_cond_t *cond);
 extern LIBHDHOMERUN_API void thread_cond_signal(thread_cond_t *cond);
 extern LIBHDHOMERUN_API void thread_cond_wait(thread_cond_t *cond);
 extern LIBHDHOMERUN_API bool thread_cond_wait_with_timeout(thread_cond_t *cond, uint64_t max_wait_time);
 
+#define MEMORY_MAP_MIRRORED 0x00000001
+#define MEMORY_MAP_HUGE_PAGES 0x00000002
+
+extern LIBHDHOMERUN_API bool thread_notify_init(thread_notify_t *notify);
+extern LIBHDHOMERUN_API void thread_notify_dispose(thread_notify_t *notify);
+extern LIBHDHOMERUN_API void thread_notify_signal(thread_notify_t *notify);
+extern LIBHDHOMERUN_API void thread_notify_clear(thread_notify_t *notify);
+extern LIBHDHOMERUN_API thread_notify_handle_t thread_notify_get_handle(thread_notify_t *notify);
+
+extern LIBHDHOMERUN_API size_t memory_get_page_size(void);
+extern LIBHDHOMERUN_API size_t memory_get_huge_page_size(void);
+extern LIBHDHOMERUN_API void *memory_map_alloc(size_t size, uint32_t flags);
+extern LIBHDHOMERUN_API void memory_map_free(void *ptr, size_t size, uint32_t flags);
+extern LIBHDHOMERUN_API void memory_map_prefault(void *ptr, size_t size);
+extern LIBHDHOMERUN_API bool memory_map_lock(void *ptr, size_t size);
+
+#define FILE_WRITER_DIRECT_IO 0x00000001
+#define FILE_WRITER_ASYNC 0x00000002
+
+struct file_writer_t;
+
+extern LIBHDHOMERUN_API struct file_writer_t *file_writer_open(const char *filename, uint32_t flags, uint32_t queue_depth);
+extern LIBHDHOMERUN_API uint32_t file_writer_get_flags(struct file_writer_t *fw);
+extern LIBHDHOMERUN_API size_t file_writer_get_alignment(struct file_writer_t *fw);
+extern LIBHDHOMERUN_API bool file_writer_preallocate(struct file_writer_t *fw, uint64_t offset, uint64_t length);
+extern LIBHDHOMERUN_API bool file_writer_submit(struct file_writer_t *fw, const void *data, size_t length, uint64_t offset, void *tag);
+extern LIBHDHOMERUN_API void *file_writer_complete(struct file_writer_t *fw, bool wait, bool *psuccess);
+extern LIBHDHOMERUN_API bool file_writer_wait(struct file_writer_t *fw, uint64_t timeout);
+extern LIBHDHOMERUN_API bool file_writer_sync(struct file_writer_t *fw);
+extern LIBHDHOMERUN_API bool file_writer_close(struct file_writer_t *fw, uint64_t final_size);
+
 extern LIBHDHOMERUN_API bool hdhomerun_vsprintf(char *buffer, char *end, const char *fmt, va_list ap);
 extern LIBHDHOMERUN_API bool hdhomerun_sprintf(char *buffer, char *end, const char *fmt, ...);
 
+static inline size_t thread_atomic_load_acquire_size(volatile size_t *ptr)
+{
+	size_t v = *ptr;
+	MemoryBarrier();
+	return v;
+}
+
+static inline void thread_atomic_store_release_size(volatile size_t *ptr, size_t v)
+{
+	MemoryBarrier();
+	*ptr = v;
+}
+
+static inline void thread_atomic_fence(void)
+{
+	MemoryBarrier();
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,566 @@
+/*
+ * hdhomerun_psi.c
+ *
+ * Copyright © 2006-2022 Silicondust USA Inc. <www.silicondust.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "hdhomerun.h"
+
+#define PSI_SECTION_SIZE_MAX 1024
+#define PSI_SECTION_SIZE_MIN (8 + 4)
+
+#define PSI_TABLE_ID_PAT 0x00
+#define PSI_TABLE_ID_PMT 0x02
+
+#define PSI_PID_SLOT_NONE 0
+#define PSI_PID_SLOT_PAT 1
+
+struct hdhomerun_psi_assembler_t {
+	uint8_t buffer[PSI_SECTION_SIZE_MAX];
+	size_t length;
+	size_t expected;
+	bool active;
+	int8_t continuity_counter; /* -1 until the first packet */
+
+	/* Last section accepted, used to skip repeats without checking the CRC again. */
+	size_t last_length;
+	uint8_t last_version;
+	uint8_t last_crc[4];
+};
+
+struct hdhomerun_psi_pat_entry_t {
+	uint16_t program_number;
+	uint16_t pmt_pid;
+	uint8_t section_number;
+};
+
+struct hdhomerun_psi_t {
+	/* Receive thread only. */
+	uint8_t pid_slot[0x2000]; /* PSI_PID_SLOT_PAT, or PMT assembler index + 2 */
+	struct hdhomerun_psi_assembler_t pat_assembler;
+	struct hdhomerun_psi_assembler_t pmt_assembler[HDHOMERUN_PSI_PROGRAMS_MAX];
+
+	uint8_t pending_version;
+	uint8_t pending_last_section;
+	uint8_t pending_sections[256 / 8];
+	uint16_t pending_transport_stream_id;
+	size_t pending_count;
+	struct hdhomerun_psi_pat_entry_t pending[HDHOMERUN_PSI_PROGRAMS_MAX];
+
+	struct hdhomerun_psi_program_t publish[HDHOMERUN_PSI_PROGRAMS_MAX];
+
+	/* Written by the receive thread under lock, read by any thread under lock. */
+	thread_mutex_t lock;
+	struct hdhomerun_psi_stats_t stats;
+	size_t program_count;
+	struct hdhomerun_psi_program_t programs[HDHOMERUN_PSI_PROGRAMS_MAX];
+};
+
+static const uint32_t hdhomerun_psi_crc32_table[16] = {
+	0x00000000, 0x04C11DB7, 0x09823B6E, 0x0D4326D9, 0x130476DC, 0x17C56B6B, 0x1A864DB2, 0x1E475005,
+	0x2608EDB8, 0x22C9F00F, 0x2F8AD6D6, 0x2B4BCB61, 0x350C9B64, 0x31CD86D3, 0x3C8EA00A, 0x384FBDBD
+};
+
+uint32_t hdhomerun_psi_crc32(const uint8_t *start, const uint8_t *end)
+{
+	const uint8_t *pos = start;
+	uint32_t crc = 0xFFFFFFFF;
+	while (pos < end) {
+		uint8_t x = *pos++;
+		crc = (crc << 4) ^ hdhomerun_psi_crc32_table[(crc >> 28) ^ (x >> 4)];
+		crc = (crc << 4) ^ hdhomerun_psi_crc32_table[(crc >> 28) ^ (x & 0x0F)];
+	}
+	return crc;
+}
+
+static void hdhomerun_psi_assembler_reset(struct hdhomerun_psi_assembler_t *assembler)
+{
+	assembler->active = false;
+	assembler->continuity_counter = -1;
+	assembler->last_length = 0;
+}
+
+static void hdhomerun_psi_pending_reset(struct hdhomerun_psi_t *psi, uint8_t version, uint8_t last_section)
+{
+	psi->pending_version = version;
+	psi->pending_last_section = last_section;
+	memset(psi->pending_sections, 0, sizeof(psi->pending_sections));
+	psi->pending_count = 0;
+}
+
+struct hdhomerun_psi_t *hdhomerun_psi_create(void)
+{
+	struct hdhomerun_psi_t *psi = (struct hdhomerun_psi_t *)calloc(1, sizeof(struct hdhomerun_psi_t));
+	if (!psi) {
+		return NULL;
+	}
+
+	thread_mutex_init(&psi->lock);
+	psi->stats.pat_version = 0xFF;
+	hdhomerun_psi_reset(psi);
+	return psi;
+}
+
+void hdhomerun_psi_destroy(struct hdhomerun_psi_t *psi)
+{
+	thread_mutex_dispose(&psi->lock);
+	free(psi);
+}
+
+void hdhomerun_psi_reset(struct hdhomerun_psi_t *psi)
+{
+	memset(psi->pid_slot, PSI_PID_SLOT_NONE, sizeof(psi->pid_slot));
+	psi->pid_slot[0x0000] = PSI_PID_SLOT_PAT;
+
+	hdhomerun_psi_assembler_reset(&psi->pat_assembler);
+	hdhomerun_psi_pending_reset(psi, 0xFF, 0);
+
+	thread_mutex_lock(&psi->lock);
+	if ((psi->program_count > 0) || (psi->stats.pat_version != 0xFF)) {
+		psi->stats.generation++;
+	}
+	psi->stats.transport_stream_id = 0;
+	psi->stats.pat_version = 0xFF;
+	psi->program_count = 0;
+	thread_mutex_unlock(&psi->lock);
+}
+
+bool hdhomerun_psi_is_psi_pid(struct hdhomerun_psi_t *psi, uint16_t pid)
+{
+	return psi->pid_slot[pid & 0x1FFF] != PSI_PID_SLOT_NONE;
+}
+
+static struct hdhomerun_psi_program_t *hdhomerun_psi_find_program(struct hdhomerun_psi_t *psi, uint16_t program_number)
+{
+	size_t i;
+	for (i = 0; i < psi->program_count; i++) {
+		if (psi->programs[i].program_number == program_number) {
+			return &psi->programs[i];
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Publish a complete PAT. PMT data is kept for programs whose PMT PID is unchanged.
+ */
+static void hdhomerun_psi_publish_pat(struct hdhomerun_psi_t *psi)
+{
+	/* Sections may arrive in any order - sort the entries by section number (stable). */
+	struct hdhomerun_psi_pat_entry_t ordered[HDHOMERUN_PSI_PROGRAMS_MAX];
+	size_t count = 0;
+	uint32_t section_number;
+	for (section_number = 0; section_number <= psi->pending_last_section; section_number++) {
+		size_t i;
+		for (i = 0; i < psi->pending_count; i++) {
+			if (psi->pending[i].section_number == section_number) {
+				ordered[count++] = psi->pending[i];
+			}
+		}
+	}
+	memcpy(psi->pending, ordered, sizeof(struct hdhomerun_psi_pat_entry_t) * count);
+
+	bool changed = (psi->pending_count != psi->program_count);
+	if (!changed) {
+		size_t i;
+		for (i = 0; i < psi->pending_count; i++) {
+			if ((psi->pending[i].program_number != psi->programs[i].program_number) || (psi->pending[i].pmt_pid != psi->programs[i].pmt_pid)) {
+				changed = true;
+				break;
+			}
+		}
+	}
+
+	if (!changed) {
+		if ((psi->stats.pat_version != psi->pending_version) || (psi->stats.transport_stream_id != psi->pending_transport_stream_id)) {
+			thread_mutex_lock(&psi->lock);
+			psi->stats.pat_version = psi->pending_version;
+			psi->stats.transport_stream_id = psi->pending_transport_stream_id;
+			psi->stats.generation++;
+			thread_mutex_unlock(&psi->lock);
+		}
+		return;
+	}
+
+	struct hdhomerun_psi_program_t *programs = psi->publish;
+
+	memset(psi->pid_slot, PSI_PID_SLOT_NONE, sizeof(psi->pid_slot));
+	psi->pid_slot[0x0000] = PSI_PID_SLOT_PAT;
+
+	uint8_t assembler_count = 0;
+	size_t i;
+	for (i = 0; i < psi->pending_count; i++) {
+		struct hdhomerun_psi_pat_entry_t *entry = &psi->pending[i];
+		struct hdhomerun_psi_program_t *program = &programs[i];
+
+		struct hdhomerun_psi_program_t *existing = hdhomerun_psi_find_program(psi, entry->program_number);
+		if (existing && (existing->pmt_pid == entry->pmt_pid)) {
+			*program = *existing;
+		} else {
+			memset(program, 0, sizeof(struct hdhomerun_psi_program_t));
+			program->program_number = entry->program_number;
+			program->pmt_pid = entry->pmt_pid;
+			program->pcr_pid = 0x1FFF;
+			program->pmt_version = 0xFF;
+		}
+
+		/* Programs may share a PMT PID. */
+		if (psi->pid_slot[entry->pmt_pid] == PSI_PID_SLOT_NONE) {
+			hdhomerun_psi_assembler_reset(&psi->pmt_assembler[assembler_count]);
+			psi->pid_slot[entry->pmt_pid] = assembler_count + 2;
+			assembler_count++;
+		}
+	}
+
+	thread_mutex_lock(&psi->lock);
+	memcpy(psi->programs, programs, sizeof(struct hdhomerun_psi_program_t) * psi->pending_count);
+	psi->program_count = psi->pending_count;
+	psi->stats.pat_version = psi->pending_version;
+	psi->stats.transport_stream_id = psi->pending_transport_stream_id;
+	psi->stats.generation++;
+	thread_mutex_unlock(&psi->lock);
+}
+
+static void hdhomerun_psi_parse_pat(struct hdhomerun_psi_t *psi, const uint8_t *section, size_t length)
+{
+	uint16_t transport_stream_id = ((uint16_t)section[3] << 8) | (uint16_t)section[4];
+	uint8_t version = (section[5] >> 1) & 0x1F;
+	uint8_t section_number = section[6];
+	uint8_t last_section = section[7];
+
+	if ((version != psi->pending_version) || (last_section != psi->pending_last_section) || (transport_stream_id != psi->pending_transport_stream_id)) {
+		hdhomerun_psi_pending_reset(psi, version, last_section);
+		psi->pending_transport_stream_id = transport_stream_id;
+	}
+
+	/* Replace the entries from any previous copy of this section. */
+	size_t count = 0;
+	size_t i;
+	for (i = 0; i < psi->pending_count; i++) {
+		if (psi->pending[i].section_number != section_number) {
+			psi->pending[count++] = psi->pending[i];
+		}
+	}
+
+	const uint8_t *ptr = section + 8;
+	const uint8_t *end = section + length - 4;
+	while (ptr + 4 <= end) {
+		uint16_t program_number = ((uint16_t)ptr[0] << 8) | (uint16_t)ptr[1];
+		uint16_t pid = ((uint16_t)(ptr[2] & 0x1F) << 8) | (uint16_t)ptr[3];
+		ptr += 4;
+
+		if ((program_number == 0) || (pid == 0x0000) || (pid == 0x1FFF)) {
+			continue; /* NIT or invalid PMT PID */
+		}
+		if (count >= HDHOMERUN_PSI_PROGRAMS_MAX) {
+			break;
+		}
+
+		psi->pending[count].program_number = program_number;
+		psi->pending[count].pmt_pid = pid;
+		psi->pending[count].section_number = section_number;
+		count++;
+	}
+
+	psi->pending_count = count;
+	psi->pending_sections[section_number >> 3] |= 1 << (section_number & 7);
+
+	for (i = 0; i <= last_section; i++) {
+		if (!(psi->pending_sections[i >> 3] & (1 << (i & 7)))) {
+			return;
+		}
+	}
+
+	hdhomerun_psi_publish_pat(psi);
+}
+
+static bool hdhomerun_psi_program_equal(const struct hdhomerun_psi_program_t *a, const struct hdhomerun_psi_program_t *b)
+{
+	if ((a->pcr_pid != b->pcr_pid) || (a->pmt_version != b->pmt_version) || (a->stream_count != b->stream_count)) {
+		return false;
+	}
+
+	uint8_t i;
+	for (i = 0; i < a->stream_count; i++) {
+		if ((a->streams[i].pid != b->streams[i].pid) || (a->streams[i].stream_type != b->streams[i].stream_type)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void hdhomerun_psi_parse_pmt(struct hdhomerun_psi_t *psi, uint16_t pid, const uint8_t *section, size_t length)
+{
+	uint16_t program_number = ((uint16_t)section[3] << 8) | (uint16_t)section[4];
+	struct hdhomerun_psi_program_t *existing = hdhomerun_psi_find_program(psi, program_number);
+	if (!existing || (existing->pmt_pid != pid)) {
+		return;
+	}
+
+	if (length < 12 + 4) {
+		return;
+	}
+
+	struct hdhomerun_psi_program_t program;
+	memset(&program, 0, sizeof(program));
+	program.program_number = program_number;
+	program.pmt_pid = pid;
+	program.pmt_version = (section[5] >> 1) & 0x1F;
+	program.pcr_pid = ((uint16_t)(section[8] & 0x1F) << 8) | (uint16_t)section[9];
+
+	uint16_t program_info_length = ((uint16_t)(section[10] & 0x0F) << 8) | (uint16_t)section[11];
+	const uint8_t *ptr = section + 12 + program_info_length;
+	const uint8_t *end = section + length - 4;
+	while (ptr + 5 <= end) {
+		uint8_t stream_type = ptr[0];
+		uint16_t stream_pid = ((uint16_t)(ptr[1] & 0x1F) << 8) | (uint16_t)ptr[2];
+		uint16_t es_info_length = ((uint16_t)(ptr[3] & 0x0F) << 8) | (uint16_t)ptr[4];
+		ptr += 5 + es_info_length;
+
+		if (program.stream_count >= HDHOMERUN_PSI_STREAMS_MAX) {
+			break;
+		}
+
+		program.streams[program.stream_count].pid = stream_pid;
+		program.streams[program.stream_count].stream_type = stream_type;
+		program.stream_count++;
+	}
+
+	if (hdhomerun_psi_program_equal(existing, &program)) {
+		return;
+	}
+
+	thread_mutex_lock(&psi->lock);
+	*existing = program;
+	psi->stats.generation++;
+	thread_mutex_unlock(&psi->lock);
+}
+
+static void hdhomerun_psi_section(struct hdhomerun_psi_t *psi, struct hdhomerun_psi_assembler_t *assembler, uint16_t pid)
+{
+	const uint8_t *section = assembler->buffer;
+	size_t length = assembler->expected;
+
+	uint8_t table_id = section[0];
+	uint8_t expected_table_id = (pid == 0x0000) ? PSI_TABLE_ID_PAT : PSI_TABLE_ID_PMT;
+	if ((table_id != expected_table_id) || !(section[1] & 0x80)) {
+		return;
+	}
+
+	thread_mutex_lock(&psi->lock);
+	psi->stats.section_count++;
+	thread_mutex_unlock(&psi->lock);
+
+	/* Repeated section - same length, version and CRC field as the last one accepted on this PID. */
+	const uint8_t *crc = section + length - 4;
+	if ((length == assembler->last_length) && (section[5] == assembler->last_version) && (memcmp(crc, assembler->last_crc, 4) == 0)) {
+		return;
+	}
+
+	if (hdhomerun_psi_crc32(section, section + length) != 0) {
+		thread_mutex_lock(&psi->lock);
+		psi->stats.crc_error_count++;
+		thread_mutex_unlock(&psi->lock);
+		return;
+	}
+
+	assembler->last_length = length;
+	assembler->last_version = section[5];
+	memcpy(assembler->last_crc, crc, 4);
+
+	/* Sections not yet applicable (current_next_indicator = 0) are ignored. */
+	if (!(section[5] & 0x01)) {
+		return;
+	}
+
+	if (table_id == PSI_TABLE_ID_PAT) {
+		hdhomerun_psi_parse_pat(psi, section, length);
+		return;
+	}
+
+	hdhomerun_psi_parse_pmt(psi, pid, section, length);
+}
+
+/*
+ * Append payload to the section being assembled. New sections may only start after a pointer field
+ * (can_start); once a section completes the next one starts immediately unless the rest is stuffing.
+ */
+static void hdhomerun_psi_assemble(struct hdhomerun_psi_t *psi, struct hdhomerun_psi_assembler_t *assembler, uint16_t pid, const uint8_t *ptr, size_t length, bool can_start)
+{
+	while (length > 0) {
+		if (!assembler->active) {
+			if (!can_start || (ptr[0] == 0xFF)) {
+				return;
+			}
+
+			assembler->active = true;
+			assembler->length = 0;
+			assembler->expected = 3;
+		}
+
+		size_t copy = assembler->expected - assembler->length;
+		if (copy > length) {
+			copy = length;
+		}
+
+		memcpy(assembler->buffer + assembler->length, ptr, copy);
+		assembler->length += copy;
+		ptr += copy;
+		length -= copy;
+
+		if (assembler->length < assembler->expected) {
+			return;
+		}
+
+		if (assembler->length == 3) {
+			size_t expected = 3 + ((((size_t)assembler->buffer[1] & 0x0F) << 8) | (size_t)assembler->buffer[2]);
+			if ((expected < PSI_SECTION_SIZE_MIN) || (expected > PSI_SECTION_SIZE_MAX)) {
+				assembler->active = false;
+				return;
+			}
+
+			assembler->expected = expected;
+			continue;
+		}
+
+		hdhomerun_psi_section(psi, assembler, pid);
+		assembler->active = false;
+		can_start = true;
+	}
+}
+
+void hdhomerun_psi_process_ts(struct hdhomerun_psi_t *psi, const uint8_t *ts_packet)
+{
+	uint16_t pid = ((uint16_t)(ts_packet[1] & 0x1F) << 8) | (uint16_t)ts_packet[2];
+	uint8_t slot = psi->pid_slot[pid];
+	if (slot == PSI_PID_SLOT_NONE) {
+		return;
+	}
+
+	struct hdhomerun_psi_assembler_t *assembler = (slot == PSI_PID_SLOT_PAT) ? &psi->pat_assembler : &psi->pmt_assembler[slot - 2];
+
+	if (ts_packet[1] & 0x80) {
+		/* Transport error - the section in progress cannot be trusted. */
+		assembler->active = false;
+		return;
+	}
+
+	if (!(ts_packet[3] & 0x10)) {
+		return;
+	}
+
+	int8_t continuity_counter = ts_packet[3] & 0x0F;
+	int8_t previous = assembler->continuity_counter;
+	assembler->continuity_counter = continuity_counter;
+	if (previous >= 0) {
+		if (continuity_counter == previous) {
+			return; /* duplicate packet */
+		}
+		if ((continuity_counter != ((previous + 1) & 0x0F)) && assembler->active) {
+			thread_mutex_lock(&psi->lock);
+			psi->stats.discontinuity_count++;
+			thread_mutex_unlock(&psi->lock);
+			assembler->active = false;
+		}
+	}
+
+	const uint8_t *ptr = ts_packet + 4;
+	const uint8_t *end = ts_packet + TS_PACKET_SIZE;
+	if (ts_packet[3] & 0x20) {
+		ptr += 1 + ptr[0];
+	}
+	if (ptr >= end) {
+		return;
+	}
+
+	if (!(ts_packet[1] & 0x40)) {
+		if (assembler->active) {
+			hdhomerun_psi_assemble(psi, assembler, pid, ptr, end - ptr, false);
+		}
+		return;
+	}
+
+	/* Payload unit start - the pointer field gives the bytes that finish the previous section. */
+	size_t pointer_field = *ptr++;
+	if (ptr + pointer_field > end) {
+		assembler->active = false;
+		return;
+	}
+
+	if (assembler->active) {
+		hdhomerun_psi_assemble(psi, assembler, pid, ptr, pointer_field, false);
+	}
+
+	assembler->active = false;
+	ptr += pointer_field;
+	hdhomerun_psi_assemble(psi, assembler, pid, ptr, end - ptr, true);
+}
+
+size_t hdhomerun_psi_get_programs(struct hdhomerun_psi_t *psi, struct hdhomerun_psi_program_t programs[], size_t max_count, uint32_t *pgeneration)
+{
+	thread_mutex_lock(&psi->lock);
+
+	size_t count = psi->program_count;
+	if (count > max_count) {
+		count = max_count;
+	}
+
+	memcpy(programs, psi->programs, sizeof(struct hdhomerun_psi_program_t) * count);
+	if (pgeneration) {
+		*pgeneration = psi->stats.generation;
+	}
+
+	thread_mutex_unlock(&psi->lock);
+	return count;
+}
+
+bool hdhomerun_psi_get_program_pid_bitmap(struct hdhomerun_psi_t *psi, uint16_t program_number, uint8_t pid_bitmap[0x2000 / 8])
+{
+	memset(pid_bitmap, 0, 0x2000 / 8);
+
+	thread_mutex_lock(&psi->lock);
+
+	struct hdhomerun_psi_program_t *program = hdhomerun_psi_find_program(psi, program_number);
+	if (!program || (program->pmt_version == 0xFF)) {
+		thread_mutex_unlock(&psi->lock);
+		return false;
+	}
+
+	pid_bitmap[0] |= 0x01;
+	pid_bitmap[program->pmt_pid >> 3] |= 1 << (program->pmt_pid & 7);
+	if (program->pcr_pid != 0x1FFF) {
+		pid_bitmap[program->pcr_pid >> 3] |= 1 << (program->pcr_pid & 7);
+	}
+
+	uint8_t i;
+	for (i = 0; i < program->stream_count; i++) {
+		uint16_t pid = program->streams[i].pid;
+		pid_bitmap[pid >> 3] |= 1 << (pid & 7);
+	}
+
+	thread_mutex_unlock(&psi->lock);
+	return true;
+}
+
+void hdhomerun_psi_get_stats(struct hdhomerun_psi_t *psi, struct hdhomerun_psi_stats_t *stats)
+{
+	thread_mutex_lock(&psi->lock);
+	*stats = psi->stats;
+	thread_mutex_unlock(&psi->lock);
+}
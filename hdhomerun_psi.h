@@ -0,0 +1,95 @@
+/*
+ * hdhomerun_psi.h
+ *
+ * Copyright © 2006-2022 Silicondust USA Inc. <www.silicondust.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct hdhomerun_psi_t;
+
+#define HDHOMERUN_PSI_PROGRAMS_MAX 64
+#define HDHOMERUN_PSI_STREAMS_MAX 32
+
+struct hdhomerun_psi_stream_t {
+	uint16_t pid;
+	uint8_t stream_type;
+};
+
+struct hdhomerun_psi_program_t {
+	uint16_t program_number;
+	uint16_t pmt_pid;
+	uint16_t pcr_pid;
+	uint8_t pmt_version; /* 0xFF until the PMT has been received */
+	uint8_t stream_count;
+	struct hdhomerun_psi_stream_t streams[HDHOMERUN_PSI_STREAMS_MAX];
+};
+
+struct hdhomerun_psi_stats_t {
+	uint32_t generation; /* incremented each time the program map changes */
+	uint16_t transport_stream_id;
+	uint8_t pat_version; /* 0xFF until the PAT has been received */
+	uint32_t section_count;
+	uint32_t crc_error_count;
+	uint32_t discontinuity_count; /* partial sections discarded after a continuity error */
+};
+
+/*
+ * PAT/PMT section assembler.
+ *
+ * TS packets are passed to hdhomerun_psi_process_ts by a single thread (normally the video receive thread).
+ * Sections are reassembled across packets, checked against their CRC32 and parsed into a program -> PID map
+ * that any thread may read. A section with the same length, version and CRC field as the previous one accepted
+ * on its PID is taken to be a repeat and is not checked or parsed again.
+ * Multi-section PATs are published once every section of the version has been received.
+ */
+extern LIBHDHOMERUN_API struct hdhomerun_psi_t *hdhomerun_psi_create(void);
+extern LIBHDHOMERUN_API void hdhomerun_psi_destroy(struct hdhomerun_psi_t *psi);
+extern LIBHDHOMERUN_API void hdhomerun_psi_reset(struct hdhomerun_psi_t *psi);
+
+/*
+ * Returns true if the PID carries the PAT or a PMT. Cheap enough to call for every TS packet.
+ */
+extern LIBHDHOMERUN_API bool hdhomerun_psi_is_psi_pid(struct hdhomerun_psi_t *psi, uint16_t pid);
+extern LIBHDHOMERUN_API void hdhomerun_psi_process_ts(struct hdhomerun_psi_t *psi, const uint8_t *ts_packet);
+
+/*
+ * Copy the programs listed in the current PAT, in PAT order. Programs whose PMT has not been received
+ * have pmt_version 0xFF and no streams. The NIT entry (program 0) is not included.
+ *
+ * Returns the number of programs copied.
+ */
+extern LIBHDHOMERUN_API size_t hdhomerun_psi_get_programs(struct hdhomerun_psi_t *psi, struct hdhomerun_psi_program_t programs[], size_t max_count, uint32_t *pgeneration);
+
+/*
+ * Build a PID bitmap (see hdhomerun_video_subscribe) for one program: PAT, PMT, PCR and elementary streams.
+ *
+ * Returns false if the program is not in the PAT or its PMT has not been received.
+ */
+extern LIBHDHOMERUN_API bool hdhomerun_psi_get_program_pid_bitmap(struct hdhomerun_psi_t *psi, uint16_t program_number, uint8_t pid_bitmap[0x2000 / 8]);
+
+extern LIBHDHOMERUN_API void hdhomerun_psi_get_stats(struct hdhomerun_psi_t *psi, struct hdhomerun_psi_stats_t *stats);
+
+/*
+ * MPEG-2 CRC32 (polynomial 0x04C11DB7, MSB first). A section including its CRC field yields 0.
+ */
+extern LIBHDHOMERUN_API uint32_t hdhomerun_psi_crc32(const uint8_t *start, const uint8_t *end);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,485 @@
+/*
+ * hdhomerun_record.c
+ *
+ * Copyright © 2006-2022 Silicondust USA Inc. <www.silicondust.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "hdhomerun.h"
+
+#define RECORD_BLOCK_SIZE 4096
+#define RECORD_MIN_BATCH_SIZE (64 * 1024)
+#define RECORD_DEFAULT_BATCH_SIZE (1024 * 1024)
+#define RECORD_DEFAULT_MAX_DELAY 1000
+#define RECORD_QUEUE_DEPTH 4
+#define RECORD_WAIT_TIME 64
+
+struct hdhomerun_record_batch_t {
+	uint8_t *data;
+	size_t length;
+	size_t write_length;
+	uint64_t offset;
+	uint64_t submit_ticks;
+	bool in_flight;
+};
+
+struct hdhomerun_record_t {
+	struct hdhomerun_video_sock_t *vs;
+	struct hdhomerun_debug_t *dbg;
+	struct file_writer_t *fw;
+	thread_task_t thread;
+	volatile bool terminate;
+
+	size_t batch_size;
+	size_t alignment;
+	uint64_t max_delay;
+	uint64_t preallocate_size;
+	uint64_t allocated_size;
+	uint32_t sync_policy;
+	uint64_t sync_interval;
+	uint64_t sync_bytes;
+
+	uint8_t *batch_memory;
+	size_t batch_memory_size;
+	struct hdhomerun_record_batch_t batches[RECORD_QUEUE_DEPTH];
+	struct hdhomerun_record_batch_t *current;
+	uint64_t current_start_time;
+
+	uint64_t file_size;
+	uint64_t unsynced_size;
+	uint64_t last_sync_time;
+	bool write_error_logged;
+
+	thread_mutex_t stats_lock;
+	uint64_t received_size;
+	uint64_t completed_size;
+	uint64_t ring_used_size;
+	uint64_t bytes_written;
+	uint32_t write_count;
+	uint32_t write_error_count;
+	uint32_t sync_count;
+	uint32_t sync_error_count;
+	uint64_t write_latency_total;
+	uint64_t write_latency_max;
+	uint64_t sync_latency_max;
+	uint32_t write_latency_histogram[HDHOMERUN_RECORD_LATENCY_BUCKETS];
+};
+
+static uint64_t hdhomerun_record_ticks_to_us(uint64_t ticks)
+{
+	uint64_t frequency = timer_get_hires_frequency();
+	return (ticks / frequency) * 1000000 + ((ticks % frequency) * 1000000) / frequency;
+}
+
+static void hdhomerun_record_reap(struct hdhomerun_record_t *rec, bool wait)
+{
+	while (1) {
+		bool success;
+		struct hdhomerun_record_batch_t *batch = (struct hdhomerun_record_batch_t *)file_writer_complete(rec->fw, wait, &success);
+		if (!batch) {
+			return;
+		}
+
+		wait = false;
+		batch->in_flight = false;
+
+		uint64_t latency = hdhomerun_record_ticks_to_us(timer_get_hires_ticks() - batch->submit_ticks);
+		uint64_t delta = latency / 16;
+		uint32_t bucket = 0;
+		while (delta && (bucket < HDHOMERUN_RECORD_LATENCY_BUCKETS - 1)) {
+			delta >>= 1;
+			bucket++;
+		}
+
+		thread_mutex_lock(&rec->stats_lock);
+		rec->completed_size += batch->write_length;
+		if (success) {
+			rec->bytes_written += batch->write_length;
+			rec->write_count++;
+			rec->write_latency_total += latency;
+			if (latency > rec->write_latency_max) {
+				rec->write_latency_max = latency;
+			}
+			rec->write_latency_histogram[bucket]++;
+		} else {
+			rec->write_error_count++;
+		}
+		thread_mutex_unlock(&rec->stats_lock);
+
+		if (success) {
+			rec->unsynced_size += batch->write_length;
+			continue;
+		}
+
+		/* The data is lost; keep draining the video socket so the recording can continue if the error clears. */
+		if (!rec->write_error_logged) {
+			hdhomerun_debug_printf(rec->dbg, "hdhomerun_record: write failed at offset %llu\n", (unsigned long long)batch->offset);
+			rec->write_error_logged = true;
+		}
+	}
+}
+
+static struct hdhomerun_record_batch_t *hdhomerun_record_get_free_batch(struct hdhomerun_record_t *rec)
+{
+	while (1) {
+		int i;
+		for (i = 0; i < RECORD_QUEUE_DEPTH; i++) {
+			struct hdhomerun_record_batch_t *batch = &rec->batches[i];
+			if (!batch->in_flight && (batch != rec->current)) {
+				return batch;
+			}
+		}
+
+		hdhomerun_record_reap(rec, true);
+	}
+}
+
+static void hdhomerun_record_sync(struct hdhomerun_record_t *rec)
+{
+	uint64_t start_ticks = timer_get_hires_ticks();
+	bool success = file_writer_sync(rec->fw);
+	uint64_t latency = hdhomerun_record_ticks_to_us(timer_get_hires_ticks() - start_ticks);
+
+	thread_mutex_lock(&rec->stats_lock);
+	if (success) {
+		rec->sync_count++;
+		if (latency > rec->sync_latency_max) {
+			rec->sync_latency_max = latency;
+		}
+	} else {
+		rec->sync_error_count++;
+	}
+	thread_mutex_unlock(&rec->stats_lock);
+
+	rec->unsynced_size = 0;
+	rec->last_sync_time = getcurrenttime();
+}
+
+static void hdhomerun_record_check_sync(struct hdhomerun_record_t *rec)
+{
+	if ((rec->sync_policy != HDHOMERUN_RECORD_SYNC_INTERVAL) || (rec->unsynced_size == 0)) {
+		return;
+	}
+
+	if (rec->sync_bytes && (rec->unsynced_size >= rec->sync_bytes)) {
+		hdhomerun_record_sync(rec);
+		return;
+	}
+
+	if (rec->sync_interval && (getcurrenttime() >= rec->last_sync_time + rec->sync_interval)) {
+		hdhomerun_record_sync(rec);
+		return;
+	}
+}
+
+static void hdhomerun_record_submit(struct hdhomerun_record_t *rec, bool final)
+{
+	struct hdhomerun_record_batch_t *batch = rec->current;
+
+	/* Direct writes must be whole blocks; carry the remainder into the next batch. */
+	size_t write_length = batch->length;
+	if (!final) {
+		write_length -= write_length % rec->alignment;
+	}
+	if (write_length == 0) {
+		return;
+	}
+
+	/* The final direct write is padded to a whole block and the file truncated on close. */
+	size_t padded_length = write_length;
+	if (padded_length % rec->alignment) {
+		padded_length += rec->alignment - (padded_length % rec->alignment);
+		memset(batch->data + write_length, 0, padded_length - write_length);
+	}
+
+	struct hdhomerun_record_batch_t *next = hdhomerun_record_get_free_batch(rec);
+	next->length = batch->length - write_length;
+	memcpy(next->data, batch->data + write_length, next->length);
+
+	if (rec->preallocate_size && (rec->file_size + padded_length > rec->allocated_size)) {
+		uint64_t length = rec->file_size + padded_length + rec->preallocate_size - rec->allocated_size;
+		if (file_writer_preallocate(rec->fw, rec->allocated_size, length)) {
+			rec->allocated_size += length;
+		} else {
+			hdhomerun_debug_printf(rec->dbg, "hdhomerun_record: preallocation not available\n");
+			rec->preallocate_size = 0;
+		}
+	}
+
+	batch->write_length = write_length;
+	batch->offset = rec->file_size;
+	batch->submit_ticks = timer_get_hires_ticks();
+	batch->in_flight = true;
+
+	if (!file_writer_submit(rec->fw, batch->data, padded_length, rec->file_size, batch)) {
+		batch->in_flight = false;
+		thread_mutex_lock(&rec->stats_lock);
+		rec->completed_size += write_length;
+		rec->write_error_count++;
+		thread_mutex_unlock(&rec->stats_lock);
+	}
+
+	rec->file_size += write_length;
+	rec->current = next;
+	rec->current_start_time = getcurrenttime();
+}
+
+static size_t hdhomerun_record_receive(struct hdhomerun_record_t *rec, uint64_t timeout)
+{
+	struct hdhomerun_record_batch_t *batch = rec->current;
+	size_t space = rec->batch_size - batch->length;
+
+	size_t actual_size;
+	uint8_t *ptr = hdhomerun_video_recv_wait(rec->vs, space, space, timeout, &actual_size);
+	if (!ptr) {
+		actual_size = 0;
+	}
+
+	if (actual_size > 0) {
+		if (batch->length == 0) {
+			rec->current_start_time = getcurrenttime();
+		}
+
+		memcpy(batch->data + batch->length, ptr, actual_size);
+		batch->length += actual_size;
+	}
+
+	/* Data not yet returned by the video socket; the data just copied is counted in received_size. */
+	struct hdhomerun_video_occupancy_t occupancy;
+	hdhomerun_video_get_occupancy(rec->vs, &occupancy);
+
+	thread_mutex_lock(&rec->stats_lock);
+	rec->received_size += actual_size;
+	rec->ring_used_size = occupancy.used_size;
+	thread_mutex_unlock(&rec->stats_lock);
+
+	if (rec->batch_size - batch->length < VIDEO_DATA_PACKET_SIZE) {
+		hdhomerun_record_submit(rec, false);
+	} else if ((batch->length >= rec->alignment) && (getcurrenttime() >= rec->current_start_time + rec->max_delay)) {
+		hdhomerun_record_submit(rec, false);
+	}
+
+	return actual_size;
+}
+
+static void hdhomerun_record_thread_execute(void *arg)
+{
+	struct hdhomerun_record_t *rec = (struct hdhomerun_record_t *)arg;
+	rec->last_sync_time = getcurrenttime();
+
+	while (!rec->terminate) {
+		hdhomerun_record_reap(rec, false);
+
+		bool in_flight = false;
+		int i;
+		for (i = 0; i < RECORD_QUEUE_DEPTH; i++) {
+			if (rec->batches[i].in_flight) {
+				in_flight = true;
+				break;
+			}
+		}
+
+		/*
+		 * Sleep on the write completions while async writes are in flight so the latency measured is accurate;
+		 * the video socket keeps buffering meanwhile and is drained without waiting afterwards.
+		 */
+		if (in_flight) {
+			file_writer_wait(rec->fw, RECORD_WAIT_TIME);
+			hdhomerun_record_reap(rec, false);
+			hdhomerun_record_receive(rec, 0);
+		} else {
+			hdhomerun_record_receive(rec, RECORD_WAIT_TIME);
+		}
+
+		hdhomerun_record_check_sync(rec);
+	}
+
+	/* Write what is buffered now; bounded in case the stream is still running. */
+	struct hdhomerun_video_occupancy_t occupancy;
+	hdhomerun_video_get_occupancy(rec->vs, &occupancy);
+	size_t remaining = occupancy.used_size;
+
+	while (remaining > 0) {
+		size_t actual_size = hdhomerun_record_receive(rec, 0);
+		if (actual_size == 0) {
+			break;
+		}
+		remaining -= (actual_size < remaining) ? actual_size : remaining;
+	}
+
+	hdhomerun_record_submit(rec, true);
+
+	int i;
+	for (i = 0; i < RECORD_QUEUE_DEPTH; i++) {
+		while (rec->batches[i].in_flight) {
+			hdhomerun_record_reap(rec, true);
+		}
+	}
+
+	if ((rec->sync_policy != HDHOMERUN_RECORD_SYNC_NONE) && (rec->unsynced_size > 0)) {
+		hdhomerun_record_sync(rec);
+	}
+}
+
+struct hdhomerun_record_t *hdhomerun_record_create(struct hdhomerun_video_sock_t *vs, const char *filename, const struct hdhomerun_record_options_t *options, struct hdhomerun_debug_t *dbg)
+{
+	struct hdhomerun_record_options_t default_options;
+	if (!options) {
+		memset(&default_options, 0, sizeof(default_options));
+		options = &default_options;
+	}
+
+	struct hdhomerun_record_t *rec = (struct hdhomerun_record_t *)calloc(1, sizeof(struct hdhomerun_record_t));
+	if (!rec) {
+		hdhomerun_debug_printf(dbg, "hdhomerun_record_create: failed to allocate record object\n");
+		return NULL;
+	}
+
+	rec->vs = vs;
+	rec->dbg = dbg;
+	thread_mutex_init(&rec->stats_lock);
+
+	rec->batch_size = options->batch_size ? options->batch_size : RECORD_DEFAULT_BATCH_SIZE;
+	if (rec->batch_size < RECORD_MIN_BATCH_SIZE) {
+		rec->batch_size = RECORD_MIN_BATCH_SIZE;
+	}
+	rec->batch_size = (rec->batch_size + RECORD_BLOCK_SIZE - 1) & ~(size_t)(RECORD_BLOCK_SIZE - 1);
+
+	rec->max_delay = options->max_delay_ms ? options->max_delay_ms : RECORD_DEFAULT_MAX_DELAY;
+	rec->preallocate_size = options->preallocate_size;
+	rec->sync_policy = options->sync_policy;
+	rec->sync_interval = options->sync_interval_ms;
+	rec->sync_bytes = options->sync_bytes;
+
+	/* Open file. */
+	uint32_t file_flags = 0;
+	if (options->flags & HDHOMERUN_RECORD_OPTION_DIRECT_IO) {
+		file_flags |= FILE_WRITER_DIRECT_IO;
+	}
+	if (options->flags & HDHOMERUN_RECORD_OPTION_ASYNC_IO) {
+		file_flags |= FILE_WRITER_ASYNC;
+	}
+
+	rec->fw = file_writer_open(filename, file_flags, RECORD_QUEUE_DEPTH);
+	if (!rec->fw) {
+		hdhomerun_debug_printf(dbg, "hdhomerun_record_create: failed to create file %s\n", filename);
+		goto error;
+	}
+
+	uint32_t active_flags = file_writer_get_flags(rec->fw);
+	if ((file_flags & FILE_WRITER_DIRECT_IO) && !(active_flags & FILE_WRITER_DIRECT_IO)) {
+		hdhomerun_debug_printf(dbg, "hdhomerun_record_create: direct io not available, using buffered writes\n");
+	}
+	if ((file_flags & FILE_WRITER_ASYNC) && !(active_flags & FILE_WRITER_ASYNC)) {
+		hdhomerun_debug_printf(dbg, "hdhomerun_record_create: async io not available, using synchronous writes\n");
+	}
+
+	rec->alignment = file_writer_get_alignment(rec->fw);
+
+	/* Create batch buffers, page aligned for direct io. */
+	size_t page_size = memory_get_page_size();
+	rec->batch_memory_size = rec->batch_size * RECORD_QUEUE_DEPTH;
+	rec->batch_memory_size = ((rec->batch_memory_size + page_size - 1) / page_size) * page_size;
+
+	rec->batch_memory = (uint8_t *)memory_map_alloc(rec->batch_memory_size, 0);
+	if (!rec->batch_memory) {
+		hdhomerun_debug_printf(dbg, "hdhomerun_record_create: failed to allocate buffers\n");
+		goto error;
+	}
+
+	int i;
+	for (i = 0; i < RECORD_QUEUE_DEPTH; i++) {
+		rec->batches[i].data = rec->batch_memory + rec->batch_size * i;
+	}
+	rec->current = &rec->batches[0];
+
+	/* Start writer thread. */
+	struct thread_task_attr_t thread_attr;
+	memset(&thread_attr, 0, sizeof(thread_attr));
+	if (options->thread_attr) {
+		thread_attr = *options->thread_attr;
+	}
+	if (!thread_attr.name) {
+		thread_attr.name = "hdhr-record";
+	}
+
+	if (!thread_task_create_ex(&rec->thread, &hdhomerun_record_thread_execute, rec, &thread_attr)) {
+		hdhomerun_debug_printf(dbg, "hdhomerun_record_create: failed to apply thread attributes, using defaults\n");
+
+		memset(&thread_attr, 0, sizeof(thread_attr));
+		thread_attr.name = "hdhr-record";
+
+		if (!thread_task_create_ex(&rec->thread, &hdhomerun_record_thread_execute, rec, &thread_attr)) {
+			hdhomerun_debug_printf(dbg, "hdhomerun_record_create: failed to start thread\n");
+			goto error;
+		}
+	}
+
+	return rec;
+
+error:
+	if (rec->batch_memory) {
+		memory_map_free(rec->batch_memory, rec->batch_memory_size, 0);
+	}
+	if (rec->fw) {
+		file_writer_close(rec->fw, 0);
+	}
+	thread_mutex_dispose(&rec->stats_lock);
+	free(rec);
+	return NULL;
+}
+
+void hdhomerun_record_destroy(struct hdhomerun_record_t *rec)
+{
+	rec->terminate = true;
+	thread_task_join(rec->thread);
+
+	if (!file_writer_close(rec->fw, rec->file_size)) {
+		hdhomerun_debug_printf(rec->dbg, "hdhomerun_record_destroy: error closing file\n");
+	}
+
+	memory_map_free(rec->batch_memory, rec->batch_memory_size, 0);
+	thread_mutex_dispose(&rec->stats_lock);
+	free(rec);
+}
+
+void hdhomerun_record_get_stats(struct hdhomerun_record_t *rec, struct hdhomerun_record_stats_t *stats)
+{
+	memset(stats, 0, sizeof(struct hdhomerun_record_stats_t));
+
+	uint32_t active_flags = file_writer_get_flags(rec->fw);
+	if (active_flags & FILE_WRITER_DIRECT_IO) {
+		stats->flags |= HDHOMERUN_RECORD_OPTION_DIRECT_IO;
+	}
+	if (active_flags & FILE_WRITER_ASYNC) {
+		stats->flags |= HDHOMERUN_RECORD_OPTION_ASYNC_IO;
+	}
+
+	thread_mutex_lock(&rec->stats_lock);
+
+	stats->bytes_written = rec->bytes_written;
+	stats->bytes_behind = rec->ring_used_size + (rec->received_size - rec->completed_size);
+	stats->write_count = rec->write_count;
+	stats->write_error_count = rec->write_error_count;
+	stats->sync_count = rec->sync_count;
+	stats->sync_error_count = rec->sync_error_count;
+	stats->write_latency_avg = rec->write_count ? rec->write_latency_total / rec->write_count : 0;
+	stats->write_latency_max = rec->write_latency_max;
+	stats->sync_latency_max = rec->sync_latency_max;
+	memcpy(stats->write_latency_histogram, rec->write_latency_histogram, sizeof(stats->write_latency_histogram));
+
+	thread_mutex_unlock(&rec->stats_lock);
+}
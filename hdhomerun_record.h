@@ -0,0 +1,107 @@
+/*
+ * hdhomerun_record.h
+ *
+ * Copyright © 2006-2022 Silicondust USA Inc. <www.silicondust.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct hdhomerun_record_t;
+
+#define HDHOMERUN_RECORD_LATENCY_BUCKETS 16
+
+struct hdhomerun_record_stats_t {
+	uint64_t bytes_written;
+	uint64_t bytes_behind; /* received from the video socket but not yet written, including data still in the ring */
+	uint32_t write_count;
+	uint32_t write_error_count;
+	uint32_t sync_count;
+	uint32_t sync_error_count;
+	uint32_t flags; /* HDHOMERUN_RECORD_OPTION_DIRECT_IO / HDHOMERUN_RECORD_OPTION_ASYNC_IO if in use */
+	uint64_t write_latency_avg; /* microseconds */
+	uint64_t write_latency_max;
+	uint64_t sync_latency_max;
+	uint32_t write_latency_histogram[HDHOMERUN_RECORD_LATENCY_BUCKETS]; /* bucket 0 < 16us, bucket n [2^(n+3), 2^(n+4)) us */
+};
+
+/*
+ * Recording sink options. Zero-initialize for defaults.
+ *
+ * HDHOMERUN_RECORD_OPTION_DIRECT_IO: Bypass the page cache (O_DIRECT / FILE_FLAG_NO_BUFFERING, F_NOCACHE on
+ *		macOS). Falls back to buffered writes if the filesystem does not support it.
+ *
+ * HDHOMERUN_RECORD_OPTION_ASYNC_IO: Keep several batches in flight using io_uring (Linux). Falls back to
+ *		pwrite from the writer thread if io_uring is not available.
+ *
+ * batch_size: Bytes collected from the video socket per write. Rounded up to 4096. Default 1MB.
+ *
+ * max_delay_ms: Write a partial batch once its oldest data has waited this long. Default 1000ms.
+ *
+ * preallocate_size: Reserve disk space this far ahead of the write position (fallocate, Linux and
+ *		Windows) to reduce fragmentation and allocation stalls. The file size only grows as data is
+ *		written; unused space is released when the sink is destroyed. 0 to disable.
+ *
+ * sync_policy: When written data is flushed to the device.
+ *		HDHOMERUN_RECORD_SYNC_NONE (default): left to the operating system.
+ *		HDHOMERUN_RECORD_SYNC_INTERVAL: after every sync_bytes written or every sync_interval_ms,
+ *			whichever comes first (either may be 0 to disable that trigger), and on destroy.
+ *		HDHOMERUN_RECORD_SYNC_CLOSE: once on destroy.
+ *
+ * thread_attr: Attributes for the writer thread (see thread_task_create_ex). NULL for defaults.
+ */
+#define HDHOMERUN_RECORD_OPTION_DIRECT_IO 0x00000001
+#define HDHOMERUN_RECORD_OPTION_ASYNC_IO 0x00000002
+
+#define HDHOMERUN_RECORD_SYNC_NONE 0
+#define HDHOMERUN_RECORD_SYNC_INTERVAL 1
+#define HDHOMERUN_RECORD_SYNC_CLOSE 2
+
+struct hdhomerun_record_options_t {
+	uint32_t flags;
+	size_t batch_size;
+	uint32_t max_delay_ms;
+	uint64_t preallocate_size;
+	uint32_t sync_policy;
+	uint32_t sync_interval_ms;
+	uint64_t sync_bytes;
+	const struct thread_task_attr_t *thread_attr;
+};
+
+/*
+ * Create a recording sink.
+ *
+ * A writer thread reads the video socket and writes the stream to the file, so a slow disk backs up
+ * into the video ring rather than stalling the application. The sink is the reader of the video socket:
+ * the application must not call hdhomerun_video_recv or related functions while it is attached.
+ *
+ * The video socket must outlive the sink.
+ *
+ * Returns NULL if the file cannot be created.
+ */
+extern LIBHDHOMERUN_API struct hdhomerun_record_t *hdhomerun_record_create(struct hdhomerun_video_sock_t *vs, const char *filename, const struct hdhomerun_record_options_t *options, struct hdhomerun_debug_t *dbg);
+
+/*
+ * Stop the writer thread, write any data remaining in the video socket and close the file.
+ */
+extern LIBHDHOMERUN_API void hdhomerun_record_destroy(struct hdhomerun_record_t *rec);
+
+extern LIBHDHOMERUN_API void hdhomerun_record_get_stats(struct hdhomerun_record_t *rec, struct hdhomerun_record_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
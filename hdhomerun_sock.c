@@ -149,6 +149,30 @@ void hdhomerun_sock_sockaddr_set_port(struct sockaddr *addr, uint16_t port)
 	}
 }
 
+bool hdhomerun_sock_sockaddr_ip_equal(const struct sockaddr *a, const struct sockaddr *b)
+{
+	if (a->sa_family != b->sa_family) {
+		return false;
+	}
+
+	if (a->sa_family == AF_INET6) {
+		const struct sockaddr_in6 *a_in6 = (const struct sockaddr_in6 *)a;
+		const struct sockaddr_in6 *b_in6 = (const struct sockaddr_in6 *)b;
+		if (a_in6->sin6_scope_id != b_in6->sin6_scope_id) {
+			return false;
+		}
+		return memcmp(&a_in6->sin6_addr, &b_in6->sin6_addr, sizeof(a_in6->sin6_addr)) == 0;
+	}
+
+	if (a->sa_family == AF_INET) {
+		const struct sockaddr_in *a_in = (const struct sockaddr_in *)a;
+		const struct sockaddr_in *b_in = (const struct sockaddr_in *)b;
+		return a_in->sin_addr.s_addr == b_in->sin_addr.s_addr;
+	}
+
+	return false;
+}
+
 void hdhomerun_sock_sockaddr_copy(struct sockaddr_storage *result, const struct sockaddr *addr)
 {
 	memset(result, 0, sizeof(struct sockaddr_storage));
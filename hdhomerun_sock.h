@@ -46,6 +46,7 @@ extern LIBHDHOMERUN_API bool hdhomerun_sock_sockaddr_is_ipv6_linklocal(const str
 extern LIBHDHOMERUN_API bool hdhomerun_sock_sockaddr_is_ipv6_global(const struct sockaddr *addr);
 extern LIBHDHOMERUN_API uint16_t hdhomerun_sock_sockaddr_get_port(const struct sockaddr *addr);
 extern LIBHDHOMERUN_API void hdhomerun_sock_sockaddr_set_port(struct sockaddr *addr, uint16_t port);
+extern LIBHDHOMERUN_API bool hdhomerun_sock_sockaddr_ip_equal(const struct sockaddr *a, const struct sockaddr *b);
 extern LIBHDHOMERUN_API void hdhomerun_sock_sockaddr_copy(struct sockaddr_storage *result, const struct sockaddr *addr);
 extern LIBHDHOMERUN_API void hdhomerun_sock_sockaddr_to_ip_str(char ip_str[64], const struct sockaddr *ip_addr, bool include_ipv6_scope_id);
 extern LIBHDHOMERUN_API bool hdhomerun_sock_ip_str_to_sockaddr(const char *ip_str, struct sockaddr_storage *result);
@@ -75,6 +76,8 @@ extern LIBHDHOMERUN_API void hdhomerun_sock_set_allow_reuse(struct hdhomerun_soc
 extern LIBHDHOMERUN_API void hdhomerun_sock_set_ttl(struct hdhomerun_sock_t *sock, uint8_t ttl);
 extern LIBHDHOMERUN_API void hdhomerun_sock_set_ipv4_onesbcast(struct hdhomerun_sock_t *sock, int v);
 extern LIBHDHOMERUN_API void hdhomerun_sock_set_ipv6_multicast_ifindex(struct hdhomerun_sock_t *sock, uint32_t ifindex);
+extern LIBHDHOMERUN_API bool hdhomerun_sock_set_recv_timestamps(struct hdhomerun_sock_t *sock, bool enable);
+extern LIBHDHOMERUN_API bool hdhomerun_sock_set_busy_poll(struct hdhomerun_sock_t *sock, uint32_t usec);
 
 extern LIBHDHOMERUN_API int hdhomerun_sock_getlasterror(void);
 extern LIBHDHOMERUN_API uint32_t hdhomerun_sock_getsockname_addr(struct hdhomerun_sock_t *sock);
@@ -104,6 +107,113 @@ extern LIBHDHOMERUN_API bool hdhomerun_sock_recv(struct hdhomerun_sock_t *sock,
 extern LIBHDHOMERUN_API bool hdhomerun_sock_recvfrom(struct hdhomerun_sock_t *sock, uint32_t *remote_addr, uint16_t *remote_port, void *data, size_t *length, uint64_t timeout);
 extern LIBHDHOMERUN_API bool hdhomerun_sock_recvfrom_ex(struct hdhomerun_sock_t *sock, struct sockaddr_storage *remote_addr, void *data, size_t *length, uint64_t timeout);
 
+#define HDHOMERUN_SOCK_CONNECT_WAIT_MAX 8
+
+/*
+ * Non-blocking operations for sockets driven by an external event loop.
+ *
+ * hdhomerun_sock_get_fd: The OS socket to wait on (poll/epoll, or WSAPoll on Windows).
+ *
+ * hdhomerun_sock_connect_start: Begin a TCP connection. Completion is signaled by the socket becoming writable,
+ * after which hdhomerun_sock_connect_finish returns whether the connection succeeded.
+ *
+ * hdhomerun_sock_connect_wait: Wait for the first of several started connections to complete (successfully or
+ * not). Returns the index of the socket, or -1 on timeout. At most HDHOMERUN_SOCK_CONNECT_WAIT_MAX sockets.
+ *
+ * hdhomerun_sock_send_nonblocking / hdhomerun_sock_recv_nonblocking: Returns 1 with *length updated to the
+ * number of bytes transferred (possibly fewer than requested), 0 if the operation would block, or -1 on error
+ * or if the connection was closed.
+ */
+extern LIBHDHOMERUN_API hdhomerun_sock_fd_t hdhomerun_sock_get_fd(struct hdhomerun_sock_t *sock);
+extern LIBHDHOMERUN_API bool hdhomerun_sock_connect_start(struct hdhomerun_sock_t *sock, const struct sockaddr *remote_addr);
+extern LIBHDHOMERUN_API bool hdhomerun_sock_connect_finish(struct hdhomerun_sock_t *sock);
+extern LIBHDHOMERUN_API int hdhomerun_sock_connect_wait(struct hdhomerun_sock_t *socks[], int count, uint64_t timeout);
+extern LIBHDHOMERUN_API int hdhomerun_sock_send_nonblocking(struct hdhomerun_sock_t *sock, const void *data, size_t *length);
+extern LIBHDHOMERUN_API int hdhomerun_sock_recv_nonblocking(struct hdhomerun_sock_t *sock, void *data, size_t *length);
+
+/*
+ * Receive multiple datagrams in one call.
+ *
+ * On entry *pcount is the number of msgs entries available (capped at HDHOMERUN_SOCK_RECV_MULTIPLE_MAX) and each
+ * msgs[i].length is the size of msgs[i].data. On success *pcount is set to the number of datagrams received and
+ * msgs[i].length to the total size of each datagram.
+ *
+ * If msgs[i].header is set the first header_length bytes of the datagram are scattered into it and the
+ * remainder into data. The returned length includes the header bytes.
+ *
+ * msgs[i].timestamp is set to the kernel receive time (ns since the epoch) if enabled with
+ * hdhomerun_sock_set_recv_timestamps and supported by the platform, otherwise 0.
+ *
+ * Uses recvmmsg where available, otherwise receives a single datagram per call.
+ *
+ * *psyscall_count is set to the number of system calls made, including the wait when the first receive finds
+ * the socket empty.
+ */
+#define HDHOMERUN_SOCK_RECV_MULTIPLE_MAX 64
+
+struct hdhomerun_sock_recv_msg_t {
+	void *header;
+	size_t header_length;
+	void *data;
+	size_t length;
+	uint64_t timestamp;
+};
+
+extern LIBHDHOMERUN_API bool hdhomerun_sock_recv_multiple(struct hdhomerun_sock_t *sock, struct hdhomerun_sock_recv_msg_t msgs[], size_t *pcount, uint32_t *psyscall_count, uint64_t timeout);
+
+/*
+ * Readiness set for servicing many sockets from one thread.
+ *
+ * Each socket or notify handle is registered with an arg that is returned by hdhomerun_sock_poll_wait when it
+ * is readable (level triggered). Sockets may be added and removed while another thread is waiting.
+ *
+ * hdhomerun_sock_poll_wait: timeout in milliseconds, or -1 to wait forever. Returns the number of ready args,
+ * 0 on timeout, or -1 on error.
+ *
+ * Implemented with epoll on Linux. hdhomerun_sock_poll_create returns NULL on other platforms.
+ */
+struct hdhomerun_sock_poll_t;
+
+extern LIBHDHOMERUN_API struct hdhomerun_sock_poll_t *hdhomerun_sock_poll_create(void);
+extern LIBHDHOMERUN_API void hdhomerun_sock_poll_destroy(struct hdhomerun_sock_poll_t *ps);
+extern LIBHDHOMERUN_API bool hdhomerun_sock_poll_add(struct hdhomerun_sock_poll_t *ps, struct hdhomerun_sock_t *sock, void *arg);
+extern LIBHDHOMERUN_API bool hdhomerun_sock_poll_add_notify(struct hdhomerun_sock_poll_t *ps, thread_notify_handle_t handle, void *arg);
+extern LIBHDHOMERUN_API void hdhomerun_sock_poll_remove(struct hdhomerun_sock_poll_t *ps, struct hdhomerun_sock_t *sock);
+extern LIBHDHOMERUN_API int hdhomerun_sock_poll_wait(struct hdhomerun_sock_poll_t *ps, void *args[], int max_count, int64_t timeout);
+
+/*
+ * io_uring receive ring for servicing many datagram sockets from one thread without a syscall per datagram.
+ *
+ * Each socket added is received with a multishot recv into its own pool of buffer_count provided buffers of
+ * buffer_size bytes. hdhomerun_sock_uring_wait returns one entry per datagram (arg, data, length); a notify
+ * handle returns an entry with the notify arg and NULL data. Buffers must be handed back with
+ * hdhomerun_sock_uring_recycle before the next wait. Sockets may be added and removed while another thread is
+ * waiting; no entries are returned for a socket once hdhomerun_sock_uring_remove has returned.
+ *
+ * hdhomerun_sock_uring_wait: timeout in milliseconds, or -1 to wait forever. Returns the number of entries,
+ * 0 on timeout, or -1 on error.
+ *
+ * Requires Linux 5.19 (provided buffer rings) and uses multishot recv from 6.0. hdhomerun_sock_uring_create
+ * returns NULL if the kernel does not support it or on other platforms.
+ */
+struct hdhomerun_sock_uring_t;
+
+struct hdhomerun_sock_uring_entry_t {
+	void *arg;
+	uint8_t *data;
+	size_t length;
+	void *source;
+	uint16_t buffer_id;
+};
+
+extern LIBHDHOMERUN_API struct hdhomerun_sock_uring_t *hdhomerun_sock_uring_create(uint32_t entries);
+extern LIBHDHOMERUN_API void hdhomerun_sock_uring_destroy(struct hdhomerun_sock_uring_t *ring);
+extern LIBHDHOMERUN_API bool hdhomerun_sock_uring_add(struct hdhomerun_sock_uring_t *ring, struct hdhomerun_sock_t *sock, void *arg, uint32_t buffer_count, size_t buffer_size);
+extern LIBHDHOMERUN_API bool hdhomerun_sock_uring_add_notify(struct hdhomerun_sock_uring_t *ring, thread_notify_handle_t handle, void *arg);
+extern LIBHDHOMERUN_API void hdhomerun_sock_uring_remove(struct hdhomerun_sock_uring_t *ring, struct hdhomerun_sock_t *sock);
+extern LIBHDHOMERUN_API int hdhomerun_sock_uring_wait(struct hdhomerun_sock_uring_t *ring, struct hdhomerun_sock_uring_entry_t entries[], int max_count, int64_t timeout);
+extern LIBHDHOMERUN_API void hdhomerun_sock_uring_recycle(struct hdhomerun_sock_uring_t *ring, struct hdhomerun_sock_uring_entry_t entries[], int count);
+
 #ifdef __cplusplus
 }
 #endif
@@ -18,8 +18,27 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include "hdhomerun.h"
 
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+#endif
+
+#if defined(__linux__) && defined(__NR_io_uring_setup) && defined(IORING_RECV_MULTISHOT)
+#define HDHOMERUN_SOCK_URING 1
+#endif
+
 #ifndef MSG_NOSIGNAL
 #define MSG_NOSIGNAL 0
 #endif
@@ -28,6 +47,7 @@ struct hdhomerun_sock_t {
 	int sock;
 	int af;
 	uint8_t ttl_set;
+	bool recv_timestamps;
 };
 
 static struct hdhomerun_sock_t *hdhomerun_sock_create_internal(int af, int protocol)
@@ -148,6 +168,38 @@ void hdhomerun_sock_set_ipv6_multicast_ifindex(struct hdhomerun_sock_t *sock, ui
 	setsockopt(sock->sock, IPPROTO_IPV6, IPV6_MULTICAST_IF, (char *)&ifindex, sizeof(ifindex));
 }
 
+bool hdhomerun_sock_set_recv_timestamps(struct hdhomerun_sock_t *sock, bool enable)
+{
+	int sock_opt = enable ? 1 : 0;
+
+#if defined(SO_TIMESTAMPNS)
+	if (setsockopt(sock->sock, SOL_SOCKET, SO_TIMESTAMPNS, (char *)&sock_opt, sizeof(sock_opt)) != 0) {
+		return false;
+	}
+#elif defined(SO_TIMESTAMP)
+	if (setsockopt(sock->sock, SOL_SOCKET, SO_TIMESTAMP, (char *)&sock_opt, sizeof(sock_opt)) != 0) {
+		return false;
+	}
+#else
+	if (enable) {
+		return false;
+	}
+#endif
+
+	sock->recv_timestamps = enable;
+	return true;
+}
+
+bool hdhomerun_sock_set_busy_poll(struct hdhomerun_sock_t *sock, uint32_t usec)
+{
+#if defined(SO_BUSY_POLL)
+	int sock_opt = (int)usec;
+	return (setsockopt(sock->sock, SOL_SOCKET, SO_BUSY_POLL, (char *)&sock_opt, sizeof(sock_opt)) == 0);
+#else
+	return (usec == 0);
+#endif
+}
+
 int hdhomerun_sock_getlasterror(void)
 {
 	return errno;
@@ -281,7 +333,12 @@ bool hdhomerun_sock_bind_ex(struct hdhomerun_sock_t *sock, const struct sockaddr
 	return true;
 }
 
-bool hdhomerun_sock_connect_ex(struct hdhomerun_sock_t *sock, const struct sockaddr *remote_addr, uint64_t timeout)
+hdhomerun_sock_fd_t hdhomerun_sock_get_fd(struct hdhomerun_sock_t *sock)
+{
+	return sock->sock;
+}
+
+bool hdhomerun_sock_connect_start(struct hdhomerun_sock_t *sock, const struct sockaddr *remote_addr)
 {
 	socklen_t remote_addr_size;
 	switch (remote_addr->sa_family) {
@@ -301,6 +358,58 @@ bool hdhomerun_sock_connect_ex(struct hdhomerun_sock_t *sock, const struct socka
 		}
 	}
 
+	return true;
+}
+
+bool hdhomerun_sock_connect_finish(struct hdhomerun_sock_t *sock)
+{
+	int error = 0;
+	socklen_t error_size = sizeof(error);
+	if (getsockopt(sock->sock, SOL_SOCKET, SO_ERROR, (char *)&error, &error_size) != 0) {
+		return false;
+	}
+
+	if (error != 0) {
+		errno = error;
+		return false;
+	}
+
+	return true;
+}
+
+int hdhomerun_sock_connect_wait(struct hdhomerun_sock_t *socks[], int count, uint64_t timeout)
+{
+	struct pollfd poll_events[HDHOMERUN_SOCK_CONNECT_WAIT_MAX];
+	if (count > HDHOMERUN_SOCK_CONNECT_WAIT_MAX) {
+		count = HDHOMERUN_SOCK_CONNECT_WAIT_MAX;
+	}
+
+	int i;
+	for (i = 0; i < count; i++) {
+		poll_events[i].fd = socks[i]->sock;
+		poll_events[i].events = POLLOUT;
+		poll_events[i].revents = 0;
+	}
+
+	if (poll(poll_events, count, (int)timeout) <= 0) {
+		return -1;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (poll_events[i].revents & (POLLOUT | POLLERR | POLLHUP)) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+bool hdhomerun_sock_connect_ex(struct hdhomerun_sock_t *sock, const struct sockaddr *remote_addr, uint64_t timeout)
+{
+	if (!hdhomerun_sock_connect_start(sock, remote_addr)) {
+		return false;
+	}
+
 	struct pollfd poll_event;
 	poll_event.fd = sock->sock;
 	poll_event.events = POLLOUT;
@@ -441,6 +550,39 @@ bool hdhomerun_sock_sendto_ex(struct hdhomerun_sock_t *sock, const struct sockad
 	}
 }
 
+int hdhomerun_sock_send_nonblocking(struct hdhomerun_sock_t *sock, const void *data, size_t *length)
+{
+	ssize_t ret = send(sock->sock, data, *length, MSG_NOSIGNAL);
+	if (ret >= 0) {
+		*length = (size_t)ret;
+		return 1;
+	}
+
+	if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINPROGRESS)) {
+		return 0;
+	}
+
+	return -1;
+}
+
+int hdhomerun_sock_recv_nonblocking(struct hdhomerun_sock_t *sock, void *data, size_t *length)
+{
+	ssize_t ret = recv(sock->sock, data, *length, 0);
+	if (ret > 0) {
+		*length = (size_t)ret;
+		return 1;
+	}
+
+	if (ret == 0) {
+		return -1;
+	}
+	if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+		return 0;
+	}
+
+	return -1;
+}
+
 bool hdhomerun_sock_recv(struct hdhomerun_sock_t *sock, void *data, size_t *length, uint64_t timeout)
 {
 	ssize_t ret = recv(sock->sock, data, *length, 0);
@@ -515,3 +657,827 @@ bool hdhomerun_sock_recvfrom_ex(struct hdhomerun_sock_t *sock, struct sockaddr_s
 
 	return false;
 }
+
+static int hdhomerun_sock_recv_msg_iov(struct hdhomerun_sock_recv_msg_t *msg, struct iovec iov[2])
+{
+	if (!msg->header) {
+		iov[0].iov_base = msg->data;
+		iov[0].iov_len = msg->length;
+		return 1;
+	}
+
+	iov[0].iov_base = msg->header;
+	iov[0].iov_len = msg->header_length;
+	iov[1].iov_base = msg->data;
+	iov[1].iov_len = msg->length;
+	return 2;
+}
+
+#if defined(SO_TIMESTAMPNS)
+#define HDHOMERUN_SOCK_RECV_CONTROL_SIZE CMSG_SPACE(sizeof(struct timespec))
+#else
+#define HDHOMERUN_SOCK_RECV_CONTROL_SIZE CMSG_SPACE(sizeof(struct timeval))
+#endif
+
+static void hdhomerun_sock_recv_msg_control(struct hdhomerun_sock_t *sock, struct msghdr *hdr, uint8_t *control)
+{
+	if (!sock->recv_timestamps) {
+		return;
+	}
+
+	hdr->msg_control = control;
+	hdr->msg_controllen = HDHOMERUN_SOCK_RECV_CONTROL_SIZE;
+}
+
+static uint64_t hdhomerun_sock_recv_msg_timestamp(struct msghdr *hdr)
+{
+	if (!hdr->msg_control) {
+		return 0;
+	}
+
+	struct cmsghdr *cmsg;
+	for (cmsg = CMSG_FIRSTHDR(hdr); cmsg; cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET) {
+			continue;
+		}
+
+#if defined(SO_TIMESTAMPNS)
+		if (cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+			struct timespec ts;
+			memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+			return ((uint64_t)ts.tv_sec * 1000000000) + (uint64_t)ts.tv_nsec;
+		}
+#elif defined(SO_TIMESTAMP)
+		if (cmsg->cmsg_type == SCM_TIMESTAMP) {
+			struct timeval tv;
+			memcpy(&tv, CMSG_DATA(cmsg), sizeof(tv));
+			return ((uint64_t)tv.tv_sec * 1000000000) + ((uint64_t)tv.tv_usec * 1000);
+		}
+#endif
+	}
+
+	return 0;
+}
+
+static ssize_t hdhomerun_sock_recvmsg(struct hdhomerun_sock_t *sock, struct hdhomerun_sock_recv_msg_t *msg)
+{
+	struct iovec iov[2];
+	uint8_t control[HDHOMERUN_SOCK_RECV_CONTROL_SIZE];
+	struct msghdr hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.msg_iov = iov;
+	hdr.msg_iovlen = hdhomerun_sock_recv_msg_iov(msg, iov);
+	hdhomerun_sock_recv_msg_control(sock, &hdr, control);
+
+	ssize_t ret = recvmsg(sock->sock, &hdr, 0);
+	if (ret > 0) {
+		msg->timestamp = hdhomerun_sock_recv_msg_timestamp(&hdr);
+	}
+
+	return ret;
+}
+
+static bool hdhomerun_sock_recv_single(struct hdhomerun_sock_t *sock, struct hdhomerun_sock_recv_msg_t msgs[], size_t *pcount, uint32_t *psyscall_count, uint64_t timeout)
+{
+	*psyscall_count = 1;
+	ssize_t ret = hdhomerun_sock_recvmsg(sock, &msgs[0]);
+	if (ret > 0) {
+		msgs[0].length = (size_t)ret;
+		*pcount = 1;
+		return true;
+	}
+
+	if (ret == 0) {
+		return false;
+	}
+	if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINPROGRESS)) {
+		return false;
+	}
+
+	struct pollfd poll_event;
+	poll_event.fd = sock->sock;
+	poll_event.events = POLLIN;
+	poll_event.revents = 0;
+
+	*psyscall_count = 3;
+	if (poll(&poll_event, 1, (int)timeout) <= 0) {
+		return false;
+	}
+
+	if ((poll_event.revents & POLLIN) == 0) {
+		return false;
+	}
+
+	ret = hdhomerun_sock_recvmsg(sock, &msgs[0]);
+	if (ret > 0) {
+		msgs[0].length = (size_t)ret;
+		*pcount = 1;
+		return true;
+	}
+
+	return false;
+}
+
+#if defined(__linux__)
+
+static volatile bool hdhomerun_sock_recvmmsg_unsupported = false;
+
+static int hdhomerun_sock_recvmmsg(struct hdhomerun_sock_t *sock, struct hdhomerun_sock_recv_msg_t msgs[], size_t count)
+{
+	struct mmsghdr mmsgs[HDHOMERUN_SOCK_RECV_MULTIPLE_MAX];
+	struct iovec iovs[HDHOMERUN_SOCK_RECV_MULTIPLE_MAX][2];
+	uint8_t controls[HDHOMERUN_SOCK_RECV_MULTIPLE_MAX][HDHOMERUN_SOCK_RECV_CONTROL_SIZE];
+	memset(mmsgs, 0, sizeof(struct mmsghdr) * count);
+
+	size_t i;
+	for (i = 0; i < count; i++) {
+		mmsgs[i].msg_hdr.msg_iov = iovs[i];
+		mmsgs[i].msg_hdr.msg_iovlen = hdhomerun_sock_recv_msg_iov(&msgs[i], iovs[i]);
+		hdhomerun_sock_recv_msg_control(sock, &mmsgs[i].msg_hdr, controls[i]);
+	}
+
+	int ret = recvmmsg(sock->sock, mmsgs, (unsigned int)count, MSG_DONTWAIT, NULL);
+	if (ret <= 0) {
+		return ret;
+	}
+
+	for (i = 0; i < (size_t)ret; i++) {
+		msgs[i].length = (size_t)mmsgs[i].msg_len;
+		msgs[i].timestamp = hdhomerun_sock_recv_msg_timestamp(&mmsgs[i].msg_hdr);
+	}
+
+	return ret;
+}
+
+bool hdhomerun_sock_recv_multiple(struct hdhomerun_sock_t *sock, struct hdhomerun_sock_recv_msg_t msgs[], size_t *pcount, uint32_t *psyscall_count, uint64_t timeout)
+{
+	size_t count = *pcount;
+	if (count > HDHOMERUN_SOCK_RECV_MULTIPLE_MAX) {
+		count = HDHOMERUN_SOCK_RECV_MULTIPLE_MAX;
+	}
+
+	if ((count <= 1) || hdhomerun_sock_recvmmsg_unsupported) {
+		return hdhomerun_sock_recv_single(sock, msgs, pcount, psyscall_count, timeout);
+	}
+
+	*psyscall_count = 1;
+	int ret = hdhomerun_sock_recvmmsg(sock, msgs, count);
+	if (ret > 0) {
+		*pcount = (size_t)ret;
+		return true;
+	}
+
+	if (ret == 0) {
+		return false;
+	}
+	if (errno == ENOSYS) {
+		hdhomerun_sock_recvmmsg_unsupported = true;
+		return hdhomerun_sock_recv_single(sock, msgs, pcount, psyscall_count, timeout);
+	}
+	if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINPROGRESS)) {
+		return false;
+	}
+
+	struct pollfd poll_event;
+	poll_event.fd = sock->sock;
+	poll_event.events = POLLIN;
+	poll_event.revents = 0;
+
+	*psyscall_count = 3;
+	if (poll(&poll_event, 1, (int)timeout) <= 0) {
+		return false;
+	}
+
+	if ((poll_event.revents & POLLIN) == 0) {
+		return false;
+	}
+
+	ret = hdhomerun_sock_recvmmsg(sock, msgs, count);
+	if (ret > 0) {
+		*pcount = (size_t)ret;
+		return true;
+	}
+
+	return false;
+}
+
+#else
+
+bool hdhomerun_sock_recv_multiple(struct hdhomerun_sock_t *sock, struct hdhomerun_sock_recv_msg_t msgs[], size_t *pcount, uint32_t *psyscall_count, uint64_t timeout)
+{
+	return hdhomerun_sock_recv_single(sock, msgs, pcount, psyscall_count, timeout);
+}
+
+#endif
+
+#if defined(__linux__)
+
+struct hdhomerun_sock_poll_t {
+	int epoll_fd;
+};
+
+struct hdhomerun_sock_poll_t *hdhomerun_sock_poll_create(void)
+{
+	struct hdhomerun_sock_poll_t *ps = (struct hdhomerun_sock_poll_t *)calloc(1, sizeof(struct hdhomerun_sock_poll_t));
+	if (!ps) {
+		return NULL;
+	}
+
+	ps->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (ps->epoll_fd < 0) {
+		free(ps);
+		return NULL;
+	}
+
+	return ps;
+}
+
+void hdhomerun_sock_poll_destroy(struct hdhomerun_sock_poll_t *ps)
+{
+	close(ps->epoll_fd);
+	free(ps);
+}
+
+static bool hdhomerun_sock_poll_add_fd(struct hdhomerun_sock_poll_t *ps, int fd, void *arg)
+{
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = arg;
+
+	return (epoll_ctl(ps->epoll_fd, EPOLL_CTL_ADD, fd, &ev) == 0);
+}
+
+bool hdhomerun_sock_poll_add(struct hdhomerun_sock_poll_t *ps, struct hdhomerun_sock_t *sock, void *arg)
+{
+	return hdhomerun_sock_poll_add_fd(ps, sock->sock, arg);
+}
+
+bool hdhomerun_sock_poll_add_notify(struct hdhomerun_sock_poll_t *ps, thread_notify_handle_t handle, void *arg)
+{
+	return hdhomerun_sock_poll_add_fd(ps, handle, arg);
+}
+
+void hdhomerun_sock_poll_remove(struct hdhomerun_sock_poll_t *ps, struct hdhomerun_sock_t *sock)
+{
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	epoll_ctl(ps->epoll_fd, EPOLL_CTL_DEL, sock->sock, &ev);
+}
+
+int hdhomerun_sock_poll_wait(struct hdhomerun_sock_poll_t *ps, void *args[], int max_count, int64_t timeout)
+{
+	struct epoll_event events[64];
+	if (max_count > 64) {
+		max_count = 64;
+	}
+
+	int ret = epoll_wait(ps->epoll_fd, events, max_count, (timeout < 0) ? -1 : (int)timeout);
+	if (ret < 0) {
+		return (errno == EINTR) ? 0 : -1;
+	}
+
+	int i;
+	for (i = 0; i < ret; i++) {
+		args[i] = events[i].data.ptr;
+	}
+
+	return ret;
+}
+
+#else
+
+struct hdhomerun_sock_poll_t *hdhomerun_sock_poll_create(void)
+{
+	return NULL;
+}
+
+void hdhomerun_sock_poll_destroy(struct hdhomerun_sock_poll_t *ps)
+{
+}
+
+bool hdhomerun_sock_poll_add(struct hdhomerun_sock_poll_t *ps, struct hdhomerun_sock_t *sock, void *arg)
+{
+	return false;
+}
+
+bool hdhomerun_sock_poll_add_notify(struct hdhomerun_sock_poll_t *ps, thread_notify_handle_t handle, void *arg)
+{
+	return false;
+}
+
+void hdhomerun_sock_poll_remove(struct hdhomerun_sock_poll_t *ps, struct hdhomerun_sock_t *sock)
+{
+}
+
+int hdhomerun_sock_poll_wait(struct hdhomerun_sock_poll_t *ps, void *args[], int max_count, int64_t timeout)
+{
+	return -1;
+}
+
+#endif
+
+#if defined(HDHOMERUN_SOCK_URING)
+
+#define SOCK_URING_SOURCE_SOCK 1
+#define SOCK_URING_SOURCE_NOTIFY 2
+#define SOCK_URING_PROBE_GROUP 0xFFFF
+#define SOCK_URING_GROUP_COUNT SOCK_URING_PROBE_GROUP
+#define SOCK_URING_CQ_ENTRIES 4096
+
+struct hdhomerun_sock_uring_source_t {
+	int type;
+	int fd;
+	void *arg;
+	struct hdhomerun_sock_uring_source_t *next;
+
+	/* Sockets only. */
+	uint16_t group;
+	uint32_t buffer_count;
+	size_t buffer_size;
+	uint8_t *buffers;
+	struct io_uring_buf_ring *buf_ring;
+	size_t buf_ring_size;
+	uint16_t buf_ring_tail;
+	bool armed;
+	bool removed;
+	bool failed;
+};
+
+struct hdhomerun_sock_uring_t {
+	struct uring_t uring;
+
+	/* Serializes submissions and the source list; sources may be added and removed from other threads. */
+	thread_mutex_t lock;
+	struct hdhomerun_sock_uring_source_t *sources;
+	uint32_t group_used[(SOCK_URING_GROUP_COUNT + 31) / 32];
+	uint32_t next_group;
+	bool recv_multishot;
+};
+
+static void hdhomerun_sock_uring_arm(struct hdhomerun_sock_uring_t *ring, struct hdhomerun_sock_uring_source_t *source)
+{
+	struct io_uring_sqe *sqe = uring_get_sqe(&ring->uring);
+	if (!sqe) {
+		return;
+	}
+
+	if (source->type == SOCK_URING_SOURCE_NOTIFY) {
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->fd = source->fd;
+		sqe->poll32_events = POLLIN;
+		sqe->len = IORING_POLL_ADD_MULTI;
+	} else {
+		sqe->opcode = IORING_OP_RECV;
+		sqe->fd = source->fd;
+		sqe->flags = IOSQE_BUFFER_SELECT;
+		sqe->buf_group = source->group;
+		sqe->ioprio = ring->recv_multishot ? IORING_RECV_MULTISHOT : 0;
+	}
+
+	sqe->user_data = (uint64_t)(uintptr_t)source;
+	source->armed = true;
+}
+
+static void hdhomerun_sock_uring_provide(struct hdhomerun_sock_uring_source_t *source, uint16_t buffer_id)
+{
+	struct io_uring_buf *buf = &source->buf_ring->bufs[source->buf_ring_tail & (source->buffer_count - 1)];
+	buf->addr = (uint64_t)(uintptr_t)(source->buffers + (size_t)buffer_id * source->buffer_size);
+	buf->len = (uint32_t)source->buffer_size;
+	buf->bid = buffer_id;
+	source->buf_ring_tail++;
+}
+
+static void hdhomerun_sock_uring_provide_commit(struct hdhomerun_sock_uring_source_t *source)
+{
+	__atomic_store_n(&source->buf_ring->tail, source->buf_ring_tail, __ATOMIC_RELEASE);
+}
+
+static void *hdhomerun_sock_uring_alloc_buf_ring(size_t size)
+{
+	void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	return (ptr == MAP_FAILED) ? NULL : ptr;
+}
+
+static bool hdhomerun_sock_uring_register_group(struct hdhomerun_sock_uring_t *ring, void *buf_ring, uint32_t entries, uint16_t group)
+{
+	struct io_uring_buf_reg reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uint64_t)(uintptr_t)buf_ring;
+	reg.ring_entries = entries;
+	reg.bgid = group;
+
+	return (uring_register(&ring->uring, IORING_REGISTER_PBUF_RING, &reg, 1) == 0);
+}
+
+static void hdhomerun_sock_uring_unregister_group(struct hdhomerun_sock_uring_t *ring, uint16_t group)
+{
+	struct io_uring_buf_reg reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.bgid = group;
+
+	uring_register(&ring->uring, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+}
+
+/*
+ * Buffer group ids are allocated round robin, so an id released by hdhomerun_sock_uring_free_source is not
+ * handed out again straight away. Called with the ring lock held.
+ */
+static bool hdhomerun_sock_uring_alloc_group(struct hdhomerun_sock_uring_t *ring, uint16_t *pgroup)
+{
+	uint32_t i;
+	for (i = 0; i < SOCK_URING_GROUP_COUNT; i++) {
+		uint32_t group = (ring->next_group + i) % SOCK_URING_GROUP_COUNT;
+		uint32_t mask = (uint32_t)1 << (group & 31);
+		if (ring->group_used[group / 32] & mask) {
+			continue;
+		}
+
+		ring->group_used[group / 32] |= mask;
+		ring->next_group = group + 1;
+		*pgroup = (uint16_t)group;
+		return true;
+	}
+
+	return false;
+}
+
+static void hdhomerun_sock_uring_release_group(struct hdhomerun_sock_uring_t *ring, uint16_t group)
+{
+	ring->group_used[group / 32] &= ~((uint32_t)1 << (group & 31));
+}
+
+static void hdhomerun_sock_uring_free_source(struct hdhomerun_sock_uring_t *ring, struct hdhomerun_sock_uring_source_t *source)
+{
+	if (source->buf_ring) {
+		hdhomerun_sock_uring_unregister_group(ring, source->group);
+		hdhomerun_sock_uring_release_group(ring, source->group);
+		munmap(source->buf_ring, source->buf_ring_size);
+	}
+	if (source->buffers) {
+		free(source->buffers);
+	}
+	free(source);
+}
+
+static bool hdhomerun_sock_uring_probe(struct hdhomerun_sock_uring_t *ring)
+{
+	/* Provided buffer rings need 5.19; also implies IORING_OP_RECV and multishot poll. */
+	size_t size = memory_get_page_size();
+	void *buf_ring = hdhomerun_sock_uring_alloc_buf_ring(size);
+	if (!buf_ring) {
+		return false;
+	}
+
+	bool success = hdhomerun_sock_uring_register_group(ring, buf_ring, 1, SOCK_URING_PROBE_GROUP);
+	if (success) {
+		hdhomerun_sock_uring_unregister_group(ring, SOCK_URING_PROBE_GROUP);
+	}
+
+	munmap(buf_ring, size);
+	return success;
+}
+
+struct hdhomerun_sock_uring_t *hdhomerun_sock_uring_create(uint32_t entries)
+{
+	struct hdhomerun_sock_uring_t *ring = (struct hdhomerun_sock_uring_t *)calloc(1, sizeof(struct hdhomerun_sock_uring_t));
+	if (!ring) {
+		return NULL;
+	}
+
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	params.flags = IORING_SETUP_CQSIZE;
+	params.cq_entries = SOCK_URING_CQ_ENTRIES;
+
+	if (!uring_init(&ring->uring, entries, &params)) {
+		free(ring);
+		return NULL;
+	}
+
+	if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP)) {
+		goto error;
+	}
+
+	if (!hdhomerun_sock_uring_probe(ring)) {
+		goto error;
+	}
+
+	thread_mutex_init(&ring->lock);
+	ring->recv_multishot = true;
+	return ring;
+
+error:
+	uring_dispose(&ring->uring);
+	free(ring);
+	return NULL;
+}
+
+void hdhomerun_sock_uring_destroy(struct hdhomerun_sock_uring_t *ring)
+{
+	/* Closing the ring cancels outstanding requests before the buffers are released. */
+	uring_dispose(&ring->uring);
+
+	while (ring->sources) {
+		struct hdhomerun_sock_uring_source_t *source = ring->sources;
+		ring->sources = source->next;
+
+		if (source->buf_ring) {
+			munmap(source->buf_ring, source->buf_ring_size);
+		}
+		if (source->buffers) {
+			free(source->buffers);
+		}
+		free(source);
+	}
+
+	thread_mutex_dispose(&ring->lock);
+	free(ring);
+}
+
+bool hdhomerun_sock_uring_add(struct hdhomerun_sock_uring_t *ring, struct hdhomerun_sock_t *sock, void *arg, uint32_t buffer_count, size_t buffer_size)
+{
+	/* Buffer rings are a power of two in size. */
+	uint32_t count = 1;
+	while ((count < buffer_count) && (count < 32768)) {
+		count <<= 1;
+	}
+
+	struct hdhomerun_sock_uring_source_t *source = (struct hdhomerun_sock_uring_source_t *)calloc(1, sizeof(struct hdhomerun_sock_uring_source_t));
+	if (!source) {
+		return false;
+	}
+
+	source->type = SOCK_URING_SOURCE_SOCK;
+	source->fd = sock->sock;
+	source->arg = arg;
+	source->buffer_count = count;
+	source->buffer_size = buffer_size;
+
+	source->buffers = (uint8_t *)malloc((size_t)count * buffer_size);
+	if (!source->buffers) {
+		free(source);
+		return false;
+	}
+
+	size_t page_size = memory_get_page_size();
+	source->buf_ring_size = (((size_t)count * sizeof(struct io_uring_buf)) + page_size - 1) & ~(page_size - 1);
+	source->buf_ring = (struct io_uring_buf_ring *)hdhomerun_sock_uring_alloc_buf_ring(source->buf_ring_size);
+	if (!source->buf_ring) {
+		free(source->buffers);
+		free(source);
+		return false;
+	}
+
+	thread_mutex_lock(&ring->lock);
+
+	/* The group id of a removed socket is released once the kernel has finished with its buffers. */
+	if (!hdhomerun_sock_uring_alloc_group(ring, &source->group)) {
+		thread_mutex_unlock(&ring->lock);
+		munmap(source->buf_ring, source->buf_ring_size);
+		free(source->buffers);
+		free(source);
+		return false;
+	}
+	if (!hdhomerun_sock_uring_register_group(ring, source->buf_ring, count, source->group)) {
+		hdhomerun_sock_uring_release_group(ring, source->group);
+		thread_mutex_unlock(&ring->lock);
+		munmap(source->buf_ring, source->buf_ring_size);
+		free(source->buffers);
+		free(source);
+		return false;
+	}
+
+	uint32_t i;
+	for (i = 0; i < count; i++) {
+		hdhomerun_sock_uring_provide(source, (uint16_t)i);
+	}
+	hdhomerun_sock_uring_provide_commit(source);
+
+	source->next = ring->sources;
+	ring->sources = source;
+
+	hdhomerun_sock_uring_arm(ring, source);
+	bool success = uring_submit(&ring->uring);
+
+	thread_mutex_unlock(&ring->lock);
+	return success;
+}
+
+bool hdhomerun_sock_uring_add_notify(struct hdhomerun_sock_uring_t *ring, thread_notify_handle_t handle, void *arg)
+{
+	struct hdhomerun_sock_uring_source_t *source = (struct hdhomerun_sock_uring_source_t *)calloc(1, sizeof(struct hdhomerun_sock_uring_source_t));
+	if (!source) {
+		return false;
+	}
+
+	source->type = SOCK_URING_SOURCE_NOTIFY;
+	source->fd = handle;
+	source->arg = arg;
+
+	thread_mutex_lock(&ring->lock);
+
+	source->next = ring->sources;
+	ring->sources = source;
+
+	hdhomerun_sock_uring_arm(ring, source);
+	bool success = uring_submit(&ring->uring);
+
+	thread_mutex_unlock(&ring->lock);
+	return success;
+}
+
+void hdhomerun_sock_uring_remove(struct hdhomerun_sock_uring_t *ring, struct hdhomerun_sock_t *sock)
+{
+	thread_mutex_lock(&ring->lock);
+
+	struct hdhomerun_sock_uring_source_t *source = ring->sources;
+	while (source) {
+		if ((source->type == SOCK_URING_SOURCE_SOCK) && (source->fd == sock->sock) && !source->removed) {
+			break;
+		}
+		source = source->next;
+	}
+
+	if (!source) {
+		thread_mutex_unlock(&ring->lock);
+		return;
+	}
+
+	source->removed = true;
+
+	/* Released by hdhomerun_sock_uring_wait once the kernel has finished with the buffers. */
+	if (source->armed) {
+		struct io_uring_sqe *sqe = uring_get_sqe(&ring->uring);
+		if (sqe) {
+			sqe->opcode = IORING_OP_ASYNC_CANCEL;
+			sqe->addr = (uint64_t)(uintptr_t)source;
+			sqe->user_data = 0;
+			uring_submit(&ring->uring);
+		}
+	}
+
+	thread_mutex_unlock(&ring->lock);
+}
+
+static void hdhomerun_sock_uring_rearm(struct hdhomerun_sock_uring_t *ring)
+{
+	thread_mutex_lock(&ring->lock);
+
+	struct hdhomerun_sock_uring_source_t **pprev = &ring->sources;
+	while (*pprev) {
+		struct hdhomerun_sock_uring_source_t *source = *pprev;
+
+		if (source->removed && !source->armed) {
+			*pprev = source->next;
+			hdhomerun_sock_uring_free_source(ring, source);
+			continue;
+		}
+
+		if (!source->armed && !source->removed && !source->failed) {
+			hdhomerun_sock_uring_arm(ring, source);
+		}
+
+		pprev = &source->next;
+	}
+
+	uring_submit(&ring->uring);
+	thread_mutex_unlock(&ring->lock);
+}
+
+static bool hdhomerun_sock_uring_complete(struct hdhomerun_sock_uring_t *ring, struct io_uring_cqe *cqe, struct hdhomerun_sock_uring_entry_t *entry)
+{
+	struct hdhomerun_sock_uring_source_t *source = (struct hdhomerun_sock_uring_source_t *)(uintptr_t)cqe->user_data;
+	if (!source) {
+		return false;
+	}
+
+	/* Without IORING_CQE_F_MORE the request has finished and is re-armed by the next wait. */
+	if (!(cqe->flags & IORING_CQE_F_MORE)) {
+		source->armed = false;
+	}
+
+	if (source->type == SOCK_URING_SOURCE_NOTIFY) {
+		entry->arg = source->arg;
+		entry->source = NULL;
+		entry->data = NULL;
+		entry->length = 0;
+		return true;
+	}
+
+	if (cqe->res < 0) {
+		if (cqe->res == -EINVAL && ring->recv_multishot) {
+			/* Kernel without multishot recv (5.19) - re-arm after each datagram instead. */
+			ring->recv_multishot = false;
+		} else if ((cqe->res != -ENOBUFS) && (cqe->res != -ECANCELED) && (cqe->res != -EINTR) && (cqe->res != -EAGAIN)) {
+			source->failed = true;
+		}
+		return false;
+	}
+
+	if (!(cqe->flags & IORING_CQE_F_BUFFER)) {
+		return false;
+	}
+
+	uint16_t buffer_id = (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+	if (source->removed) {
+		return false;
+	}
+
+	entry->arg = source->arg;
+	entry->source = source;
+	entry->buffer_id = buffer_id;
+	entry->data = source->buffers + (size_t)buffer_id * source->buffer_size;
+	entry->length = (size_t)cqe->res;
+	return true;
+}
+
+int hdhomerun_sock_uring_wait(struct hdhomerun_sock_uring_t *ring, struct hdhomerun_sock_uring_entry_t entries[], int max_count, int64_t timeout)
+{
+	hdhomerun_sock_uring_rearm(ring);
+
+	if (!uring_peek_cqe(&ring->uring)) {
+		struct __kernel_timespec ts;
+		struct io_uring_getevents_arg arg;
+		memset(&arg, 0, sizeof(arg));
+		if (timeout >= 0) {
+			ts.tv_sec = timeout / 1000;
+			ts.tv_nsec = (timeout % 1000) * 1000000;
+			arg.ts = (uint64_t)(uintptr_t)&ts;
+		}
+
+		if (uring_enter(&ring->uring, 0, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg)) < 0) {
+			if ((errno != ETIME) && (errno != EINTR)) {
+				return -1;
+			}
+		}
+	}
+
+	int count = 0;
+	while (count < max_count) {
+		struct io_uring_cqe *cqe = uring_peek_cqe(&ring->uring);
+		if (!cqe) {
+			break;
+		}
+
+		if (hdhomerun_sock_uring_complete(ring, cqe, &entries[count])) {
+			count++;
+		}
+		uring_cqe_seen(&ring->uring);
+	}
+
+	return count;
+}
+
+void hdhomerun_sock_uring_recycle(struct hdhomerun_sock_uring_t *ring, struct hdhomerun_sock_uring_entry_t entries[], int count)
+{
+	int i;
+	for (i = 0; i < count; i++) {
+		struct hdhomerun_sock_uring_source_t *source = (struct hdhomerun_sock_uring_source_t *)entries[i].source;
+		if (!source) {
+			continue;
+		}
+
+		hdhomerun_sock_uring_provide(source, entries[i].buffer_id);
+
+		if ((i + 1 == count) || (entries[i + 1].source != source)) {
+			hdhomerun_sock_uring_provide_commit(source);
+		}
+	}
+}
+
+#else
+
+struct hdhomerun_sock_uring_t *hdhomerun_sock_uring_create(uint32_t entries)
+{
+	return NULL;
+}
+
+void hdhomerun_sock_uring_destroy(struct hdhomerun_sock_uring_t *ring)
+{
+}
+
+bool hdhomerun_sock_uring_add(struct hdhomerun_sock_uring_t *ring, struct hdhomerun_sock_t *sock, void *arg, uint32_t buffer_count, size_t buffer_size)
+{
+	return false;
+}
+
+bool hdhomerun_sock_uring_add_notify(struct hdhomerun_sock_uring_t *ring, thread_notify_handle_t handle, void *arg)
+{
+	return false;
+}
+
+void hdhomerun_sock_uring_remove(struct hdhomerun_sock_uring_t *ring, struct hdhomerun_sock_t *sock)
+{
+}
+
+int hdhomerun_sock_uring_wait(struct hdhomerun_sock_uring_t *ring, struct hdhomerun_sock_uring_entry_t entries[], int max_count, int64_t timeout)
+{
+	return -1;
+}
+
+void hdhomerun_sock_uring_recycle(struct hdhomerun_sock_uring_t *ring, struct hdhomerun_sock_uring_entry_t entries[], int count)
+{
+}
+
+#endif
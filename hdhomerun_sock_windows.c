@@ -230,6 +230,16 @@ void hdhomerun_sock_set_ipv6_multicast_ifindex(struct hdhomerun_sock_t *sock, ui
 	setsockopt(sock->sock, IPPROTO_IPV6, IPV6_MULTICAST_IF, (char *)&ifindex, sizeof(ifindex));
 }
 
+bool hdhomerun_sock_set_recv_timestamps(struct hdhomerun_sock_t *sock, bool enable)
+{
+	return !enable;
+}
+
+bool hdhomerun_sock_set_busy_poll(struct hdhomerun_sock_t *sock, uint32_t usec)
+{
+	return (usec == 0);
+}
+
 int hdhomerun_sock_getlasterror(void)
 {
 	return WSAGetLastError();
@@ -376,7 +386,12 @@ static bool hdhomerun_sock_event_select(struct hdhomerun_sock_t *sock, long even
 	return true;
 }
 
-bool hdhomerun_sock_connect_ex(struct hdhomerun_sock_t *sock, const struct sockaddr *remote_addr, uint64_t timeout)
+hdhomerun_sock_fd_t hdhomerun_sock_get_fd(struct hdhomerun_sock_t *sock)
+{
+	return sock->sock;
+}
+
+bool hdhomerun_sock_connect_start(struct hdhomerun_sock_t *sock, const struct sockaddr *remote_addr)
 {
 	socklen_t remote_addr_size;
 	switch (remote_addr->sa_family) {
@@ -390,7 +405,8 @@ bool hdhomerun_sock_connect_ex(struct hdhomerun_sock_t *sock, const struct socka
 		return false;
 	}
 
-	if (!hdhomerun_sock_event_select(sock, FD_WRITE | FD_CLOSE)) {
+	/* WSAEventSelect also puts the socket in non-blocking mode. FD_CONNECT signals a failed connect. */
+	if (!hdhomerun_sock_event_select(sock, FD_CONNECT | FD_WRITE | FD_CLOSE)) {
 		return false;
 	}
 
@@ -400,6 +416,55 @@ bool hdhomerun_sock_connect_ex(struct hdhomerun_sock_t *sock, const struct socka
 		}
 	}
 
+	return true;
+}
+
+bool hdhomerun_sock_connect_finish(struct hdhomerun_sock_t *sock)
+{
+	int error = 0;
+	int error_size = sizeof(error);
+	if (getsockopt(sock->sock, SOL_SOCKET, SO_ERROR, (char *)&error, &error_size) != 0) {
+		return false;
+	}
+
+	if (error != 0) {
+		WSASetLastError(error);
+		return false;
+	}
+
+	return true;
+}
+
+int hdhomerun_sock_connect_wait(struct hdhomerun_sock_t *socks[], int count, uint64_t timeout)
+{
+	HANDLE events[HDHOMERUN_SOCK_CONNECT_WAIT_MAX];
+	if (count > HDHOMERUN_SOCK_CONNECT_WAIT_MAX) {
+		count = HDHOMERUN_SOCK_CONNECT_WAIT_MAX;
+	}
+
+	int i;
+	for (i = 0; i < count; i++) {
+		events[i] = socks[i]->event;
+	}
+
+	DWORD wait_ret = WaitForMultipleObjectsEx((DWORD)count, events, false, (DWORD)timeout, false);
+	if ((wait_ret < WAIT_OBJECT_0) || (wait_ret >= WAIT_OBJECT_0 + (DWORD)count)) {
+		return -1;
+	}
+
+	i = (int)(wait_ret - WAIT_OBJECT_0);
+
+	WSANETWORKEVENTS network_events;
+	WSAEnumNetworkEvents(socks[i]->sock, socks[i]->event, &network_events);
+	return i;
+}
+
+bool hdhomerun_sock_connect_ex(struct hdhomerun_sock_t *sock, const struct sockaddr *remote_addr, uint64_t timeout)
+{
+	if (!hdhomerun_sock_connect_start(sock, remote_addr)) {
+		return false;
+	}
+
 	DWORD wait_ret = WaitForSingleObjectEx(sock->event, (DWORD)timeout, false);
 	if (wait_ret != WAIT_OBJECT_0) {
 		return false;
@@ -496,6 +561,39 @@ bool hdhomerun_sock_sendto_ex(struct hdhomerun_sock_t *sock, const struct sockad
 	return false;
 }
 
+int hdhomerun_sock_send_nonblocking(struct hdhomerun_sock_t *sock, const void *data, size_t *length)
+{
+	int ret = send(sock->sock, (const char *)data, (int)(*length), 0);
+	if (ret >= 0) {
+		*length = ret;
+		return 1;
+	}
+
+	if (WSAGetLastError() == WSAEWOULDBLOCK) {
+		return 0;
+	}
+
+	return -1;
+}
+
+int hdhomerun_sock_recv_nonblocking(struct hdhomerun_sock_t *sock, void *data, size_t *length)
+{
+	int ret = recv(sock->sock, (char *)data, (int)(*length), 0);
+	if (ret > 0) {
+		*length = ret;
+		return 1;
+	}
+
+	if (ret == 0) {
+		return -1;
+	}
+	if (WSAGetLastError() == WSAEWOULDBLOCK) {
+		return 0;
+	}
+
+	return -1;
+}
+
 bool hdhomerun_sock_recv(struct hdhomerun_sock_t *sock, void *data, size_t *length, uint64_t timeout)
 {
 	if (!hdhomerun_sock_event_select(sock, FD_READ | FD_CLOSE)) {
@@ -560,3 +658,124 @@ bool hdhomerun_sock_recvfrom_ex(struct hdhomerun_sock_t *sock, struct sockaddr_s
 
 	return false;
 }
+
+static int hdhomerun_sock_recv_msg(struct hdhomerun_sock_t *sock, struct hdhomerun_sock_recv_msg_t *msg)
+{
+	WSABUF buffers[2];
+	DWORD buffer_count = 0;
+
+	if (msg->header) {
+		buffers[buffer_count].buf = (char *)msg->header;
+		buffers[buffer_count].len = (ULONG)msg->header_length;
+		buffer_count++;
+	}
+
+	buffers[buffer_count].buf = (char *)msg->data;
+	buffers[buffer_count].len = (ULONG)msg->length;
+	buffer_count++;
+
+	DWORD received = 0;
+	DWORD flags = 0;
+	if (WSARecv(sock->sock, buffers, buffer_count, &received, &flags, NULL, NULL) == SOCKET_ERROR) {
+		return SOCKET_ERROR;
+	}
+
+	msg->timestamp = 0;
+	return (int)received;
+}
+
+bool hdhomerun_sock_recv_multiple(struct hdhomerun_sock_t *sock, struct hdhomerun_sock_recv_msg_t msgs[], size_t *pcount, uint32_t *psyscall_count, uint64_t timeout)
+{
+	if (!hdhomerun_sock_event_select(sock, FD_READ | FD_CLOSE)) {
+		return false;
+	}
+
+	*psyscall_count = 1;
+	int ret = hdhomerun_sock_recv_msg(sock, &msgs[0]);
+	if (ret > 0) {
+		msgs[0].length = ret;
+		*pcount = 1;
+		return true;
+	}
+
+	if (ret == 0) {
+		return false;
+	}
+	if (WSAGetLastError() != WSAEWOULDBLOCK) {
+		return false;
+	}
+
+	*psyscall_count = 3;
+	if (WaitForSingleObjectEx(sock->event, (DWORD)timeout, false) != WAIT_OBJECT_0) {
+		return false;
+	}
+
+	ret = hdhomerun_sock_recv_msg(sock, &msgs[0]);
+	if (ret > 0) {
+		msgs[0].length = ret;
+		*pcount = 1;
+		return true;
+	}
+
+	return false;
+}
+
+struct hdhomerun_sock_poll_t *hdhomerun_sock_poll_create(void)
+{
+	return NULL;
+}
+
+void hdhomerun_sock_poll_destroy(struct hdhomerun_sock_poll_t *ps)
+{
+}
+
+bool hdhomerun_sock_poll_add(struct hdhomerun_sock_poll_t *ps, struct hdhomerun_sock_t *sock, void *arg)
+{
+	return false;
+}
+
+bool hdhomerun_sock_poll_add_notify(struct hdhomerun_sock_poll_t *ps, thread_notify_handle_t handle, void *arg)
+{
+	return false;
+}
+
+void hdhomerun_sock_poll_remove(struct hdhomerun_sock_poll_t *ps, struct hdhomerun_sock_t *sock)
+{
+}
+
+int hdhomerun_sock_poll_wait(struct hdhomerun_sock_poll_t *ps, void *args[], int max_count, int64_t timeout)
+{
+	return -1;
+}
+
+struct hdhomerun_sock_uring_t *hdhomerun_sock_uring_create(uint32_t entries)
+{
+	return NULL;
+}
+
+void hdhomerun_sock_uring_destroy(struct hdhomerun_sock_uring_t *ring)
+{
+}
+
+bool hdhomerun_sock_uring_add(struct hdhomerun_sock_uring_t *ring, struct hdhomerun_sock_t *sock, void *arg, uint32_t buffer_count, size_t buffer_size)
+{
+	return false;
+}
+
+bool hdhomerun_sock_uring_add_notify(struct hdhomerun_sock_uring_t *ring, thread_notify_handle_t handle, void *arg)
+{
+	return false;
+}
+
+void hdhomerun_sock_uring_remove(struct hdhomerun_sock_uring_t *ring, struct hdhomerun_sock_t *sock)
+{
+}
+
+int hdhomerun_sock_uring_wait(struct hdhomerun_sock_uring_t *ring, struct hdhomerun_sock_uring_entry_t entries[], int max_count, int64_t timeout)
+{
+	return -1;
+}
+
+void hdhomerun_sock_uring_recycle(struct hdhomerun_sock_uring_t *ring, struct hdhomerun_sock_uring_entry_t entries[], int count)
+{
+}
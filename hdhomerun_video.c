@@ -20,6 +20,109 @@
 
 #include "hdhomerun.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VIDEO_TS_AVX2 1
+#include <immintrin.h>
+#endif
+
+#define VIDEO_RECV_BATCH_COUNT 16
+#define VIDEO_RTP_HEADER_SIZE (VIDEO_RTP_DATA_PACKET_SIZE - VIDEO_DATA_PACKET_SIZE)
+
+#define VIDEO_KEEPALIVE_INTERVAL 1000
+
+#define VIDEO_REORDER_DEFAULT_PACKETS 32
+
+#define VIDEO_PID_BITRATE_WINDOW 1000
+
+#define VIDEO_URING_BUFFER_COUNT 256
+#define VIDEO_URING_ENTRY_COUNT 64
+
+#define VIDEO_ENGINE_WORKER_MAX 64
+#define VIDEO_ENGINE_RECV_BATCH_LIMIT 4
+#define VIDEO_ENGINE_WHEEL_SLOTS 32
+#define VIDEO_ENGINE_WHEEL_TICK 64
+
+/*
+ * Counters written by the receive thread, as read together under stats_seq.
+ */
+struct hdhomerun_video_counters_t {
+	uint32_t packet_count;
+	uint32_t transport_error_count;
+	uint32_t network_error_count;
+	uint32_t sequence_error_count;
+	uint32_t overflow_error_count;
+	uint32_t recv_syscall_count;
+	uint32_t reordered_count;
+	uint32_t late_drop_count;
+	uint32_t duplicate_count;
+	uint32_t jitter_histogram[HDHOMERUN_VIDEO_JITTER_BUCKETS];
+	uint64_t stripped_bytes;
+};
+
+struct hdhomerun_video_reorder_slot_t {
+	uint64_t arrival_time;
+	uint64_t timestamp;
+	uint16_t rtp_sequence;
+	bool valid;
+};
+
+struct hdhomerun_video_pid_entry_t {
+	uint64_t packet_count;
+	uint64_t transport_error_count;
+	uint64_t sequence_error_count;
+	uint64_t scrambled_count;
+	uint64_t window_packet_count;
+	uint64_t last_seen_time;
+	uint32_t bitrate;
+	uint16_t pid;
+};
+
+/*
+ * Per-PID stats, written only by the receive thread. Readers copy the active entries under the seqlock
+ * (seq is odd while a receive batch is updating the table).
+ */
+struct hdhomerun_video_pid_table_t {
+	volatile size_t seq;
+	volatile size_t active_count;
+	uint64_t window_start;
+	uint64_t batch_time;
+	uint16_t index[0x2000]; /* entry index + 1, 0 = not seen */
+	struct hdhomerun_video_pid_entry_t entries[0x2000];
+};
+
+struct hdhomerun_video_subscription_t {
+	struct hdhomerun_video_subscription_t *next;
+	uint8_t pid_bitmap[HDHOMERUN_VIDEO_PID_BITMAP_SIZE];
+
+	hdhomerun_video_subscribe_callback_t callback;
+	void *callback_arg;
+
+	/* Single-producer/single-consumer ring of TS packets (ring mode). */
+	volatile size_t head;
+	volatile size_t tail;
+	uint8_t *buffer;
+	size_t buffer_size;
+	size_t advance;
+
+	volatile uint64_t packet_count;
+	volatile uint64_t overflow_error_count;
+};
+
+/*
+ * Additional consumer of the main ring. tail and advance are owned by the reader; detached is set by the
+ * receive thread under reader_lock and cleared by hdhomerun_video_reader_flush under reader_lock.
+ */
+struct hdhomerun_video_reader_t {
+	struct hdhomerun_video_reader_t *next;
+	struct hdhomerun_video_sock_t *vs;
+	uint32_t flags;
+
+	volatile size_t tail;
+	size_t advance;
+
+	volatile bool detached;
+};
+
 struct hdhomerun_video_sock_t {
 	thread_mutex_t lock;
 	struct hdhomerun_debug_t *dbg;
@@ -29,26 +132,222 @@ struct hdhomerun_video_sock_t {
 	struct sockaddr_storage keepalive_addr;
 	volatile bool keepalive_start;
 
+	/*
+	 * Single-producer/single-consumer ring.
+	 * head is written only by the receive thread (release) and tail only by the consumer (release).
+	 */
 	volatile size_t head;
 	volatile size_t tail;
 	uint8_t *buffer;
 	size_t buffer_size;
+	size_t slot_size; /* VIDEO_DATA_PACKET_SIZE, or TS_PACKET_SIZE with HDHOMERUN_VIDEO_OPTION_STRIP */
 	size_t advance;
+	bool buffer_mirrored;
+	size_t buffer_map_size; /* non-zero if the standard buffer was allocated with memory_map_alloc */
+
+	/*
+	 * Consumer wakeup. The consumer publishes wait_size (bytes) or notify_armed, issues a full
+	 * fence and re-checks head; the receive thread publishes head, issues a full fence and checks
+	 * them, so a wakeup cannot be lost.
+	 */
+	thread_cond_t wait_cond;
+	volatile size_t wait_size;
+	thread_notify_t notify;
+	bool notify_valid;
+	bool notify_enabled;
+	volatile bool notify_armed;
+
+	/*
+	 * Overflow handling. For HDHOMERUN_VIDEO_OVERFLOW_DROP_OLDEST an overflow sets skip_pending; when the batch
+	 * is committed the receive thread publishes the new head as skip_position then skip_request (release). The
+	 * consumer moves tail forward to skip_position on its next recv and acks. skip_count (consumer) is the number
+	 * of datagrams discarded that way.
+	 */
+	uint32_t overflow_policy;
+	bool overflow_resync;
+	bool skip_pending;
+	volatile size_t skip_position;
+	volatile size_t skip_request;
+	volatile size_t skip_ack;
+	uint32_t skip_count;
+
+	/* Occupancy. slot_time is the arrival time of each ring slot, written before head is published. */
+	uint64_t *slot_time;
+
+	/*
+	 * Receive timestamps (ns since the epoch) of each ring slot, NULL unless
+	 * HDHOMERUN_VIDEO_OPTION_RECV_TIMESTAMPS. Kernel timestamps when available, otherwise the batch time.
+	 */
+	uint64_t *slot_timestamp;
+	uint64_t jitter_last_timestamp;
+	volatile size_t peak_used_size;
+	volatile uint32_t peak_reset_request;
+	uint32_t peak_reset_ack;
+
+	size_t high_watermark;
+	hdhomerun_video_watermark_callback_t watermark_callback;
+	void *watermark_callback_arg;
+	bool watermark_active;
+
+	uint8_t recv_header[VIDEO_RECV_BATCH_COUNT][VIDEO_RTP_HEADER_SIZE];
+	uint8_t *recv_discard;
+
+	/*
+	 * TS packet stripping (HDHOMERUN_VIDEO_OPTION_STRIP). The consumer writes strip_pending under lock and
+	 * increments strip_request; the receive thread copies it to strip_pid_bitmap under lock and acks.
+	 */
+	bool strip;
+	bool strip_pid_filter;
+	uint8_t strip_pid_bitmap[HDHOMERUN_VIDEO_PID_BITMAP_SIZE];
+	bool strip_pending_filter;
+	uint8_t strip_pending[HDHOMERUN_VIDEO_PID_BITMAP_SIZE];
+	volatile uint32_t strip_request;
+	uint32_t strip_ack;
+	volatile uint64_t stripped_bytes;
+
+	/* io_uring receive ring of a dedicated thread (HDHOMERUN_VIDEO_OPTION_IO_URING). */
+	struct hdhomerun_sock_uring_t *uring;
 
 	thread_task_t thread;
 	volatile bool terminate;
 
+	/*
+	 * Engine mode - protected by the worker lock. The socket is on the timer wheel once, due at the earliest
+	 * of its keepalive and reorder timeouts (engine_wheel_due).
+	 */
+	struct hdhomerun_video_engine_worker_t *engine_worker;
+	bool engine_detaching;
+	struct hdhomerun_video_sock_t *engine_wheel_next;
+	bool engine_wheel_scheduled;
+	uint64_t engine_wheel_due;
+	bool engine_keepalive;
+	uint64_t engine_keepalive_time;
+
+	/* Written only by the receive thread. */
 	volatile uint32_t packet_count;
 	volatile uint32_t transport_error_count;
 	volatile uint32_t network_error_count;
 	volatile uint32_t sequence_error_count;
 	volatile uint32_t overflow_error_count;
+	volatile uint32_t recv_syscall_count;
+	volatile uint32_t reordered_count;
+	volatile uint32_t late_drop_count;
+	volatile uint32_t duplicate_count;
+	volatile uint32_t jitter_histogram[HDHOMERUN_VIDEO_JITTER_BUCKETS];
+
+	/*
+	 * The receive thread updates the counters above with stats_seq odd, so a reader can take a consistent
+	 * snapshot. stats_baseline holds the counters at the last flush (protected by lock).
+	 */
+	volatile size_t stats_seq;
+	struct hdhomerun_video_counters_t stats_baseline;
+
+	/*
+	 * Flush handshake. hdhomerun_video_flush discards the data committed so far and increments flush_request.
+	 * The receive thread resets its sequence tracking at the start of its next batch, publishes its head in
+	 * flush_position and then flush_ack (release); the consumer moves tail up to flush_position on its next
+	 * recv, discarding data that was received before the flush but committed after it.
+	 */
+	volatile size_t flush_request;
+	volatile size_t flush_ack;
+	volatile size_t flush_position;
+	size_t flush_ack_seen;
+
+	/*
+	 * Continuity counter per PID, tagged with the epoch it was stored in (epoch << 4 | cc). Advancing
+	 * sequence_epoch (1-0xFFF) invalidates every entry without touching the table.
+	 */
+	uint32_t rtp_sequence;
+	uint16_t sequence_epoch;
+	uint16_t sequence[0x2000];
+
+	/*
+	 * RTP reorder window (reorder_window == 0 when disabled). Datagram n is held in slot n & reorder_mask, where
+	 * reorder_mask + 1 is reorder_window rounded up to a power of two so that slots stay unique across wrap.
+	 * Bit k of reorder_history is set if rtp_sequence - k was delivered rather than given up as missing.
+	 */
+	uint32_t reorder_window;
+	uint32_t reorder_mask;
+	uint64_t reorder_timeout;
+	uint32_t reorder_held_count;
+	uint64_t reorder_history;
+	struct hdhomerun_video_reorder_slot_t reorder_slot[HDHOMERUN_VIDEO_REORDER_MAX];
+	uint8_t *reorder_data;
+
+	/* NULL unless HDHOMERUN_VIDEO_OPTION_PID_STATS. */
+	struct hdhomerun_video_pid_table_t *pid_table;
+
+	/* NULL unless HDHOMERUN_VIDEO_OPTION_PSI. */
+	struct hdhomerun_psi_t *psi;
+
+	/* PID subscriptions. The receive thread only takes subscription_lock when subscription_count is non-zero. */
+	thread_mutex_t subscription_lock;
+	struct hdhomerun_video_subscription_t *subscriptions;
+	volatile uint32_t subscription_count;
+
+	/*
+	 * Reader cursors. Readers without HDHOMERUN_VIDEO_READER_OPTION_DETACH_ON_LAG bound the free space in the
+	 * ring together with tail. The receive thread only takes reader_lock when reader_count is non-zero.
+	 */
+	thread_mutex_t reader_lock;
+	struct hdhomerun_video_reader_t *readers;
+	volatile uint32_t reader_count;
+
+	/*
+	 * Push delivery (hdhomerun_video_set_callback). The receive thread is the ring consumer while a callback is
+	 * set and only takes callback_lock when callback_enabled is set.
+	 */
+	thread_mutex_t callback_lock;
+	hdhomerun_video_data_callback_t data_callback;
+	void *data_callback_arg;
+	size_t data_callback_min_size;
+	uint64_t data_callback_max_delay;
+	volatile bool callback_enabled;
+};
+
+struct hdhomerun_video_engine_worker_t {
+	struct hdhomerun_video_engine_t *engine;
+	struct hdhomerun_sock_poll_t *ps;
+	struct hdhomerun_sock_uring_t *uring;
+	thread_notify_t notify;
+	bool notify_valid;
+	thread_task_t thread;
+	bool thread_started;
 
-	volatile uint32_t rtp_sequence;
-	volatile uint8_t sequence[0x2000];
+	thread_mutex_t lock;
+	uint32_t sock_count;
+
+	/*
+	 * generation is incremented (under lock) after each poll cycle has been processed. A detaching socket
+	 * waits for it to change so the worker can no longer be using the socket.
+	 */
+	uint32_t generation;
+	uint32_t detach_pending;
+	thread_cond_t detach_cond;
+
+	/* Timer wheel for keepalive, reorder and push delivery timeouts. Slot wheel_pos fires at wheel_time, each following slot one tick later. */
+	struct hdhomerun_video_sock_t *wheel[VIDEO_ENGINE_WHEEL_SLOTS];
+	size_t wheel_pos;
+	uint64_t wheel_time;
+	uint32_t wheel_count;
+};
+
+struct hdhomerun_video_engine_t {
+	struct hdhomerun_debug_t *dbg;
+	volatile bool terminate;
+	uint32_t worker_count;
+	struct hdhomerun_video_engine_worker_t *workers;
 };
 
+static void hdhomerun_video_ts_select_kernel(void);
+static void hdhomerun_video_thread_flush(struct hdhomerun_video_sock_t *vs);
+static void hdhomerun_video_thread_store(struct hdhomerun_video_sock_t *vs, struct hdhomerun_sock_recv_msg_t msgs[], size_t count, size_t free_count, uint32_t syscall_count);
 static void hdhomerun_video_thread_execute(void *arg);
+static size_t hdhomerun_video_release(struct hdhomerun_video_sock_t *vs);
+static bool hdhomerun_video_engine_attach(struct hdhomerun_video_engine_t *engine, struct hdhomerun_video_sock_t *vs);
+static void hdhomerun_video_engine_detach(struct hdhomerun_video_sock_t *vs);
+static void hdhomerun_video_engine_keepalive_changed(struct hdhomerun_video_sock_t *vs, bool enabled);
+static void hdhomerun_video_engine_reschedule(struct hdhomerun_video_sock_t *vs);
 
 struct hdhomerun_video_sock_t *hdhomerun_video_create(uint16_t listen_port, bool allow_port_reuse, size_t buffer_size, struct hdhomerun_debug_t *dbg)
 {
@@ -62,6 +361,83 @@ struct hdhomerun_video_sock_t *hdhomerun_video_create(uint16_t listen_port, bool
 
 struct hdhomerun_video_sock_t *hdhomerun_video_create_ex(const struct sockaddr *listen_addr, bool allow_port_reuse, size_t buffer_size, struct hdhomerun_debug_t *dbg)
 {
+	return hdhomerun_video_create_with_options(listen_addr, allow_port_reuse, buffer_size, NULL, dbg);
+}
+
+static size_t hdhomerun_video_gcd(size_t a, size_t b)
+{
+	while (b) {
+		size_t t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+static bool hdhomerun_video_alloc_mirrored_buffer(struct hdhomerun_video_sock_t *vs, uint32_t map_flags)
+{
+	/*
+	 * The mapping must be a whole number of pages and a whole number of slots so a slot never
+	 * straddles the end of the ring.
+	 */
+	size_t page_size = memory_get_page_size();
+	size_t unit = (page_size / hdhomerun_video_gcd(page_size, VIDEO_DATA_PACKET_SIZE)) * VIDEO_DATA_PACKET_SIZE;
+	size_t buffer_size = ((vs->buffer_size + unit - 1) / unit) * unit;
+
+	vs->buffer = (uint8_t *)memory_map_alloc(buffer_size, MEMORY_MAP_MIRRORED | map_flags);
+	if (!vs->buffer) {
+		return false;
+	}
+
+	vs->buffer_size = buffer_size;
+	vs->buffer_mirrored = true;
+	return true;
+}
+
+static bool hdhomerun_video_alloc_mapped_buffer(struct hdhomerun_video_sock_t *vs, uint32_t map_flags)
+{
+	/* The mapping may be larger than the ring - only buffer_size bytes are used. */
+	size_t unit = memory_get_page_size();
+	if (map_flags & MEMORY_MAP_HUGE_PAGES) {
+		size_t huge_page_size = memory_get_huge_page_size();
+		if (huge_page_size > unit) {
+			unit = huge_page_size;
+		}
+	}
+
+	size_t map_size = ((vs->buffer_size + unit - 1) / unit) * unit;
+	vs->buffer = (uint8_t *)memory_map_alloc(map_size, map_flags);
+	if (!vs->buffer) {
+		return false;
+	}
+
+	vs->buffer_map_size = map_size;
+	return true;
+}
+
+static void hdhomerun_video_free_buffer(struct hdhomerun_video_sock_t *vs)
+{
+	if (vs->buffer_mirrored) {
+		memory_map_free(vs->buffer, vs->buffer_size, MEMORY_MAP_MIRRORED);
+		return;
+	}
+
+	if (vs->buffer_map_size > 0) {
+		memory_map_free(vs->buffer, vs->buffer_map_size, 0);
+		return;
+	}
+
+	free(vs->buffer);
+}
+
+struct hdhomerun_video_sock_t *hdhomerun_video_create_with_options(const struct sockaddr *listen_addr, bool allow_port_reuse, size_t buffer_size, const struct hdhomerun_video_options_t *options, struct hdhomerun_debug_t *dbg)
+{
+	struct hdhomerun_video_options_t default_options;
+	if (!options) {
+		memset(&default_options, 0, sizeof(default_options));
+		options = &default_options;
+	}
+
 	/* Create object. */
 	struct hdhomerun_video_sock_t *vs = (struct hdhomerun_video_sock_t *)calloc(1, sizeof(struct hdhomerun_video_sock_t));
 	if (!vs) {
@@ -71,9 +447,16 @@ struct hdhomerun_video_sock_t *hdhomerun_video_create_ex(const struct sockaddr *
 
 	vs->dbg = dbg;
 	thread_mutex_init(&vs->lock);
+	thread_mutex_init(&vs->subscription_lock);
+	thread_mutex_init(&vs->reader_lock);
+	thread_mutex_init(&vs->callback_lock);
+	thread_cond_init(&vs->wait_cond);
+	hdhomerun_video_ts_select_kernel();
+	vs->notify_valid = thread_notify_init(&vs->notify);
 
 	/* Reset sequence tracking. */
 	hdhomerun_video_flush(vs);
+	hdhomerun_video_thread_flush(vs);
 
 	/* Buffer size. */
 	vs->buffer_size = (buffer_size / VIDEO_DATA_PACKET_SIZE) * VIDEO_DATA_PACKET_SIZE;
@@ -82,14 +465,122 @@ struct hdhomerun_video_sock_t *hdhomerun_video_create_ex(const struct sockaddr *
 		goto error;
 	}
 	vs->buffer_size += VIDEO_DATA_PACKET_SIZE;
+	vs->slot_size = VIDEO_DATA_PACKET_SIZE;
 
 	/* Create buffer. */
-	vs->buffer = (uint8_t *)malloc(vs->buffer_size);
+	uint32_t map_flags = 0;
+	if (options->flags & HDHOMERUN_VIDEO_OPTION_HUGE_PAGES) {
+		map_flags |= MEMORY_MAP_HUGE_PAGES;
+	}
+
+	if (options->flags & HDHOMERUN_VIDEO_OPTION_MIRRORED_BUFFER) {
+		if (!hdhomerun_video_alloc_mirrored_buffer(vs, map_flags)) {
+			hdhomerun_debug_printf(dbg, "hdhomerun_video_create: mirrored buffer not available, using standard buffer\n");
+		}
+	}
+	if (!vs->buffer && (options->flags & (HDHOMERUN_VIDEO_OPTION_HUGE_PAGES | HDHOMERUN_VIDEO_OPTION_PREFAULT | HDHOMERUN_VIDEO_OPTION_LOCK_MEMORY))) {
+		if (!hdhomerun_video_alloc_mapped_buffer(vs, map_flags)) {
+			hdhomerun_debug_printf(dbg, "hdhomerun_video_create: mapped buffer not available, using standard buffer\n");
+		}
+	}
+	if (!vs->buffer) {
+		vs->buffer = (uint8_t *)malloc(vs->buffer_size);
+	}
 	if (!vs->buffer) {
 		hdhomerun_debug_printf(dbg, "hdhomerun_video_create: failed to allocate buffer (%lu bytes)\n", (unsigned long)vs->buffer_size);
 		goto error;
 	}
-	
+
+	/* Both views of a mirrored buffer have their own page table entries. */
+	size_t touch_size = vs->buffer_mirrored ? vs->buffer_size * 2 : vs->buffer_size;
+	if (options->flags & HDHOMERUN_VIDEO_OPTION_LOCK_MEMORY) {
+		if (!memory_map_lock(vs->buffer, touch_size)) {
+			hdhomerun_debug_printf(dbg, "hdhomerun_video_create: failed to lock buffer (%lu bytes)\n", (unsigned long)touch_size);
+		}
+	}
+	if (options->flags & HDHOMERUN_VIDEO_OPTION_PREFAULT) {
+		memory_map_prefault(vs->buffer, touch_size);
+	}
+
+	/* Stripped datagrams are stored as individual TS packets. */
+	if (options->flags & HDHOMERUN_VIDEO_OPTION_STRIP) {
+		vs->strip = true;
+		vs->slot_size = TS_PACKET_SIZE;
+		if (options->strip_pid_bitmap) {
+			vs->strip_pid_filter = true;
+			memcpy(vs->strip_pid_bitmap, options->strip_pid_bitmap, HDHOMERUN_VIDEO_PID_BITMAP_SIZE);
+		}
+	}
+
+	/* Create slot arrival times. */
+	vs->slot_time = (uint64_t *)calloc(vs->buffer_size / vs->slot_size, sizeof(uint64_t));
+	if (!vs->slot_time) {
+		hdhomerun_debug_printf(dbg, "hdhomerun_video_create: failed to allocate slot times\n");
+		goto error;
+	}
+
+	if (options->flags & HDHOMERUN_VIDEO_OPTION_RECV_TIMESTAMPS) {
+		vs->slot_timestamp = (uint64_t *)calloc(vs->buffer_size / vs->slot_size, sizeof(uint64_t));
+		if (!vs->slot_timestamp) {
+			hdhomerun_debug_printf(dbg, "hdhomerun_video_create: failed to allocate slot timestamps\n");
+			goto error;
+		}
+	}
+
+	vs->overflow_policy = options->overflow_policy;
+	vs->high_watermark = options->high_watermark;
+	vs->watermark_callback = options->watermark_callback;
+	vs->watermark_callback_arg = options->watermark_callback_arg;
+
+	/* Create per-PID stats table. */
+	if (options->flags & HDHOMERUN_VIDEO_OPTION_PID_STATS) {
+		vs->pid_table = (struct hdhomerun_video_pid_table_t *)calloc(1, sizeof(struct hdhomerun_video_pid_table_t));
+		if (!vs->pid_table) {
+			hdhomerun_debug_printf(dbg, "hdhomerun_video_create: failed to allocate pid stats\n");
+			goto error;
+		}
+	}
+
+	/* Create PAT/PMT assembler. */
+	if (options->flags & HDHOMERUN_VIDEO_OPTION_PSI) {
+		vs->psi = hdhomerun_psi_create();
+		if (!vs->psi) {
+			hdhomerun_debug_printf(dbg, "hdhomerun_video_create: failed to allocate psi\n");
+			goto error;
+		}
+	}
+
+	/* Create reorder window. */
+	if ((options->reorder_packets > 0) || (options->reorder_ms > 0)) {
+		vs->reorder_window = options->reorder_packets ? options->reorder_packets : VIDEO_REORDER_DEFAULT_PACKETS;
+		if (vs->reorder_window < 2) {
+			vs->reorder_window = 2;
+		}
+		if (vs->reorder_window > HDHOMERUN_VIDEO_REORDER_MAX) {
+			vs->reorder_window = HDHOMERUN_VIDEO_REORDER_MAX;
+		}
+		vs->reorder_timeout = options->reorder_ms;
+
+		vs->reorder_mask = 1;
+		while (vs->reorder_mask < vs->reorder_window) {
+			vs->reorder_mask <<= 1;
+		}
+		vs->reorder_mask--;
+
+		vs->reorder_data = (uint8_t *)malloc((vs->reorder_mask + 1) * VIDEO_DATA_PACKET_SIZE);
+		if (!vs->reorder_data) {
+			hdhomerun_debug_printf(dbg, "hdhomerun_video_create: failed to allocate reorder buffer\n");
+			goto error;
+		}
+	}
+
+	/* Create discard buffer used when the ring is full. */
+	vs->recv_discard = (uint8_t *)malloc(VIDEO_RECV_BATCH_COUNT * VIDEO_DATA_PACKET_SIZE);
+	if (!vs->recv_discard) {
+		hdhomerun_debug_printf(dbg, "hdhomerun_video_create: failed to allocate discard buffer\n");
+		goto error;
+	}
+
 	/* Create socket. */
 	vs->sock = hdhomerun_sock_create_udp_ex(listen_addr->sa_family);
 	if (!vs->sock) {
@@ -100,30 +591,113 @@ struct hdhomerun_video_sock_t *hdhomerun_video_create_ex(const struct sockaddr *
 	/* Expand socket buffer size. */
 	hdhomerun_sock_set_recv_buffer_size(vs->sock, 1024 * 1024);
 
+	if (vs->slot_timestamp) {
+		if (!hdhomerun_sock_set_recv_timestamps(vs->sock, true)) {
+			hdhomerun_debug_printf(dbg, "hdhomerun_video_create: kernel receive timestamps not available\n");
+		}
+	}
+
+	if (options->busy_poll_us > 0) {
+		if (!hdhomerun_sock_set_busy_poll(vs->sock, options->busy_poll_us)) {
+			hdhomerun_debug_printf(dbg, "hdhomerun_video_create: busy poll not available\n");
+		}
+	}
+
 	/* Bind socket. */
 	if (!hdhomerun_sock_bind_ex(vs->sock, listen_addr, allow_port_reuse)) {
 		hdhomerun_debug_printf(dbg, "hdhomerun_video_create: failed to bind socket\n");
 		goto error;
 	}
 
-	/* Start thread. */
-	if (!thread_task_create(&vs->thread, &hdhomerun_video_thread_execute, vs)) {
-		hdhomerun_debug_printf(dbg, "hdhomerun_video_create: failed to start thread\n");
-		goto error;
+	/* io_uring receive for a dedicated thread, falling back to recvmmsg if the kernel does not support it. */
+	if ((options->flags & HDHOMERUN_VIDEO_OPTION_IO_URING) && !options->engine) {
+		vs->uring = hdhomerun_sock_uring_create(8);
+		if (vs->uring && !hdhomerun_sock_uring_add(vs->uring, vs->sock, vs, VIDEO_URING_BUFFER_COUNT, VIDEO_RTP_DATA_PACKET_SIZE)) {
+			hdhomerun_sock_uring_destroy(vs->uring);
+			vs->uring = NULL;
+		}
+		if (!vs->uring) {
+			hdhomerun_debug_printf(dbg, "hdhomerun_video_create: io_uring receive not available, using recvmmsg\n");
+		}
+	}
+
+	/* Attach to the engine, or start a dedicated thread. */
+	if (options->engine) {
+		if (!hdhomerun_video_engine_attach(options->engine, vs)) {
+			hdhomerun_debug_printf(dbg, "hdhomerun_video_create: failed to attach to engine\n");
+			goto error;
+		}
+	} else {
+		struct thread_task_attr_t thread_attr;
+		memset(&thread_attr, 0, sizeof(thread_attr));
+		if (options->thread_attr) {
+			thread_attr = *options->thread_attr;
+		}
+		if (!thread_attr.name) {
+			thread_attr.name = "hdhr-video";
+		}
+
+		if (!thread_task_create_ex(&vs->thread, &hdhomerun_video_thread_execute, vs, &thread_attr)) {
+			hdhomerun_debug_printf(dbg, "hdhomerun_video_create: failed to apply thread attributes, using defaults\n");
+
+			memset(&thread_attr, 0, sizeof(thread_attr));
+			thread_attr.name = "hdhr-video";
+
+			if (!thread_task_create_ex(&vs->thread, &hdhomerun_video_thread_execute, vs, &thread_attr)) {
+				hdhomerun_debug_printf(dbg, "hdhomerun_video_create: failed to start thread\n");
+				goto error;
+			}
+		}
 	}
 
 	/* Success. */
 	return vs;
 
 error:
+	if (vs->uring) {
+		hdhomerun_sock_uring_destroy(vs->uring);
+	}
+
 	if (vs->sock) {
 		hdhomerun_sock_destroy(vs->sock);
 	}
 
 	if (vs->buffer) {
-		free(vs->buffer);
+		hdhomerun_video_free_buffer(vs);
+	}
+
+	if (vs->recv_discard) {
+		free(vs->recv_discard);
+	}
+
+	if (vs->pid_table) {
+		free(vs->pid_table);
+	}
+
+	if (vs->psi) {
+		hdhomerun_psi_destroy(vs->psi);
+	}
+
+	if (vs->reorder_data) {
+		free(vs->reorder_data);
+	}
+
+	if (vs->slot_time) {
+		free(vs->slot_time);
+	}
+
+	if (vs->slot_timestamp) {
+		free(vs->slot_timestamp);
+	}
+
+	if (vs->notify_valid) {
+		thread_notify_dispose(&vs->notify);
 	}
 
+	thread_cond_dispose(&vs->wait_cond);
+	thread_mutex_dispose(&vs->callback_lock);
+	thread_mutex_dispose(&vs->reader_lock);
+	thread_mutex_dispose(&vs->subscription_lock);
 	thread_mutex_dispose(&vs->lock);
 
 	free(vs);
@@ -132,12 +706,46 @@ error:
 
 void hdhomerun_video_destroy(struct hdhomerun_video_sock_t *vs)
 {
-	vs->terminate = true;
-	thread_task_join(vs->thread);
+	if (vs->engine_worker) {
+		hdhomerun_video_engine_detach(vs);
+	} else {
+		vs->terminate = true;
+		thread_task_join(vs->thread);
+	}
+
+	if (vs->uring) {
+		hdhomerun_sock_uring_destroy(vs->uring);
+	}
 
 	hdhomerun_sock_destroy(vs->sock);
+	if (vs->notify_valid) {
+		thread_notify_dispose(&vs->notify);
+	}
+
+	while (vs->subscriptions) {
+		hdhomerun_video_unsubscribe(vs, vs->subscriptions);
+	}
+
+	while (vs->readers) {
+		hdhomerun_video_reader_destroy(vs->readers);
+	}
+
+	thread_cond_dispose(&vs->wait_cond);
+	thread_mutex_dispose(&vs->callback_lock);
+	thread_mutex_dispose(&vs->reader_lock);
+	thread_mutex_dispose(&vs->subscription_lock);
 	thread_mutex_dispose(&vs->lock);
-	free(vs->buffer);
+	hdhomerun_video_free_buffer(vs);
+	free(vs->recv_discard);
+	free(vs->pid_table);
+	free(vs->reorder_data);
+
+	if (vs->psi) {
+		hdhomerun_psi_destroy(vs->psi);
+	}
+
+	free(vs->slot_time);
+	free(vs->slot_timestamp);
 
 	free(vs);
 }
@@ -172,11 +780,16 @@ void hdhomerun_video_set_keepalive_ex(struct hdhomerun_video_sock_t *vs, const s
 
 	vs->keepalive_lockkey = lockkey;
 
-	if (vs->keepalive_addr.ss_family) {
+	bool enabled = (vs->keepalive_addr.ss_family != 0);
+	if (enabled) {
 		vs->keepalive_start = true;
 	}
 
 	thread_mutex_unlock(&vs->lock);
+
+	if (vs->engine_worker) {
+		hdhomerun_video_engine_keepalive_changed(vs, enabled);
+	}
 }
 
 struct hdhomerun_sock_t *hdhomerun_video_get_sock(struct hdhomerun_video_sock_t *vs)
@@ -242,7 +855,19 @@ void hdhomerun_video_leave_multicast_group_ex(struct hdhomerun_video_sock_t *vs,
 	}
 }
 
-static void hdhomerun_video_stats_ts_pkt(struct hdhomerun_video_sock_t *vs, uint8_t *ptr)
+static void hdhomerun_video_sequence_reset(struct hdhomerun_video_sock_t *vs)
+{
+	vs->sequence_epoch++;
+	if (vs->sequence_epoch > 0x0FFF) {
+		memset(vs->sequence, 0, sizeof(vs->sequence));
+		vs->sequence_epoch = 1;
+	}
+}
+
+#define VIDEO_TS_PKT_TRANSPORT_ERROR 0x01
+#define VIDEO_TS_PKT_SEQUENCE_ERROR 0x02
+
+static uint8_t hdhomerun_video_stats_ts_pkt(struct hdhomerun_video_sock_t *vs, uint8_t *ptr)
 {
 	uint16_t packet_identifier;
 	packet_identifier  = (uint16_t)(ptr[1] & 0x1F) << 8;
@@ -251,42 +876,252 @@ static void hdhomerun_video_stats_ts_pkt(struct hdhomerun_video_sock_t *vs, uint
 	bool transport_error = (ptr[1] & 0x80) != 0;
 	if (transport_error) {
 		vs->transport_error_count++;
-		vs->sequence[packet_identifier] = 0xFF;
-		return;
+		vs->sequence[packet_identifier] = 0;
+		return VIDEO_TS_PKT_TRANSPORT_ERROR;
 	}
 
 	if (packet_identifier == 0x1FFF) {
-		return;
+		return 0;
 	}
 
 	bool payload_present = (ptr[3] & 0x10) != 0;
 	if (!payload_present) {
-		return;
+		return 0;
+	}
+
+	uint16_t tag = vs->sequence_epoch << 4;
+	uint16_t sequence = ptr[3] & 0x0F;
+
+	uint16_t previous = vs->sequence[packet_identifier];
+	vs->sequence[packet_identifier] = tag | sequence;
+
+	if ((previous & 0xFFF0) != tag) {
+		return 0;
+	}
+	if (sequence == ((previous + 1) & 0x0F)) {
+		return 0;
+	}
+
+	vs->sequence_error_count++;
+	return VIDEO_TS_PKT_SEQUENCE_ERROR;
+}
+
+/*
+ * Uniform prefix check.
+ *
+ * Each TS header is reduced to key = (header & TEI|PID|payload flag) | ((cc - index) & 0x0F). Packets whose key
+ * equals the key of packet 0 are on one PID, with the same TEI/payload flags and consecutive continuity counters.
+ * Returns the number of leading packets that match packet 0 (1 - 7), so the caller only checks the rest per packet.
+ */
+#define VIDEO_TS_KEY_MASK 0x10FF9F00
+
+static inline uint32_t hdhomerun_video_ts_load_header(const uint8_t *ptr, int index)
+{
+	const uint8_t *p = ptr + TS_PACKET_SIZE * index;
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static size_t hdhomerun_video_ts_uniform_generic(const uint8_t *ptr)
+{
+	uint32_t hdr0 = hdhomerun_video_ts_load_header(ptr, 0);
+	uint32_t key0 = (hdr0 & VIDEO_TS_KEY_MASK) | ((hdr0 >> 24) & 0x0F);
+
+	/* Stop at the first mismatch - mixed PID streams usually fail on packet 1. */
+	size_t i;
+	for (i = 1; i < 7; i++) {
+		uint32_t hdr = hdhomerun_video_ts_load_header(ptr, (int)i);
+		uint32_t key = (hdr & VIDEO_TS_KEY_MASK) | (((hdr >> 24) - (uint32_t)i) & 0x0F);
+		if (key != key0) {
+			break;
+		}
+	}
+
+	return i;
+}
+
+#if defined(VIDEO_TS_AVX2)
+static inline size_t hdhomerun_video_ts_prefix_count(uint32_t eq_mask)
+{
+	/* eq_mask has 4 bits per lane; lane 7 duplicates lane 6. */
+	size_t count = 1;
+	while ((count < 7) && (eq_mask & (1 << (count * 4)))) {
+		count++;
+	}
+	return count;
+}
+
+__attribute__((target("avx2")))
+static size_t hdhomerun_video_ts_uniform_avx2(const uint8_t *ptr)
+{
+	/* Bail before the gather when packet 1 is already on another PID. */
+	if (memcmp(ptr + 1, ptr + TS_PACKET_SIZE + 1, 2) != 0) {
+		return 1;
 	}
 
-	uint8_t sequence = ptr[3] & 0x0F;
+	/* Gather the 7 headers in one instruction; lane 7 repeats packet 6 to fill the vector. */
+	const __m256i offsets = _mm256_setr_epi32(TS_PACKET_SIZE * 0, TS_PACKET_SIZE * 1, TS_PACKET_SIZE * 2, TS_PACKET_SIZE * 3, TS_PACKET_SIZE * 4, TS_PACKET_SIZE * 5, TS_PACKET_SIZE * 6, TS_PACKET_SIZE * 6);
+	__m256i h = _mm256_i32gather_epi32((const int *)ptr, offsets, 1);
+
+	__m256i cc = _mm256_and_si256(_mm256_sub_epi32(_mm256_srli_epi32(h, 24), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 6)), _mm256_set1_epi32(0x0F));
+	__m256i key = _mm256_or_si256(_mm256_and_si256(h, _mm256_set1_epi32(VIDEO_TS_KEY_MASK)), cc);
+
+	__m256i key0 = _mm256_permutevar8x32_epi32(key, _mm256_setzero_si256());
+	return hdhomerun_video_ts_prefix_count((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi32(key, key0)));
+}
+#endif
 
-	uint8_t previous_sequence = vs->sequence[packet_identifier];
-	vs->sequence[packet_identifier] = sequence;
+typedef size_t (*hdhomerun_video_ts_uniform_func_t)(const uint8_t *ptr);
+static hdhomerun_video_ts_uniform_func_t hdhomerun_video_ts_uniform = hdhomerun_video_ts_uniform_generic;
 
-	if (previous_sequence == 0xFF) {
+static void hdhomerun_video_ts_select_kernel(void)
+{
+#if defined(VIDEO_TS_AVX2)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		hdhomerun_video_ts_uniform = hdhomerun_video_ts_uniform_avx2;
 		return;
 	}
-	if (sequence == ((previous_sequence + 1) & 0x0F)) {
+#endif
+}
+
+static struct hdhomerun_video_pid_entry_t *hdhomerun_video_pid_entry(struct hdhomerun_video_pid_table_t *table, uint16_t packet_identifier)
+{
+	uint16_t index = table->index[packet_identifier];
+	if (index > 0) {
+		return &table->entries[index - 1];
+	}
+
+	/* New PID - initialize the entry before publishing it through active_count. */
+	size_t active_count = table->active_count;
+	struct hdhomerun_video_pid_entry_t *entry = &table->entries[active_count];
+	memset(entry, 0, sizeof(struct hdhomerun_video_pid_entry_t));
+	entry->pid = packet_identifier;
+
+	table->index[packet_identifier] = (uint16_t)(active_count + 1);
+	table->active_count = active_count + 1;
+	return entry;
+}
+
+static void hdhomerun_video_pid_stats_datagram(struct hdhomerun_video_sock_t *vs, uint8_t *ptr)
+{
+	struct hdhomerun_video_pid_table_t *table = vs->pid_table;
+
+	int i;
+	for (i = 0; i < 7; i++) {
+		uint8_t *pkt = ptr + TS_PACKET_SIZE * i;
+		uint8_t result = hdhomerun_video_stats_ts_pkt(vs, pkt);
+
+		uint16_t packet_identifier = ((uint16_t)(pkt[1] & 0x1F) << 8) | (uint16_t)pkt[2];
+		struct hdhomerun_video_pid_entry_t *entry = hdhomerun_video_pid_entry(table, packet_identifier);
+
+		entry->packet_count++;
+		entry->window_packet_count++;
+		entry->last_seen_time = table->batch_time;
+		if (result & VIDEO_TS_PKT_TRANSPORT_ERROR) {
+			entry->transport_error_count++;
+		}
+		if (result & VIDEO_TS_PKT_SEQUENCE_ERROR) {
+			entry->sequence_error_count++;
+		}
+		if (pkt[3] & 0xC0) {
+			entry->scrambled_count++;
+		}
+	}
+}
+
+static void hdhomerun_video_pid_stats_begin(struct hdhomerun_video_pid_table_t *table)
+{
+	thread_atomic_store_release_size(&table->seq, table->seq + 1);
+	thread_atomic_fence();
+	table->batch_time = getcurrenttime();
+}
+
+static void hdhomerun_video_pid_stats_end(struct hdhomerun_video_pid_table_t *table)
+{
+	/* Fold the packets seen since the last update into the bitrate average once per second. */
+	uint64_t current_time = table->batch_time;
+	if (table->window_start == 0) {
+		table->window_start = current_time;
+	}
+
+	uint64_t elapsed = current_time - table->window_start;
+	if (elapsed >= VIDEO_PID_BITRATE_WINDOW) {
+		size_t active_count = table->active_count;
+		size_t i;
+		for (i = 0; i < active_count; i++) {
+			struct hdhomerun_video_pid_entry_t *entry = &table->entries[i];
+			int64_t bitrate = (int64_t)(entry->window_packet_count * TS_PACKET_SIZE * 8 * 1000 / elapsed);
+			/* A PID with no packets for a whole window drops to 0 rather than decaying. */
+			if ((entry->bitrate == 0) || (bitrate == 0)) {
+				entry->bitrate = (uint32_t)bitrate;
+			} else {
+				entry->bitrate = (uint32_t)((int64_t)entry->bitrate + (bitrate - (int64_t)entry->bitrate) / 4);
+			}
+			entry->window_packet_count = 0;
+		}
+
+		table->window_start = current_time;
+	}
+
+	thread_atomic_store_release_size(&table->seq, table->seq + 1);
+}
+
+static void hdhomerun_video_pid_stats_reset(struct hdhomerun_video_pid_table_t *table)
+{
+	hdhomerun_video_pid_stats_begin(table);
+	memset(table->index, 0, sizeof(table->index));
+	table->active_count = 0;
+	table->window_start = 0;
+	thread_atomic_store_release_size(&table->seq, table->seq + 1);
+}
+
+static void hdhomerun_video_stats_datagram(struct hdhomerun_video_sock_t *vs, uint8_t *ptr)
+{
+	if (vs->psi) {
+		int i;
+		for (i = 0; i < 7; i++) {
+			hdhomerun_psi_process_ts(vs->psi, ptr + TS_PACKET_SIZE * i);
+		}
+	}
+
+	if (vs->pid_table) {
+		hdhomerun_video_pid_stats_datagram(vs, ptr);
 		return;
 	}
 
-	vs->sequence_error_count++;
+	/*
+	 * Fast path - a run of consecutive payload packets on one PID, only the first needs checking. The rest of
+	 * the datagram is checked per packet.
+	 */
+	size_t index = 0;
+	size_t uniform_count = hdhomerun_video_ts_uniform(ptr);
+	if (uniform_count > 1) {
+		bool transport_error = (ptr[1] & 0x80) != 0;
+		bool payload_present = (ptr[3] & 0x10) != 0;
+		uint16_t packet_identifier = ((uint16_t)(ptr[1] & 0x1F) << 8) | (uint16_t)ptr[2];
+		if (!transport_error && payload_present) {
+			if (packet_identifier != 0x1FFF) {
+				hdhomerun_video_stats_ts_pkt(vs, ptr);
+				vs->sequence[packet_identifier] = (vs->sequence_epoch << 4) | (ptr[TS_PACKET_SIZE * (uniform_count - 1) + 3] & 0x0F);
+			}
+			index = uniform_count;
+		}
+	}
+
+	for (; index < 7; index++) {
+		hdhomerun_video_stats_ts_pkt(vs, ptr + TS_PACKET_SIZE * index);
+	}
 }
 
-static void hdhomerun_video_parse_rtp(struct hdhomerun_video_sock_t *vs, struct hdhomerun_pkt_t *pkt)
+static void hdhomerun_video_parse_rtp(struct hdhomerun_video_sock_t *vs, const uint8_t *ptr)
 {
-	pkt->pos += 2;
-	uint32_t rtp_sequence = hdhomerun_pkt_read_u16(pkt);
-	pkt->pos += 8;
+	uint32_t rtp_sequence;
+	rtp_sequence  = (uint32_t)ptr[2] << 8;
+	rtp_sequence |= (uint32_t)ptr[3] << 0;
 
 	uint32_t previous_rtp_sequence = vs->rtp_sequence;
 	vs->rtp_sequence = rtp_sequence;
+	vs->reorder_history = (vs->reorder_history << 1) | 1;
 
 	/* Initial case - first packet received. */
 	if (previous_rtp_sequence == 0xFFFFFFFF) {
@@ -302,10 +1137,7 @@ static void hdhomerun_video_parse_rtp(struct hdhomerun_video_sock_t *vs, struct
 	vs->network_error_count++;
 
 	/* Restart pid sequence check after packet loss. */
-	int i;
-	for (i = 0; i < 0x2000; i++) {
-		vs->sequence[i] = 0xFF;
-	}
+	hdhomerun_video_sequence_reset(vs);
 }
 
 static void hdhomerun_video_thread_send_keepalive(struct hdhomerun_video_sock_t *vs)
@@ -327,6 +1159,982 @@ static void hdhomerun_video_thread_send_keepalive(struct hdhomerun_video_sock_t
 	hdhomerun_sock_sendto_ex(vs->sock, (struct sockaddr *)&keepalive_addr, pkt.start, pkt.end - pkt.start, 25);
 }
 
+static size_t hdhomerun_video_used_size(struct hdhomerun_video_sock_t *vs, size_t head, size_t tail)
+{
+	if (head >= tail) {
+		return head - tail;
+	}
+
+	return vs->buffer_size - tail + head;
+}
+
+static size_t hdhomerun_video_free_slot_count(struct hdhomerun_video_sock_t *vs, size_t head, size_t tail)
+{
+	size_t used = hdhomerun_video_used_size(vs, head, tail);
+
+	/*
+	 * One slot is always left empty so that a full ring can be told apart from an empty one. The result is in
+	 * datagrams, assuming none of a stripped datagram is removed.
+	 */
+	return (((vs->buffer_size - used) / vs->slot_size) - 1) / (VIDEO_DATA_PACKET_SIZE / vs->slot_size);
+}
+
+/*
+ * Free slots at head, bounded by tail and every attached reader without HDHOMERUN_VIDEO_READER_OPTION_DETACH_ON_LAG.
+ * Readers that detach on lag and have fewer than needed free slots are detached. If plag_free_count is set it
+ * returns the least free space of the remaining detach-on-lag readers (SIZE_MAX if none).
+ */
+static size_t hdhomerun_video_thread_free_count(struct hdhomerun_video_sock_t *vs, size_t head, size_t needed, size_t *plag_free_count)
+{
+	size_t free_count = hdhomerun_video_free_slot_count(vs, head, thread_atomic_load_acquire_size(&vs->tail));
+	size_t lag_free_count = SIZE_MAX;
+
+	if (vs->reader_count > 0) {
+		thread_mutex_lock(&vs->reader_lock);
+
+		struct hdhomerun_video_reader_t *reader;
+		for (reader = vs->readers; reader; reader = reader->next) {
+			if (reader->detached || (reader->flags & HDHOMERUN_VIDEO_READER_OPTION_DETACH_ON_LAG)) {
+				continue;
+			}
+
+			size_t reader_free_count = hdhomerun_video_free_slot_count(vs, head, thread_atomic_load_acquire_size(&reader->tail));
+			if (reader_free_count < free_count) {
+				free_count = reader_free_count;
+			}
+		}
+
+		if (needed > free_count) {
+			needed = free_count;
+		}
+
+		for (reader = vs->readers; reader; reader = reader->next) {
+			if (reader->detached || !(reader->flags & HDHOMERUN_VIDEO_READER_OPTION_DETACH_ON_LAG)) {
+				continue;
+			}
+
+			size_t reader_free_count = hdhomerun_video_free_slot_count(vs, head, thread_atomic_load_acquire_size(&reader->tail));
+			if (reader_free_count < needed) {
+				reader->detached = true;
+				continue;
+			}
+
+			if (reader_free_count < lag_free_count) {
+				lag_free_count = reader_free_count;
+			}
+		}
+
+		thread_mutex_unlock(&vs->reader_lock);
+	}
+
+	if (plag_free_count) {
+		*plag_free_count = lag_free_count;
+	}
+	return free_count;
+}
+
+static void hdhomerun_video_thread_wakeup(struct hdhomerun_video_sock_t *vs, size_t head)
+{
+	thread_atomic_fence();
+
+	size_t wait_size = vs->wait_size;
+	if (wait_size > 0) {
+		size_t tail = thread_atomic_load_acquire_size(&vs->tail);
+		if (hdhomerun_video_used_size(vs, head, tail) >= wait_size) {
+			thread_cond_signal(&vs->wait_cond);
+		}
+	}
+
+	if (vs->notify_armed) {
+		vs->notify_armed = false;
+		thread_notify_signal(&vs->notify);
+	}
+}
+
+static void hdhomerun_video_thread_overflow(struct hdhomerun_video_sock_t *vs)
+{
+	vs->overflow_error_count++;
+
+	switch (vs->overflow_policy) {
+	case HDHOMERUN_VIDEO_OVERFLOW_DROP_OLDEST:
+		/* Published by hdhomerun_video_thread_commit once the head of this batch is known. */
+		vs->skip_pending = true;
+		break;
+
+	case HDHOMERUN_VIDEO_OVERFLOW_DROP_TO_PUSI:
+		vs->overflow_resync = true;
+		break;
+
+	default:
+		break;
+	}
+}
+
+/*
+ * Returns true if the datagram contains a payload_unit_start. Packets ahead of the unit start are replaced
+ * with null packets so the stream resumes at the start of a PES packet or section.
+ */
+static bool hdhomerun_video_thread_resync(struct hdhomerun_video_sock_t *vs, uint8_t *ptr)
+{
+	size_t offset;
+	for (offset = 0; offset < VIDEO_DATA_PACKET_SIZE; offset += TS_PACKET_SIZE) {
+		if ((ptr[offset + 0] == 0x47) && (ptr[offset + 1] & 0x40)) {
+			break;
+		}
+	}
+	if (offset >= VIDEO_DATA_PACKET_SIZE) {
+		return false;
+	}
+
+	size_t null_offset;
+	for (null_offset = 0; null_offset < offset; null_offset += TS_PACKET_SIZE) {
+		ptr[null_offset + 1] = 0x1F;
+		ptr[null_offset + 2] = 0xFF;
+		ptr[null_offset + 3] = 0x10;
+	}
+
+	vs->overflow_resync = false;
+	return true;
+}
+
+/*
+ * Inter-arrival histogram. Bucket 0 counts gaps under 16us, bucket n gaps of [2^(n+3), 2^(n+4)) us and the last
+ * bucket everything longer.
+ */
+static void hdhomerun_video_jitter_record(struct hdhomerun_video_sock_t *vs, uint64_t timestamp)
+{
+	uint64_t last_timestamp = vs->jitter_last_timestamp;
+	vs->jitter_last_timestamp = timestamp;
+
+	if ((last_timestamp == 0) || (timestamp < last_timestamp)) {
+		return;
+	}
+
+	uint64_t delta = (timestamp - last_timestamp) / 16000;
+	uint32_t bucket = 0;
+	while (delta && (bucket < HDHOMERUN_VIDEO_JITTER_BUCKETS - 1)) {
+		delta >>= 1;
+		bucket++;
+	}
+
+	vs->jitter_histogram[bucket]++;
+}
+
+static void hdhomerun_video_thread_timestamps(struct hdhomerun_video_sock_t *vs, struct hdhomerun_sock_recv_msg_t msgs[], size_t count)
+{
+	uint64_t batch_timestamp = 0;
+
+	size_t i;
+	for (i = 0; i < count; i++) {
+		if ((msgs[i].length != VIDEO_RTP_DATA_PACKET_SIZE) && (msgs[i].length != VIDEO_DATA_PACKET_SIZE)) {
+			continue;
+		}
+
+		if (msgs[i].timestamp) {
+			hdhomerun_video_jitter_record(vs, msgs[i].timestamp);
+			continue;
+		}
+
+		/* No kernel timestamp - use the time the batch was processed. */
+		if (batch_timestamp == 0) {
+			batch_timestamp = getcurrenttime_realtime_ns();
+		}
+		msgs[i].timestamp = batch_timestamp;
+	}
+}
+
+/*
+ * Pass committed data to the push callback once min_size bytes are buffered or the oldest data has waited
+ * max_delay ms, then release it.
+ */
+static void hdhomerun_video_thread_deliver(struct hdhomerun_video_sock_t *vs)
+{
+	if (!vs->callback_enabled) {
+		return;
+	}
+
+	thread_mutex_lock(&vs->callback_lock);
+
+	if (!vs->data_callback) {
+		thread_mutex_unlock(&vs->callback_lock);
+		return;
+	}
+
+	size_t tail = hdhomerun_video_release(vs);
+	size_t head = vs->head;
+	size_t used_size = hdhomerun_video_used_size(vs, head, tail);
+	if (used_size == 0) {
+		thread_mutex_unlock(&vs->callback_lock);
+		return;
+	}
+
+	if (used_size < vs->data_callback_min_size) {
+		if (vs->data_callback_max_delay == 0) {
+			thread_mutex_unlock(&vs->callback_lock);
+			return;
+		}
+
+		uint64_t arrival_time = vs->slot_time[tail / vs->slot_size];
+		if (getcurrenttime() < arrival_time + vs->data_callback_max_delay) {
+			thread_mutex_unlock(&vs->callback_lock);
+			return;
+		}
+	}
+
+	while (tail != head) {
+		size_t size;
+		if (head > tail) {
+			size = head - tail;
+		} else if (vs->buffer_mirrored) {
+			size = vs->buffer_size - tail + head;
+		} else {
+			size = vs->buffer_size - tail;
+		}
+
+		vs->data_callback(vs->data_callback_arg, vs->buffer + tail, size);
+
+		tail += size;
+		if (tail >= vs->buffer_size) {
+			tail -= vs->buffer_size;
+		}
+		thread_atomic_store_release_size(&vs->tail, tail);
+	}
+
+	thread_mutex_unlock(&vs->callback_lock);
+}
+
+/*
+ * Time at which undelivered push data reaches max_delay, or 0 if there is none or no max_delay.
+ */
+static uint64_t hdhomerun_video_deliver_due_time(struct hdhomerun_video_sock_t *vs)
+{
+	if (!vs->callback_enabled) {
+		return 0;
+	}
+
+	thread_mutex_lock(&vs->callback_lock);
+
+	uint64_t due_time = 0;
+	if (vs->data_callback && (vs->data_callback_max_delay > 0)) {
+		size_t tail = vs->tail;
+		if (hdhomerun_video_used_size(vs, vs->head, tail) > 0) {
+			due_time = vs->slot_time[tail / vs->slot_size] + vs->data_callback_max_delay;
+		}
+	}
+
+	thread_mutex_unlock(&vs->callback_lock);
+	return due_time;
+}
+
+static void hdhomerun_video_thread_skip(struct hdhomerun_video_sock_t *vs)
+{
+	if (!vs->skip_pending) {
+		return;
+	}
+
+	/* Ask the consumer to discard everything up to the committed head (one request outstanding at a time). */
+	vs->skip_pending = false;
+	if (vs->skip_request == thread_atomic_load_acquire_size(&vs->skip_ack)) {
+		vs->skip_position = vs->head;
+		thread_atomic_store_release_size(&vs->skip_request, vs->skip_request + 1);
+	}
+}
+
+static void hdhomerun_video_thread_commit(struct hdhomerun_video_sock_t *vs, size_t head)
+{
+	size_t slot = vs->head;
+	if (head == slot) {
+		hdhomerun_video_thread_skip(vs);
+		return;
+	}
+
+	uint64_t current_time = getcurrenttime();
+	while (slot != head) {
+		vs->slot_time[slot / vs->slot_size] = current_time;
+		slot += vs->slot_size;
+		if (slot >= vs->buffer_size) {
+			slot -= vs->buffer_size;
+		}
+	}
+
+	/* The data is already in place. */
+	thread_atomic_store_release_size(&vs->head, head);
+	hdhomerun_video_thread_skip(vs);
+	hdhomerun_video_thread_wakeup(vs, head);
+
+	size_t used_size = hdhomerun_video_used_size(vs, head, thread_atomic_load_acquire_size(&vs->tail));
+
+	if (vs->peak_reset_request != vs->peak_reset_ack) {
+		vs->peak_reset_ack = vs->peak_reset_request;
+		vs->peak_used_size = used_size;
+	} else if (used_size > vs->peak_used_size) {
+		vs->peak_used_size = used_size;
+	}
+
+	if (vs->watermark_callback) {
+		if (used_size < vs->high_watermark) {
+			vs->watermark_active = false;
+		} else if (!vs->watermark_active) {
+			vs->watermark_active = true;
+			vs->watermark_callback(vs->watermark_callback_arg, used_size);
+		}
+	}
+
+	hdhomerun_video_thread_deliver(vs);
+}
+
+static void hdhomerun_video_thread_flush(struct hdhomerun_video_sock_t *vs)
+{
+	vs->rtp_sequence = 0xFFFFFFFF;
+	hdhomerun_video_sequence_reset(vs);
+
+	vs->reorder_held_count = 0;
+	vs->reorder_history = 0;
+	memset(vs->reorder_slot, 0, sizeof(vs->reorder_slot));
+
+	vs->overflow_resync = false;
+	vs->skip_pending = false;
+	vs->jitter_last_timestamp = 0;
+
+	if (vs->pid_table) {
+		hdhomerun_video_pid_stats_reset(vs->pid_table);
+	}
+
+	if (vs->psi) {
+		hdhomerun_psi_reset(vs->psi);
+	}
+
+	/* Data committed before this point was received before the flush. */
+	vs->flush_position = vs->head;
+	thread_atomic_store_release_size(&vs->flush_ack, thread_atomic_load_acquire_size(&vs->flush_request));
+}
+
+static void hdhomerun_video_thread_stats_begin(struct hdhomerun_video_sock_t *vs)
+{
+	thread_atomic_store_release_size(&vs->stats_seq, vs->stats_seq + 1);
+	thread_atomic_fence();
+}
+
+static void hdhomerun_video_thread_stats_end(struct hdhomerun_video_sock_t *vs)
+{
+	thread_atomic_store_release_size(&vs->stats_seq, vs->stats_seq + 1);
+}
+
+static void hdhomerun_video_subscription_push(struct hdhomerun_video_subscription_t *sub, const uint8_t *ptr, size_t count)
+{
+	sub->packet_count += count;
+
+	if (sub->callback) {
+		sub->callback(sub->callback_arg, ptr, count);
+		return;
+	}
+
+	size_t head = sub->head;
+	size_t tail = thread_atomic_load_acquire_size(&sub->tail);
+
+	while (count > 0) {
+		size_t next = head + TS_PACKET_SIZE;
+		if (next >= sub->buffer_size) {
+			next = 0;
+		}
+		if (next == tail) {
+			sub->overflow_error_count += count;
+			break;
+		}
+
+		memcpy(sub->buffer + head, ptr, TS_PACKET_SIZE);
+		ptr += TS_PACKET_SIZE;
+		head = next;
+		count--;
+	}
+
+	thread_atomic_store_release_size(&sub->head, head);
+}
+
+static void hdhomerun_video_thread_route(struct hdhomerun_video_sock_t *vs, const uint8_t *ptr)
+{
+	struct hdhomerun_video_subscription_t *sub = vs->subscriptions;
+	while (sub) {
+		/* Deliver runs of consecutive matching packets. */
+		const uint8_t *run = NULL;
+		size_t run_count = 0;
+
+		int i;
+		for (i = 0; i < 7; i++) {
+			const uint8_t *pkt = ptr + TS_PACKET_SIZE * i;
+			uint16_t packet_identifier = ((uint16_t)(pkt[1] & 0x1F) << 8) | (uint16_t)pkt[2];
+
+			if (sub->pid_bitmap[packet_identifier >> 3] & (1 << (packet_identifier & 7))) {
+				if (run_count == 0) {
+					run = pkt;
+				}
+				run_count++;
+				continue;
+			}
+
+			if (run_count > 0) {
+				hdhomerun_video_subscription_push(sub, run, run_count);
+				run_count = 0;
+			}
+		}
+
+		if (run_count > 0) {
+			hdhomerun_video_subscription_push(sub, run, run_count);
+		}
+
+		sub = sub->next;
+	}
+}
+
+/*
+ * Store one datagram at head and return the new head. Without stripping the datagram fills one slot (ptr may
+ * already be that slot). With stripping, null packets and packets outside the PID filter are dropped and the
+ * rest are packed into consecutive TS_PACKET_SIZE slots.
+ */
+static size_t hdhomerun_video_thread_put(struct hdhomerun_video_sock_t *vs, size_t head, const uint8_t *ptr, uint64_t timestamp)
+{
+	if (!vs->strip) {
+		uint8_t *head_ptr = vs->buffer + head;
+		if (ptr != head_ptr) {
+			memmove(head_ptr, ptr, VIDEO_DATA_PACKET_SIZE);
+		}
+
+		if (vs->slot_timestamp) {
+			vs->slot_timestamp[head / VIDEO_DATA_PACKET_SIZE] = timestamp;
+		}
+
+		head += VIDEO_DATA_PACKET_SIZE;
+		if (head >= vs->buffer_size) {
+			head -= vs->buffer_size;
+		}
+		return head;
+	}
+
+	int i;
+	for (i = 0; i < 7; i++) {
+		const uint8_t *pkt = ptr + TS_PACKET_SIZE * i;
+		uint16_t packet_identifier = ((uint16_t)(pkt[1] & 0x1F) << 8) | (uint16_t)pkt[2];
+
+		if ((packet_identifier == 0x1FFF) || (vs->strip_pid_filter && !(vs->strip_pid_bitmap[packet_identifier >> 3] & (1 << (packet_identifier & 7))))) {
+			vs->stripped_bytes += TS_PACKET_SIZE;
+			continue;
+		}
+
+		memcpy(vs->buffer + head, pkt, TS_PACKET_SIZE);
+		if (vs->slot_timestamp) {
+			vs->slot_timestamp[head / TS_PACKET_SIZE] = timestamp;
+		}
+
+		head += TS_PACKET_SIZE;
+		if (head >= vs->buffer_size) {
+			head -= vs->buffer_size;
+		}
+	}
+
+	return head;
+}
+
+/*
+ * Reorder path. Datagrams are copied into the ring at head in RTP sequence order.
+ */
+struct hdhomerun_video_reorder_ctx_t {
+	size_t head;
+	size_t free_count;
+	uint64_t current_time;
+	bool route;
+};
+
+static inline uint16_t hdhomerun_video_rtp_sequence(const uint8_t *header)
+{
+	return ((uint16_t)header[2] << 8) | (uint16_t)header[3];
+}
+
+static void hdhomerun_video_reorder_deliver(struct hdhomerun_video_sock_t *vs, struct hdhomerun_video_reorder_ctx_t *ctx, uint8_t *data, uint64_t timestamp)
+{
+	vs->packet_count++;
+	hdhomerun_video_stats_datagram(vs, data);
+
+	if (ctx->route) {
+		hdhomerun_video_thread_route(vs, data);
+	}
+
+	if (ctx->free_count == 0) {
+		hdhomerun_video_thread_overflow(vs);
+		return;
+	}
+
+	if (vs->overflow_resync && !hdhomerun_video_thread_resync(vs, data)) {
+		vs->overflow_error_count++;
+		return;
+	}
+
+	ctx->head = hdhomerun_video_thread_put(vs, ctx->head, data, timestamp);
+	ctx->free_count--;
+}
+
+static void hdhomerun_video_reorder_deliver_rtp(struct hdhomerun_video_sock_t *vs, struct hdhomerun_video_reorder_ctx_t *ctx, uint16_t rtp_sequence, uint8_t *data, uint64_t timestamp)
+{
+	vs->rtp_sequence = rtp_sequence;
+	vs->reorder_history = (vs->reorder_history << 1) | 1;
+	hdhomerun_video_reorder_deliver(vs, ctx, data, timestamp);
+}
+
+static void hdhomerun_video_reorder_gap(struct hdhomerun_video_sock_t *vs)
+{
+	/* Missing data - same handling as an RTP discontinuity without reordering. */
+	vs->network_error_count++;
+	hdhomerun_video_sequence_reset(vs);
+}
+
+/*
+ * Time at which the oldest held datagram times out, or 0 if nothing is held or there is no timeout.
+ */
+static uint64_t hdhomerun_video_reorder_due_time(struct hdhomerun_video_sock_t *vs)
+{
+	if ((vs->reorder_timeout == 0) || (vs->reorder_held_count == 0)) {
+		return 0;
+	}
+
+	uint64_t oldest = 0;
+	uint32_t i;
+	for (i = 0; i <= vs->reorder_mask; i++) {
+		struct hdhomerun_video_reorder_slot_t *slot = &vs->reorder_slot[i];
+		if (slot->valid && ((oldest == 0) || (slot->arrival_time < oldest))) {
+			oldest = slot->arrival_time;
+		}
+	}
+
+	return oldest + vs->reorder_timeout;
+}
+
+static bool hdhomerun_video_reorder_timed_out(struct hdhomerun_video_sock_t *vs, uint64_t current_time)
+{
+	uint64_t due_time = hdhomerun_video_reorder_due_time(vs);
+	return (due_time != 0) && (current_time >= due_time);
+}
+
+/*
+ * Give up on the missing datagrams up to the next held one. Only called with datagrams held.
+ */
+static void hdhomerun_video_reorder_give_up(struct hdhomerun_video_sock_t *vs)
+{
+	hdhomerun_video_reorder_gap(vs);
+	while (1) {
+		uint16_t expected = (uint16_t)(vs->rtp_sequence + 1);
+		struct hdhomerun_video_reorder_slot_t *slot = &vs->reorder_slot[expected & vs->reorder_mask];
+		if (slot->valid && (slot->rtp_sequence == expected)) {
+			return;
+		}
+
+		vs->rtp_sequence = expected;
+		vs->reorder_history <<= 1;
+	}
+}
+
+/*
+ * Release held datagrams that are now in sequence. A gap is given up when force is set or the oldest held
+ * datagram has waited longer than the reorder timeout.
+ */
+static void hdhomerun_video_reorder_drain(struct hdhomerun_video_sock_t *vs, struct hdhomerun_video_reorder_ctx_t *ctx, bool force)
+{
+	while (vs->reorder_held_count > 0) {
+		uint16_t expected = (uint16_t)(vs->rtp_sequence + 1);
+		uint32_t index = expected & vs->reorder_mask;
+		struct hdhomerun_video_reorder_slot_t *slot = &vs->reorder_slot[index];
+
+		if (slot->valid && (slot->rtp_sequence == expected)) {
+			slot->valid = false;
+			vs->reorder_held_count--;
+			hdhomerun_video_reorder_deliver_rtp(vs, ctx, expected, vs->reorder_data + index * VIDEO_DATA_PACKET_SIZE, slot->timestamp);
+			continue;
+		}
+
+		if (!force && !hdhomerun_video_reorder_timed_out(vs, ctx->current_time)) {
+			return;
+		}
+
+		hdhomerun_video_reorder_give_up(vs);
+	}
+}
+
+static void hdhomerun_video_reorder_insert(struct hdhomerun_video_sock_t *vs, struct hdhomerun_video_reorder_ctx_t *ctx, uint16_t rtp_sequence, uint8_t *data, uint64_t timestamp)
+{
+	if (vs->rtp_sequence == 0xFFFFFFFF) {
+		hdhomerun_video_reorder_deliver_rtp(vs, ctx, rtp_sequence, data, timestamp);
+		return;
+	}
+
+	uint16_t expected = (uint16_t)(vs->rtp_sequence + 1);
+	uint16_t ahead = (uint16_t)(rtp_sequence - expected);
+
+	if (ahead >= 0x8000) {
+		uint16_t behind = (uint16_t)(expected - rtp_sequence);
+		if (behind <= 64) {
+			if (vs->reorder_history & ((uint64_t)1 << (behind - 1))) {
+				vs->duplicate_count++;
+			} else {
+				vs->late_drop_count++;
+			}
+			return;
+		}
+
+		/* Far behind - treat as a stream restart. */
+		hdhomerun_video_reorder_drain(vs, ctx, true);
+		hdhomerun_video_reorder_gap(vs);
+		vs->reorder_history = 0;
+		hdhomerun_video_reorder_deliver_rtp(vs, ctx, rtp_sequence, data, timestamp);
+		return;
+	}
+
+	/* Beyond the window - give up on the oldest gaps, one at a time, until it fits. */
+	while (ahead >= vs->reorder_window) {
+		if (vs->reorder_held_count == 0) {
+			hdhomerun_video_reorder_gap(vs);
+			vs->reorder_history = (ahead >= 64) ? 0 : (vs->reorder_history << ahead);
+			vs->rtp_sequence = (uint16_t)(rtp_sequence - 1);
+			ahead = 0;
+			break;
+		}
+
+		hdhomerun_video_reorder_give_up(vs);
+		hdhomerun_video_reorder_drain(vs, ctx, false);
+		expected = (uint16_t)(vs->rtp_sequence + 1);
+		ahead = (uint16_t)(rtp_sequence - expected);
+	}
+
+	if (ahead == 0) {
+		if (vs->reorder_held_count > 0) {
+			vs->reordered_count++;
+		}
+
+		hdhomerun_video_reorder_deliver_rtp(vs, ctx, rtp_sequence, data, timestamp);
+		hdhomerun_video_reorder_drain(vs, ctx, false);
+		return;
+	}
+
+	uint32_t index = rtp_sequence & vs->reorder_mask;
+	struct hdhomerun_video_reorder_slot_t *slot = &vs->reorder_slot[index];
+	if (slot->valid) {
+		vs->duplicate_count++;
+		return;
+	}
+
+	memcpy(vs->reorder_data + index * VIDEO_DATA_PACKET_SIZE, data, VIDEO_DATA_PACKET_SIZE);
+	slot->arrival_time = ctx->current_time;
+	slot->timestamp = timestamp;
+	slot->rtp_sequence = rtp_sequence;
+	slot->valid = true;
+	vs->reorder_held_count++;
+}
+
+static bool hdhomerun_video_reorder_batch_in_order(struct hdhomerun_video_sock_t *vs, struct hdhomerun_sock_recv_msg_t msgs[], size_t count)
+{
+	if (vs->reorder_held_count > 0) {
+		return false;
+	}
+
+	uint32_t expected = vs->rtp_sequence;
+	size_t i;
+	for (i = 0; i < count; i++) {
+		if (msgs[i].length != VIDEO_RTP_DATA_PACKET_SIZE) {
+			continue;
+		}
+
+		uint16_t rtp_sequence = hdhomerun_video_rtp_sequence((const uint8_t *)msgs[i].header);
+		if ((expected != 0xFFFFFFFF) && (rtp_sequence != (uint16_t)(expected + 1))) {
+			return false;
+		}
+
+		expected = rtp_sequence;
+	}
+
+	return true;
+}
+
+static void hdhomerun_video_reorder_batch(struct hdhomerun_video_sock_t *vs, struct hdhomerun_sock_recv_msg_t msgs[], size_t count, struct hdhomerun_video_reorder_ctx_t *ctx)
+{
+	/*
+	 * Copy the whole batch out of the ring into the staging area first so that writing released datagrams
+	 * at head cannot overwrite datagrams that have not been processed yet.
+	 */
+	size_t i;
+	for (i = 0; i < count; i++) {
+		uint8_t *ptr = (uint8_t *)msgs[i].data;
+		uint8_t *staging = vs->recv_discard + (i * VIDEO_DATA_PACKET_SIZE);
+		size_t length = msgs[i].length;
+
+		if (length == VIDEO_RTP_DATA_PACKET_SIZE) {
+			if (ptr != staging) {
+				memcpy(staging, ptr, VIDEO_DATA_PACKET_SIZE);
+			}
+		} else if (length == VIDEO_DATA_PACKET_SIZE) {
+			memmove(staging + VIDEO_RTP_HEADER_SIZE, ptr, VIDEO_DATA_PACKET_SIZE - VIDEO_RTP_HEADER_SIZE);
+			memcpy(staging, msgs[i].header, VIDEO_RTP_HEADER_SIZE);
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		uint8_t *staging = vs->recv_discard + (i * VIDEO_DATA_PACKET_SIZE);
+		size_t length = msgs[i].length;
+
+		if (length == VIDEO_RTP_DATA_PACKET_SIZE) {
+			hdhomerun_video_reorder_insert(vs, ctx, hdhomerun_video_rtp_sequence((const uint8_t *)msgs[i].header), staging, msgs[i].timestamp);
+		} else if (length == VIDEO_DATA_PACKET_SIZE) {
+			/* Plain UDP has no sequence number - release everything held before it. */
+			hdhomerun_video_reorder_drain(vs, ctx, true);
+			hdhomerun_video_reorder_deliver(vs, ctx, staging, msgs[i].timestamp);
+		}
+	}
+
+	/* Enforce the timeout while data is flowing, not only when the socket goes idle. */
+	hdhomerun_video_reorder_drain(vs, ctx, false);
+}
+
+static void hdhomerun_video_thread_reorder_timeout(struct hdhomerun_video_sock_t *vs)
+{
+	struct hdhomerun_video_reorder_ctx_t ctx;
+	ctx.head = vs->head;
+	ctx.free_count = hdhomerun_video_thread_free_count(vs, ctx.head, vs->reorder_held_count, NULL);
+	ctx.current_time = getcurrenttime();
+	ctx.route = (vs->subscription_count > 0);
+
+	if (!hdhomerun_video_reorder_timed_out(vs, ctx.current_time)) {
+		return;
+	}
+
+	hdhomerun_video_thread_stats_begin(vs);
+	if (vs->pid_table) {
+		hdhomerun_video_pid_stats_begin(vs->pid_table);
+	}
+	if (ctx.route) {
+		thread_mutex_lock(&vs->subscription_lock);
+	}
+
+	hdhomerun_video_reorder_drain(vs, &ctx, false);
+
+	if (ctx.route) {
+		thread_mutex_unlock(&vs->subscription_lock);
+	}
+	if (vs->pid_table) {
+		hdhomerun_video_pid_stats_end(vs->pid_table);
+	}
+	hdhomerun_video_thread_stats_end(vs);
+
+	hdhomerun_video_thread_commit(vs, ctx.head);
+}
+
+/*
+ * Receive one batch of datagrams into the ring. Returns the number of datagrams received.
+ */
+static size_t hdhomerun_video_thread_recv_batch(struct hdhomerun_video_sock_t *vs, uint64_t timeout)
+{
+	/*
+	 * Receive directly into the free ring slots following head. Slots still unread by a detach-on-lag reader are
+	 * not received into, so a reader is only detached once hdhomerun_video_thread_store knows the space is needed.
+	 */
+	size_t head = vs->head;
+	size_t lag_free_count;
+	size_t free_count = hdhomerun_video_thread_free_count(vs, head, 0, &lag_free_count);
+	if (lag_free_count < free_count) {
+		free_count = lag_free_count;
+	}
+
+	/* Stripped datagrams are compacted from the discard buffer. */
+	if (vs->strip) {
+		free_count = 0;
+	}
+
+	struct hdhomerun_sock_recv_msg_t msgs[VIDEO_RECV_BATCH_COUNT];
+	size_t slot = head;
+	size_t count;
+	for (count = 0; count < VIDEO_RECV_BATCH_COUNT; count++) {
+		msgs[count].header = vs->recv_header[count];
+		msgs[count].header_length = VIDEO_RTP_HEADER_SIZE;
+		msgs[count].length = VIDEO_DATA_PACKET_SIZE;
+
+		if (count >= free_count) {
+			/* Ring full - receive into the discard buffer. */
+			msgs[count].data = vs->recv_discard + (count * VIDEO_DATA_PACKET_SIZE);
+			continue;
+		}
+
+		msgs[count].data = vs->buffer + slot;
+		slot += VIDEO_DATA_PACKET_SIZE;
+		if (slot >= vs->buffer_size) {
+			slot -= vs->buffer_size;
+		}
+	}
+
+	uint32_t syscall_count;
+	if (!hdhomerun_sock_recv_multiple(vs->sock, msgs, &count, &syscall_count, timeout)) {
+		if (vs->reorder_held_count > 0) {
+			hdhomerun_video_thread_reorder_timeout(vs);
+		}
+		hdhomerun_video_thread_deliver(vs);
+		return 0;
+	}
+
+	hdhomerun_video_thread_store(vs, msgs, count, free_count, syscall_count);
+	return count;
+}
+
+/*
+ * Store received datagrams. Each msg has the first VIDEO_RTP_HEADER_SIZE bytes of the datagram in header and
+ * the rest in data. free_count is the number of msgs known to be in free ring slots at head. syscall_count is
+ * the number of receive calls that returned them.
+ */
+static void hdhomerun_video_thread_store(struct hdhomerun_video_sock_t *vs, struct hdhomerun_sock_recv_msg_t msgs[], size_t count, size_t free_count, uint32_t syscall_count)
+{
+	size_t head = vs->head;
+
+	if (vs->strip_request != vs->strip_ack) {
+		thread_mutex_lock(&vs->lock);
+		vs->strip_ack = vs->strip_request;
+		vs->strip_pid_filter = vs->strip_pending_filter;
+		memcpy(vs->strip_pid_bitmap, vs->strip_pending, HDHOMERUN_VIDEO_PID_BITMAP_SIZE);
+		thread_mutex_unlock(&vs->lock);
+	}
+
+	/* Stats readers spin under lock while stats_seq is odd - do not take lock until stats_end. */
+	hdhomerun_video_thread_stats_begin(vs);
+	vs->recv_syscall_count += syscall_count;
+
+	if (thread_atomic_load_acquire_size(&vs->flush_request) != vs->flush_ack) {
+		hdhomerun_video_thread_flush(vs);
+	}
+
+	/*
+	 * The consumer may have freed space while the receive was blocked. Datagrams in the discard buffer are
+	 * moved into the ring by the loop below. Held datagrams released by the reorder window also need space.
+	 */
+	size_t needed = count + vs->reorder_held_count;
+	if (needed > free_count) {
+		free_count = hdhomerun_video_thread_free_count(vs, head, needed, NULL);
+	}
+
+	if (vs->slot_timestamp) {
+		hdhomerun_video_thread_timestamps(vs, msgs, count);
+	}
+
+	if (vs->pid_table) {
+		hdhomerun_video_pid_stats_begin(vs->pid_table);
+	}
+
+	bool route = (vs->subscription_count > 0);
+	if (route) {
+		thread_mutex_lock(&vs->subscription_lock);
+	}
+
+	size_t store_count = count;
+	if (vs->reorder_window && !hdhomerun_video_reorder_batch_in_order(vs, msgs, count)) {
+		struct hdhomerun_video_reorder_ctx_t ctx;
+		ctx.head = head;
+		ctx.free_count = free_count;
+		ctx.current_time = getcurrenttime();
+		ctx.route = route;
+
+		hdhomerun_video_reorder_batch(vs, msgs, count, &ctx);
+		head = ctx.head;
+		store_count = 0;
+	}
+
+	size_t i;
+	for (i = 0; i < store_count; i++) {
+		uint8_t *ptr = (uint8_t *)msgs[i].data;
+		size_t length = msgs[i].length;
+
+		if (length == VIDEO_RTP_DATA_PACKET_SIZE) {
+			hdhomerun_video_parse_rtp(vs, (const uint8_t *)msgs[i].header);
+		} else if (length == VIDEO_DATA_PACKET_SIZE) {
+			/* Plain UDP - the first bytes of the payload were scattered into the header buffer. */
+			memmove(ptr + VIDEO_RTP_HEADER_SIZE, ptr, VIDEO_DATA_PACKET_SIZE - VIDEO_RTP_HEADER_SIZE);
+			memcpy(ptr, msgs[i].header, VIDEO_RTP_HEADER_SIZE);
+		} else {
+			/* Data received but not valid - ignore. */
+			continue;
+		}
+
+		/* Stats. */
+		vs->packet_count++;
+		hdhomerun_video_stats_datagram(vs, ptr);
+
+		/* Subscribers also receive datagrams that overflow the main ring. */
+		if (route) {
+			hdhomerun_video_thread_route(vs, ptr);
+		}
+
+		/* Check for buffer overflow. */
+		if (i >= free_count) {
+			hdhomerun_video_thread_overflow(vs);
+			continue;
+		}
+
+		if (vs->overflow_resync && !hdhomerun_video_thread_resync(vs, ptr)) {
+			vs->overflow_error_count++;
+			continue;
+		}
+
+		head = hdhomerun_video_thread_put(vs, head, ptr, msgs[i].timestamp);
+	}
+
+	if (route) {
+		thread_mutex_unlock(&vs->subscription_lock);
+	}
+
+	if (vs->pid_table) {
+		hdhomerun_video_pid_stats_end(vs->pid_table);
+	}
+
+	hdhomerun_video_thread_stats_end(vs);
+	hdhomerun_video_thread_commit(vs, head);
+}
+
+/*
+ * Store datagrams received through an io_uring. The datagram is split at VIDEO_RTP_HEADER_SIZE to match the
+ * layout of the recvmmsg path; provided buffers cannot scatter the RTP header so the payload is copied into
+ * the ring by hdhomerun_video_thread_store.
+ */
+static void hdhomerun_video_thread_store_uring(struct hdhomerun_video_sock_t *vs, struct hdhomerun_sock_uring_entry_t entries[], int count)
+{
+	struct hdhomerun_sock_recv_msg_t msgs[VIDEO_RECV_BATCH_COUNT];
+	uint32_t syscall_count = 1;
+
+	int i = 0;
+	while (i < count) {
+		size_t msg_count = 0;
+		while ((i < count) && (msg_count < VIDEO_RECV_BATCH_COUNT)) {
+			struct hdhomerun_sock_recv_msg_t *msg = &msgs[msg_count++];
+			msg->header = entries[i].data;
+			msg->header_length = VIDEO_RTP_HEADER_SIZE;
+			msg->data = entries[i].data + VIDEO_RTP_HEADER_SIZE;
+			msg->length = entries[i].length;
+			msg->timestamp = 0;
+			i++;
+		}
+
+		hdhomerun_video_thread_store(vs, msgs, msg_count, 0, syscall_count);
+		syscall_count = 0;
+	}
+}
+
+static size_t hdhomerun_video_thread_recv_uring(struct hdhomerun_video_sock_t *vs, uint64_t timeout)
+{
+	struct hdhomerun_sock_uring_entry_t entries[VIDEO_URING_ENTRY_COUNT];
+
+	int count = hdhomerun_sock_uring_wait(vs->uring, entries, VIDEO_URING_ENTRY_COUNT, (int64_t)timeout);
+	if (count <= 0) {
+		if (vs->reorder_held_count > 0) {
+			hdhomerun_video_thread_reorder_timeout(vs);
+		}
+		hdhomerun_video_thread_deliver(vs);
+		return 0;
+	}
+
+	hdhomerun_video_thread_store_uring(vs, entries, count);
+	hdhomerun_sock_uring_recycle(vs->uring, entries, count);
+	return (size_t)count;
+}
+
 static void hdhomerun_video_thread_execute(void *arg)
 {
 	struct hdhomerun_video_sock_t *vs = (struct hdhomerun_video_sock_t *)arg;
@@ -336,71 +2144,488 @@ static void hdhomerun_video_thread_execute(void *arg)
 		uint64_t current_time = getcurrenttime();
 		if (vs->keepalive_start || (current_time >= send_time)) {
 			hdhomerun_video_thread_send_keepalive(vs);
-			send_time = current_time + 1000;
+			send_time = current_time + VIDEO_KEEPALIVE_INTERVAL;
+		}
+
+		if (vs->uring) {
+			hdhomerun_video_thread_recv_uring(vs, 25);
+		} else {
+			hdhomerun_video_thread_recv_batch(vs, 25);
+		}
+	}
+}
+
+static void hdhomerun_video_engine_wheel_remove(struct hdhomerun_video_engine_worker_t *worker, struct hdhomerun_video_sock_t *vs)
+{
+	if (!vs->engine_wheel_scheduled) {
+		return;
+	}
+
+	size_t i;
+	for (i = 0; i < VIDEO_ENGINE_WHEEL_SLOTS; i++) {
+		struct hdhomerun_video_sock_t **pprev = &worker->wheel[i];
+		while (*pprev) {
+			if (*pprev == vs) {
+				*pprev = vs->engine_wheel_next;
+				vs->engine_wheel_next = NULL;
+				vs->engine_wheel_scheduled = false;
+				worker->wheel_count--;
+				return;
+			}
+			pprev = &(*pprev)->engine_wheel_next;
+		}
+	}
+}
+
+static void hdhomerun_video_engine_wheel_insert(struct hdhomerun_video_engine_worker_t *worker, struct hdhomerun_video_sock_t *vs, uint64_t current_time, uint64_t delay)
+{
+	if (worker->wheel_count == 0) {
+		worker->wheel_pos = 0;
+		worker->wheel_time = current_time;
+	}
+
+	uint64_t due_time = current_time + delay;
+	uint64_t offset = 0;
+	if (due_time > worker->wheel_time) {
+		offset = (due_time - worker->wheel_time + VIDEO_ENGINE_WHEEL_TICK - 1) / VIDEO_ENGINE_WHEEL_TICK;
+	}
+	if (offset >= VIDEO_ENGINE_WHEEL_SLOTS) {
+		offset = VIDEO_ENGINE_WHEEL_SLOTS - 1;
+	}
+
+	size_t slot = (worker->wheel_pos + (size_t)offset) % VIDEO_ENGINE_WHEEL_SLOTS;
+	vs->engine_wheel_next = worker->wheel[slot];
+	vs->engine_wheel_scheduled = true;
+	vs->engine_wheel_due = due_time;
+	worker->wheel[slot] = vs;
+	worker->wheel_count++;
+}
+
+/*
+ * Earliest timer due for the socket, or 0 if none.
+ */
+static uint64_t hdhomerun_video_engine_due_time(struct hdhomerun_video_sock_t *vs)
+{
+	uint64_t due_time = 0;
+	if (vs->engine_keepalive) {
+		due_time = vs->engine_keepalive_time;
+	}
+
+	uint64_t reorder_due_time = hdhomerun_video_reorder_due_time(vs);
+	if ((reorder_due_time != 0) && ((due_time == 0) || (reorder_due_time < due_time))) {
+		due_time = reorder_due_time;
+	}
+
+	uint64_t deliver_due_time = hdhomerun_video_deliver_due_time(vs);
+	if ((deliver_due_time != 0) && ((due_time == 0) || (deliver_due_time < due_time))) {
+		due_time = deliver_due_time;
+	}
+
+	return due_time;
+}
+
+/*
+ * Schedule the socket's next timer. An entry that fires early is harmless - the due time is recomputed then - so
+ * the socket is only moved when the new due time is earlier than the one it is scheduled for.
+ */
+static void hdhomerun_video_engine_schedule(struct hdhomerun_video_engine_worker_t *worker, struct hdhomerun_video_sock_t *vs, uint64_t current_time)
+{
+	if (vs->engine_detaching) {
+		return;
+	}
+
+	uint64_t due_time = hdhomerun_video_engine_due_time(vs);
+	if (due_time == 0) {
+		return;
+	}
+	if (vs->engine_wheel_scheduled) {
+		if (due_time >= vs->engine_wheel_due) {
+			return;
+		}
+		hdhomerun_video_engine_wheel_remove(worker, vs);
+	}
+
+	uint64_t delay = (due_time > current_time) ? (due_time - current_time) : 0;
+	hdhomerun_video_engine_wheel_insert(worker, vs, current_time, delay);
+}
+
+static void hdhomerun_video_engine_wheel_process(struct hdhomerun_video_engine_worker_t *worker, uint64_t current_time)
+{
+	/* Catch up at most one revolution after a long stall. */
+	size_t remaining = VIDEO_ENGINE_WHEEL_SLOTS;
+
+	while ((worker->wheel_count > 0) && (current_time >= worker->wheel_time) && (remaining-- > 0)) {
+		struct hdhomerun_video_sock_t *list = worker->wheel[worker->wheel_pos];
+		worker->wheel[worker->wheel_pos] = NULL;
+
+		worker->wheel_pos = (worker->wheel_pos + 1) % VIDEO_ENGINE_WHEEL_SLOTS;
+		worker->wheel_time += VIDEO_ENGINE_WHEEL_TICK;
+
+		while (list) {
+			struct hdhomerun_video_sock_t *vs = list;
+			list = vs->engine_wheel_next;
+			vs->engine_wheel_next = NULL;
+			vs->engine_wheel_scheduled = false;
+			worker->wheel_count--;
+
+			if (vs->engine_keepalive && (current_time >= vs->engine_keepalive_time)) {
+				hdhomerun_video_thread_send_keepalive(vs);
+				vs->engine_keepalive_time = current_time + VIDEO_KEEPALIVE_INTERVAL;
+			}
+			if (vs->reorder_held_count > 0) {
+				hdhomerun_video_thread_reorder_timeout(vs);
+			}
+			hdhomerun_video_thread_deliver(vs);
+
+			hdhomerun_video_engine_schedule(worker, vs, current_time);
+		}
+	}
+
+	if (current_time >= worker->wheel_time + VIDEO_ENGINE_WHEEL_TICK) {
+		worker->wheel_time = current_time;
+	}
+}
+
+static int64_t hdhomerun_video_engine_wheel_timeout(struct hdhomerun_video_engine_worker_t *worker, uint64_t current_time)
+{
+	if (worker->wheel_count == 0) {
+		return -1;
+	}
+
+	size_t offset;
+	for (offset = 0; offset < VIDEO_ENGINE_WHEEL_SLOTS; offset++) {
+		if (worker->wheel[(worker->wheel_pos + offset) % VIDEO_ENGINE_WHEEL_SLOTS]) {
+			break;
+		}
+	}
+
+	uint64_t fire_time = worker->wheel_time + (uint64_t)offset * VIDEO_ENGINE_WHEEL_TICK;
+	if (fire_time <= current_time) {
+		return 0;
+	}
+
+	return (int64_t)(fire_time - current_time);
+}
+
+static void hdhomerun_video_engine_worker_process_uring(struct hdhomerun_video_engine_worker_t *worker, struct hdhomerun_sock_uring_entry_t entries[], int count)
+{
+	int i = 0;
+	while (i < count) {
+		if (entries[i].arg == worker) {
+			thread_notify_clear(&worker->notify);
+			i++;
+			continue;
+		}
+
+		/* Consecutive datagrams for the same socket are stored together. */
+		struct hdhomerun_video_sock_t *vs = (struct hdhomerun_video_sock_t *)entries[i].arg;
+		int start = i;
+		while ((i < count) && (entries[i].arg == vs)) {
+			i++;
 		}
 
-		/* Receive. */
-		struct hdhomerun_pkt_t pkt;
-		hdhomerun_pkt_reset(&pkt);
+		if (vs->engine_detaching) {
+			continue;
+		}
+
+		hdhomerun_video_thread_store_uring(vs, &entries[start], i - start);
+		hdhomerun_video_engine_schedule(worker, vs, getcurrenttime());
+	}
+}
 
-		size_t length = VIDEO_RTP_DATA_PACKET_SIZE;
-		if (!hdhomerun_sock_recv(vs->sock, pkt.end, &length, 25)) {
+static void hdhomerun_video_engine_worker_execute(void *arg)
+{
+	struct hdhomerun_video_engine_worker_t *worker = (struct hdhomerun_video_engine_worker_t *)arg;
+	struct hdhomerun_video_engine_t *engine = worker->engine;
+	void *ready[64];
+	struct hdhomerun_sock_uring_entry_t entries[VIDEO_URING_ENTRY_COUNT];
+
+	while (!engine->terminate) {
+		thread_mutex_lock(&worker->lock);
+		int64_t timeout = hdhomerun_video_engine_wheel_timeout(worker, getcurrenttime());
+		thread_mutex_unlock(&worker->lock);
+
+		if (worker->uring) {
+			int count = hdhomerun_sock_uring_wait(worker->uring, entries, VIDEO_URING_ENTRY_COUNT, timeout);
+
+			thread_mutex_lock(&worker->lock);
+			if (count > 0) {
+				hdhomerun_video_engine_worker_process_uring(worker, entries, count);
+				hdhomerun_sock_uring_recycle(worker->uring, entries, count);
+			}
+
+			hdhomerun_video_engine_wheel_process(worker, getcurrenttime());
+
+			worker->generation++;
+			bool detach_pending = (worker->detach_pending > 0);
+			thread_mutex_unlock(&worker->lock);
+
+			if (detach_pending) {
+				thread_cond_signal(&worker->detach_cond);
+			}
 			continue;
 		}
 
-		pkt.end += length;
+		int count = hdhomerun_sock_poll_wait(worker->ps, ready, 64, timeout);
+
+		thread_mutex_lock(&worker->lock);
+
+		int i;
+		for (i = 0; i < count; i++) {
+			if (ready[i] == worker) {
+				thread_notify_clear(&worker->notify);
+				continue;
+			}
+
+			/* Bounded per socket so one busy stream cannot starve the others (level triggered). */
+			struct hdhomerun_video_sock_t *vs = (struct hdhomerun_video_sock_t *)ready[i];
+			if (vs->engine_detaching) {
+				continue;
+			}
+
+			int batch;
+			for (batch = 0; batch < VIDEO_ENGINE_RECV_BATCH_LIMIT; batch++) {
+				if (hdhomerun_video_thread_recv_batch(vs, 0) < VIDEO_RECV_BATCH_COUNT) {
+					break;
+				}
+			}
+
+			hdhomerun_video_engine_schedule(worker, vs, getcurrenttime());
+		}
+
+		hdhomerun_video_engine_wheel_process(worker, getcurrenttime());
+
+		worker->generation++;
+		bool detach_pending = (worker->detach_pending > 0);
+		thread_mutex_unlock(&worker->lock);
+
+		if (detach_pending) {
+			thread_cond_signal(&worker->detach_cond);
+		}
+	}
+}
+
+struct hdhomerun_video_engine_t *hdhomerun_video_engine_create(uint32_t worker_count, struct hdhomerun_debug_t *dbg)
+{
+	return hdhomerun_video_engine_create_ex(worker_count, 0, dbg);
+}
+
+struct hdhomerun_video_engine_t *hdhomerun_video_engine_create_ex(uint32_t worker_count, uint32_t flags, struct hdhomerun_debug_t *dbg)
+{
+	if (worker_count == 0) {
+		worker_count = 1;
+	}
+	if (worker_count > VIDEO_ENGINE_WORKER_MAX) {
+		worker_count = VIDEO_ENGINE_WORKER_MAX;
+	}
+
+	struct hdhomerun_video_engine_t *engine = (struct hdhomerun_video_engine_t *)calloc(1, sizeof(struct hdhomerun_video_engine_t));
+	if (!engine) {
+		hdhomerun_debug_printf(dbg, "hdhomerun_video_engine_create: failed to allocate engine object\n");
+		return NULL;
+	}
+
+	engine->dbg = dbg;
+
+	engine->workers = (struct hdhomerun_video_engine_worker_t *)calloc(worker_count, sizeof(struct hdhomerun_video_engine_worker_t));
+	if (!engine->workers) {
+		hdhomerun_debug_printf(dbg, "hdhomerun_video_engine_create: failed to allocate workers\n");
+		free(engine);
+		return NULL;
+	}
+
+	uint32_t i;
+	for (i = 0; i < worker_count; i++) {
+		struct hdhomerun_video_engine_worker_t *worker = &engine->workers[i];
+		worker->engine = engine;
+		thread_mutex_init(&worker->lock);
+		thread_cond_init(&worker->detach_cond);
+		engine->worker_count++;
+
+		worker->notify_valid = thread_notify_init(&worker->notify);
+		if (!worker->notify_valid) {
+			hdhomerun_debug_printf(dbg, "hdhomerun_video_engine_create: failed to create notify\n");
+			goto error;
+		}
+
+		if (flags & HDHOMERUN_VIDEO_ENGINE_OPTION_IO_URING) {
+			worker->uring = hdhomerun_sock_uring_create(64);
+			if (worker->uring && !hdhomerun_sock_uring_add_notify(worker->uring, thread_notify_get_handle(&worker->notify), worker)) {
+				hdhomerun_sock_uring_destroy(worker->uring);
+				worker->uring = NULL;
+			}
+			if (!worker->uring) {
+				hdhomerun_debug_printf(dbg, "hdhomerun_video_engine_create: io_uring receive not available, using epoll\n");
+				flags &= ~HDHOMERUN_VIDEO_ENGINE_OPTION_IO_URING;
+			}
+		}
+
+		if (!worker->uring) {
+			worker->ps = hdhomerun_sock_poll_create();
+			if (!worker->ps) {
+				hdhomerun_debug_printf(dbg, "hdhomerun_video_engine_create: socket poll not supported\n");
+				goto error;
+			}
+
+			if (!hdhomerun_sock_poll_add_notify(worker->ps, thread_notify_get_handle(&worker->notify), worker)) {
+				hdhomerun_debug_printf(dbg, "hdhomerun_video_engine_create: failed to register notify\n");
+				goto error;
+			}
+		}
+
+		struct thread_task_attr_t thread_attr;
+		memset(&thread_attr, 0, sizeof(thread_attr));
+		thread_attr.name = "hdhr-engine";
+
+		if (!thread_task_create_ex(&worker->thread, &hdhomerun_video_engine_worker_execute, worker, &thread_attr)) {
+			hdhomerun_debug_printf(dbg, "hdhomerun_video_engine_create: failed to start thread\n");
+			goto error;
+		}
+
+		worker->thread_started = true;
+	}
+
+	return engine;
+
+error:
+	hdhomerun_video_engine_destroy(engine);
+	return NULL;
+}
+
+void hdhomerun_video_engine_destroy(struct hdhomerun_video_engine_t *engine)
+{
+	engine->terminate = true;
+
+	uint32_t i;
+	for (i = 0; i < engine->worker_count; i++) {
+		struct hdhomerun_video_engine_worker_t *worker = &engine->workers[i];
+
+		if (worker->thread_started) {
+			thread_notify_signal(&worker->notify);
+			thread_task_join(worker->thread);
+		}
+
+		if (worker->notify_valid) {
+			thread_notify_dispose(&worker->notify);
+		}
+
+		if (worker->uring) {
+			hdhomerun_sock_uring_destroy(worker->uring);
+		}
+
+		if (worker->ps) {
+			hdhomerun_sock_poll_destroy(worker->ps);
+		}
+
+		thread_cond_dispose(&worker->detach_cond);
+		thread_mutex_dispose(&worker->lock);
+	}
+
+	free(engine->workers);
+	free(engine);
+}
+
+static bool hdhomerun_video_engine_attach(struct hdhomerun_video_engine_t *engine, struct hdhomerun_video_sock_t *vs)
+{
+	/* Least loaded worker. The count is only a balancing hint so it is read without the worker locks. */
+	struct hdhomerun_video_engine_worker_t *worker = &engine->workers[0];
+	uint32_t i;
+	for (i = 1; i < engine->worker_count; i++) {
+		if (engine->workers[i].sock_count < worker->sock_count) {
+			worker = &engine->workers[i];
+		}
+	}
+
+	thread_mutex_lock(&worker->lock);
+
+	bool success;
+	if (worker->uring) {
+		success = hdhomerun_sock_uring_add(worker->uring, vs->sock, vs, VIDEO_URING_BUFFER_COUNT, VIDEO_RTP_DATA_PACKET_SIZE);
+	} else {
+		success = hdhomerun_sock_poll_add(worker->ps, vs->sock, vs);
+	}
+
+	if (!success) {
+		thread_mutex_unlock(&worker->lock);
+		return false;
+	}
+
+	vs->engine_worker = worker;
+	worker->sock_count++;
+
+	thread_mutex_unlock(&worker->lock);
+	return true;
+}
+
+static void hdhomerun_video_engine_detach(struct hdhomerun_video_sock_t *vs)
+{
+	struct hdhomerun_video_engine_worker_t *worker = vs->engine_worker;
 
-		if (length == VIDEO_RTP_DATA_PACKET_SIZE) {
-			hdhomerun_video_parse_rtp(vs, &pkt);
-			length = pkt.end - pkt.pos;
+	thread_mutex_lock(&worker->lock);
+	if (worker->uring) {
+		hdhomerun_sock_uring_remove(worker->uring, vs->sock);
+	} else {
+		hdhomerun_sock_poll_remove(worker->ps, vs->sock);
+	}
+	/* A poll cycle already returned may still name the socket; it is skipped and not rescheduled once flagged. */
+	vs->engine_detaching = true;
+	hdhomerun_video_engine_wheel_remove(worker, vs);
+	worker->sock_count--;
+	worker->detach_pending++;
+	uint32_t generation = worker->generation;
+	thread_mutex_unlock(&worker->lock);
+
+	/* Wait for the worker to finish any poll cycle that may still reference this socket. */
+	thread_notify_signal(&worker->notify);
+	while (1) {
+		thread_mutex_lock(&worker->lock);
+		bool done = (worker->generation != generation);
+		if (done) {
+			worker->detach_pending--;
 		}
+		thread_mutex_unlock(&worker->lock);
 
-		if (length != VIDEO_DATA_PACKET_SIZE) {
-			/* Data received but not valid - ignore. */
-			continue;
+		if (done) {
+			break;
 		}
 
-		thread_mutex_lock(&vs->lock);
-
-		/* Store in ring buffer. */
-		size_t head = vs->head;
-		uint8_t *ptr = vs->buffer + head;
-		memcpy(ptr, pkt.pos, length);
+		thread_cond_wait_with_timeout(&worker->detach_cond, 10);
+	}
 
-		/* Stats. */
-		vs->packet_count++;
-		hdhomerun_video_stats_ts_pkt(vs, ptr + TS_PACKET_SIZE * 0);
-		hdhomerun_video_stats_ts_pkt(vs, ptr + TS_PACKET_SIZE * 1);
-		hdhomerun_video_stats_ts_pkt(vs, ptr + TS_PACKET_SIZE * 2);
-		hdhomerun_video_stats_ts_pkt(vs, ptr + TS_PACKET_SIZE * 3);
-		hdhomerun_video_stats_ts_pkt(vs, ptr + TS_PACKET_SIZE * 4);
-		hdhomerun_video_stats_ts_pkt(vs, ptr + TS_PACKET_SIZE * 5);
-		hdhomerun_video_stats_ts_pkt(vs, ptr + TS_PACKET_SIZE * 6);
-
-		/* Calculate new head. */
-		head += length;
-		if (head >= vs->buffer_size) {
-			head -= vs->buffer_size;
-		}
+	vs->engine_worker = NULL;
+}
 
-		/* Check for buffer overflow. */
-		if (head == vs->tail) {
-			vs->overflow_error_count++;
-			thread_mutex_unlock(&vs->lock);
-			continue;
-		}
+static void hdhomerun_video_engine_keepalive_changed(struct hdhomerun_video_sock_t *vs, bool enabled)
+{
+	struct hdhomerun_video_engine_worker_t *worker = vs->engine_worker;
 
-		vs->head = head;
+	thread_mutex_lock(&worker->lock);
+	uint64_t current_time = getcurrenttime();
+	hdhomerun_video_engine_wheel_remove(worker, vs);
+	vs->engine_keepalive = enabled;
+	vs->engine_keepalive_time = current_time;
+	hdhomerun_video_engine_schedule(worker, vs, current_time);
+	thread_mutex_unlock(&worker->lock);
 
-		thread_mutex_unlock(&vs->lock);
-	}
+	thread_notify_signal(&worker->notify);
 }
 
-uint8_t *hdhomerun_video_recv(struct hdhomerun_video_sock_t *vs, size_t max_size, size_t *pactual_size)
+static void hdhomerun_video_engine_reschedule(struct hdhomerun_video_sock_t *vs)
 {
-	thread_mutex_lock(&vs->lock);
+	struct hdhomerun_video_engine_worker_t *worker = vs->engine_worker;
 
-	size_t head = vs->head;
+	thread_mutex_lock(&worker->lock);
+	hdhomerun_video_engine_schedule(worker, vs, getcurrenttime());
+	thread_mutex_unlock(&worker->lock);
+
+	thread_notify_signal(&worker->notify);
+}
+
+/*
+ * Release data returned by the previous recv call and apply any pending drop-oldest request or flush.
+ */
+static size_t hdhomerun_video_release(struct hdhomerun_video_sock_t *vs)
+{
 	size_t tail = vs->tail;
 
 	if (vs->advance > 0) {
@@ -408,28 +2633,76 @@ uint8_t *hdhomerun_video_recv(struct hdhomerun_video_sock_t *vs, size_t max_size
 		if (tail >= vs->buffer_size) {
 			tail -= vs->buffer_size;
 		}
-	
-		vs->tail = tail;
+
+		vs->advance = 0;
+		thread_atomic_store_release_size(&vs->tail, tail);
+	}
+
+	size_t skip_request = thread_atomic_load_acquire_size(&vs->skip_request);
+	if (skip_request != vs->skip_ack) {
+		/* Only move forward - data past skip_position may already have been returned since the request. */
+		size_t skip_position = vs->skip_position;
+		size_t skip_size = hdhomerun_video_used_size(vs, skip_position, tail);
+		size_t head = thread_atomic_load_acquire_size(&vs->head);
+		if (skip_size <= hdhomerun_video_used_size(vs, head, tail)) {
+			vs->skip_count += (uint32_t)((skip_size + VIDEO_DATA_PACKET_SIZE - 1) / VIDEO_DATA_PACKET_SIZE);
+			tail = skip_position;
+			thread_atomic_store_release_size(&vs->tail, tail);
+		}
+
+		thread_atomic_store_release_size(&vs->skip_ack, skip_request);
+	}
+
+	size_t flush_ack = thread_atomic_load_acquire_size(&vs->flush_ack);
+	if (flush_ack != vs->flush_ack_seen) {
+		vs->flush_ack_seen = flush_ack;
+
+		/* Only move forward - data up to tail may already have been returned since the flush. */
+		size_t flush_position = vs->flush_position;
+		size_t head = thread_atomic_load_acquire_size(&vs->head);
+		if (hdhomerun_video_used_size(vs, flush_position, tail) <= hdhomerun_video_used_size(vs, head, tail)) {
+			tail = flush_position;
+			thread_atomic_store_release_size(&vs->tail, tail);
+		}
 	}
 
+	return tail;
+}
+
+static uint8_t *hdhomerun_video_recv_internal(struct hdhomerun_video_sock_t *vs, size_t size, size_t *pactual_size)
+{
+	size_t tail = hdhomerun_video_release(vs);
+	size_t head = thread_atomic_load_acquire_size(&vs->head);
+
 	if (head == tail) {
 		vs->advance = 0;
 		*pactual_size = 0;
-		thread_mutex_unlock(&vs->lock);
+
+		if (vs->notify_enabled) {
+			/* Re-arm the notify handle then re-check for data that arrived while arming. */
+			thread_notify_clear(&vs->notify);
+			vs->notify_armed = true;
+			thread_atomic_fence();
+			if (vs->head != tail) {
+				thread_notify_signal(&vs->notify);
+			}
+		}
+
 		return NULL;
 	}
 
-	size_t size = (max_size / VIDEO_DATA_PACKET_SIZE) * VIDEO_DATA_PACKET_SIZE;
 	if (size == 0) {
 		vs->advance = 0;
 		*pactual_size = 0;
-		thread_mutex_unlock(&vs->lock);
 		return NULL;
 	}
 
 	size_t avail;
 	if (head > tail) {
 		avail = head - tail;
+	} else if (vs->buffer_mirrored) {
+		/* The second mapping makes the wrapped data contiguous. */
+		avail = vs->buffer_size - tail + head;
 	} else {
 		avail = vs->buffer_size - tail;
 	}
@@ -438,58 +2711,531 @@ uint8_t *hdhomerun_video_recv(struct hdhomerun_video_sock_t *vs, size_t max_size
 	}
 	vs->advance = size;
 	*pactual_size = size;
-	uint8_t *result = vs->buffer + tail;
+	return vs->buffer + tail;
+}
 
-	thread_mutex_unlock(&vs->lock);
-	return result;
+uint8_t *hdhomerun_video_recv(struct hdhomerun_video_sock_t *vs, size_t max_size, size_t *pactual_size)
+{
+	return hdhomerun_video_recv_internal(vs, (max_size / vs->slot_size) * vs->slot_size, pactual_size);
 }
 
-void hdhomerun_video_flush(struct hdhomerun_video_sock_t *vs)
+uint8_t *hdhomerun_video_recv_ts(struct hdhomerun_video_sock_t *vs, size_t max_size, size_t *pactual_size)
 {
-	thread_mutex_lock(&vs->lock);
+	return hdhomerun_video_recv_internal(vs, (max_size / TS_PACKET_SIZE) * TS_PACKET_SIZE, pactual_size);
+}
 
-	vs->tail = vs->head;
-	vs->advance = 0;
+uint8_t *hdhomerun_video_recv_ex(struct hdhomerun_video_sock_t *vs, size_t max_size, size_t *pactual_size, uint64_t timestamps[])
+{
+	uint8_t *ptr = hdhomerun_video_recv(vs, max_size, pactual_size);
+	if (!ptr) {
+		return NULL;
+	}
 
-	vs->rtp_sequence = 0xFFFFFFFF;
+	size_t count = *pactual_size / vs->slot_size;
+	if (!vs->slot_timestamp) {
+		memset(timestamps, 0, count * sizeof(uint64_t));
+		return ptr;
+	}
 
-	int i;
-	for (i = 0; i < 0x2000; i++) {
-		vs->sequence[i] = 0xFF;
+	/* Data returned through the second view of a mirrored buffer wraps in the timestamp array. */
+	size_t slot_count = vs->buffer_size / vs->slot_size;
+	size_t slot = (size_t)(ptr - vs->buffer) / vs->slot_size;
+
+	size_t i;
+	for (i = 0; i < count; i++) {
+		timestamps[i] = vs->slot_timestamp[slot];
+		slot++;
+		if (slot >= slot_count) {
+			slot = 0;
+		}
+	}
+
+	return ptr;
+}
+
+uint8_t *hdhomerun_video_recv_wait(struct hdhomerun_video_sock_t *vs, size_t max_size, size_t min_size, uint64_t timeout, size_t *pactual_size)
+{
+	/* Release data returned by the previous call so it does not count towards min_size. */
+	size_t tail = hdhomerun_video_release(vs);
+
+	size_t slot_size = vs->slot_size;
+	size_t max_wait_size = (max_size / slot_size) * slot_size;
+	if (max_wait_size > vs->buffer_size - slot_size) {
+		max_wait_size = vs->buffer_size - slot_size;
+	}
+
+	size_t wait_size = ((min_size + slot_size - 1) / slot_size) * slot_size;
+	if (wait_size < slot_size) {
+		wait_size = slot_size;
+	}
+	if (wait_size > max_wait_size) {
+		wait_size = max_wait_size;
+	}
+
+	uint64_t stop_time = getcurrenttime() + timeout;
+
+	while (wait_size > 0) {
+		size_t head = thread_atomic_load_acquire_size(&vs->head);
+		if (hdhomerun_video_used_size(vs, head, tail) >= wait_size) {
+			break;
+		}
+
+		vs->wait_size = wait_size;
+		thread_atomic_fence();
+
+		head = thread_atomic_load_acquire_size(&vs->head);
+		if (hdhomerun_video_used_size(vs, head, tail) >= wait_size) {
+			vs->wait_size = 0;
+			break;
+		}
+
+		uint64_t current_time = getcurrenttime();
+		if (current_time >= stop_time) {
+			vs->wait_size = 0;
+			break;
+		}
+
+		thread_cond_wait_with_timeout(&vs->wait_cond, stop_time - current_time);
+		vs->wait_size = 0;
+	}
+
+	return hdhomerun_video_recv(vs, max_size, pactual_size);
+}
+
+thread_notify_handle_t hdhomerun_video_get_notify_handle(struct hdhomerun_video_sock_t *vs)
+{
+	if (!vs->notify_valid) {
+		return THREAD_NOTIFY_HANDLE_INVALID;
+	}
+
+	if (!vs->notify_enabled) {
+		vs->notify_enabled = true;
+		vs->notify_armed = true;
+		thread_atomic_fence();
+		if (vs->head != vs->tail) {
+			thread_notify_signal(&vs->notify);
+		}
+	}
+
+	return thread_notify_get_handle(&vs->notify);
+}
+
+struct hdhomerun_video_subscription_t *hdhomerun_video_subscribe(struct hdhomerun_video_sock_t *vs, const uint8_t pid_bitmap[HDHOMERUN_VIDEO_PID_BITMAP_SIZE], size_t buffer_size, hdhomerun_video_subscribe_callback_t callback, void *callback_arg)
+{
+	struct hdhomerun_video_subscription_t *sub = (struct hdhomerun_video_subscription_t *)calloc(1, sizeof(struct hdhomerun_video_subscription_t));
+	if (!sub) {
+		hdhomerun_debug_printf(vs->dbg, "hdhomerun_video_subscribe: failed to allocate subscription\n");
+		return NULL;
+	}
+
+	memcpy(sub->pid_bitmap, pid_bitmap, HDHOMERUN_VIDEO_PID_BITMAP_SIZE);
+	sub->callback = callback;
+	sub->callback_arg = callback_arg;
+
+	if (!callback) {
+		sub->buffer_size = (buffer_size / TS_PACKET_SIZE) * TS_PACKET_SIZE;
+		if (sub->buffer_size == 0) {
+			hdhomerun_debug_printf(vs->dbg, "hdhomerun_video_subscribe: invalid buffer size (%lu bytes)\n", (unsigned long)buffer_size);
+			free(sub);
+			return NULL;
+		}
+		sub->buffer_size += TS_PACKET_SIZE;
+
+		sub->buffer = (uint8_t *)malloc(sub->buffer_size);
+		if (!sub->buffer) {
+			hdhomerun_debug_printf(vs->dbg, "hdhomerun_video_subscribe: failed to allocate buffer (%lu bytes)\n", (unsigned long)sub->buffer_size);
+			free(sub);
+			return NULL;
+		}
+	}
+
+	thread_mutex_lock(&vs->subscription_lock);
+	sub->next = vs->subscriptions;
+	vs->subscriptions = sub;
+	vs->subscription_count++;
+	thread_mutex_unlock(&vs->subscription_lock);
+
+	return sub;
+}
+
+void hdhomerun_video_unsubscribe(struct hdhomerun_video_sock_t *vs, struct hdhomerun_video_subscription_t *sub)
+{
+	thread_mutex_lock(&vs->subscription_lock);
+
+	struct hdhomerun_video_subscription_t **pprev = &vs->subscriptions;
+	while (*pprev) {
+		if (*pprev == sub) {
+			*pprev = sub->next;
+			vs->subscription_count--;
+			break;
+		}
+		pprev = &(*pprev)->next;
+	}
+
+	thread_mutex_unlock(&vs->subscription_lock);
+
+	/* The receive thread holds subscription_lock while routing so it can no longer reference sub. */
+	free(sub->buffer);
+	free(sub);
+}
+
+uint8_t *hdhomerun_video_subscription_recv(struct hdhomerun_video_subscription_t *sub, size_t max_size, size_t *pactual_size)
+{
+	size_t head = thread_atomic_load_acquire_size(&sub->head);
+	size_t tail = sub->tail;
+
+	if (sub->advance > 0) {
+		tail += sub->advance;
+		if (tail >= sub->buffer_size) {
+			tail -= sub->buffer_size;
+		}
+
+		thread_atomic_store_release_size(&sub->tail, tail);
+	}
+
+	size_t size = (max_size / TS_PACKET_SIZE) * TS_PACKET_SIZE;
+	if ((head == tail) || (size == 0)) {
+		sub->advance = 0;
+		*pactual_size = 0;
+		return NULL;
+	}
+
+	size_t avail;
+	if (head > tail) {
+		avail = head - tail;
+	} else {
+		avail = sub->buffer_size - tail;
+	}
+	if (size > avail) {
+		size = avail;
+	}
+
+	sub->advance = size;
+	*pactual_size = size;
+	return sub->buffer + tail;
+}
+
+void hdhomerun_video_subscription_get_stats(struct hdhomerun_video_subscription_t *sub, uint64_t *ppacket_count, uint64_t *poverflow_error_count)
+{
+	*ppacket_count = sub->packet_count;
+	*poverflow_error_count = sub->overflow_error_count;
+}
+
+struct hdhomerun_video_reader_t *hdhomerun_video_reader_create(struct hdhomerun_video_sock_t *vs, uint32_t flags)
+{
+	struct hdhomerun_video_reader_t *reader = (struct hdhomerun_video_reader_t *)calloc(1, sizeof(struct hdhomerun_video_reader_t));
+	if (!reader) {
+		hdhomerun_debug_printf(vs->dbg, "hdhomerun_video_reader_create: failed to allocate reader\n");
+		return NULL;
+	}
+
+	reader->vs = vs;
+	reader->flags = flags;
+
+	/* The receive thread sees the reader from its next batch; data it is writing now lands after head. */
+	thread_mutex_lock(&vs->reader_lock);
+	reader->tail = thread_atomic_load_acquire_size(&vs->head);
+	reader->next = vs->readers;
+	vs->readers = reader;
+	vs->reader_count++;
+	thread_mutex_unlock(&vs->reader_lock);
+
+	return reader;
+}
+
+void hdhomerun_video_reader_destroy(struct hdhomerun_video_reader_t *reader)
+{
+	struct hdhomerun_video_sock_t *vs = reader->vs;
+
+	thread_mutex_lock(&vs->reader_lock);
+
+	struct hdhomerun_video_reader_t **pprev = &vs->readers;
+	while (*pprev) {
+		if (*pprev == reader) {
+			*pprev = reader->next;
+			vs->reader_count--;
+			break;
+		}
+		pprev = &(*pprev)->next;
+	}
+
+	thread_mutex_unlock(&vs->reader_lock);
+
+	/* The receive thread holds reader_lock while reading reader tails so it can no longer reference reader. */
+	free(reader);
+}
+
+uint8_t *hdhomerun_video_reader_recv(struct hdhomerun_video_reader_t *reader, size_t max_size, size_t *pactual_size)
+{
+	struct hdhomerun_video_sock_t *vs = reader->vs;
+	size_t tail = reader->tail;
+
+	if (reader->advance > 0) {
+		tail += reader->advance;
+		if (tail >= vs->buffer_size) {
+			tail -= vs->buffer_size;
+		}
+
+		reader->advance = 0;
+		thread_atomic_store_release_size(&reader->tail, tail);
+	}
+
+	size_t head = thread_atomic_load_acquire_size(&vs->head);
+	size_t size = (max_size / vs->slot_size) * vs->slot_size;
+	if ((head == tail) || (size == 0) || reader->detached) {
+		*pactual_size = 0;
+		return NULL;
+	}
+
+	size_t avail;
+	if (head > tail) {
+		avail = head - tail;
+	} else if (vs->buffer_mirrored) {
+		avail = vs->buffer_size - tail + head;
+	} else {
+		avail = vs->buffer_size - tail;
+	}
+	if (size > avail) {
+		size = avail;
+	}
+
+	reader->advance = size;
+	*pactual_size = size;
+	return vs->buffer + tail;
+}
+
+void hdhomerun_video_reader_flush(struct hdhomerun_video_reader_t *reader)
+{
+	struct hdhomerun_video_sock_t *vs = reader->vs;
+
+	thread_mutex_lock(&vs->reader_lock);
+	reader->advance = 0;
+	thread_atomic_store_release_size(&reader->tail, thread_atomic_load_acquire_size(&vs->head));
+	reader->detached = false;
+	thread_mutex_unlock(&vs->reader_lock);
+}
+
+bool hdhomerun_video_reader_is_detached(struct hdhomerun_video_reader_t *reader)
+{
+	return reader->detached;
+}
+
+/*
+ * Read the receive thread counters as of the end of a batch.
+ */
+static void hdhomerun_video_counters_snapshot(struct hdhomerun_video_sock_t *vs, struct hdhomerun_video_counters_t *counters)
+{
+	while (1) {
+		size_t seq = thread_atomic_load_acquire_size(&vs->stats_seq);
+		if (seq & 1) {
+			thread_yield();
+			continue;
+		}
+
+		counters->packet_count = vs->packet_count;
+		counters->transport_error_count = vs->transport_error_count;
+		counters->network_error_count = vs->network_error_count;
+		counters->sequence_error_count = vs->sequence_error_count;
+		counters->overflow_error_count = vs->overflow_error_count;
+		counters->recv_syscall_count = vs->recv_syscall_count;
+		counters->reordered_count = vs->reordered_count;
+		counters->late_drop_count = vs->late_drop_count;
+		counters->duplicate_count = vs->duplicate_count;
+		counters->stripped_bytes = vs->stripped_bytes;
+
+		int bucket;
+		for (bucket = 0; bucket < HDHOMERUN_VIDEO_JITTER_BUCKETS; bucket++) {
+			counters->jitter_histogram[bucket] = vs->jitter_histogram[bucket];
+		}
+
+		thread_atomic_fence();
+		if (vs->stats_seq == seq) {
+			break;
+		}
 	}
 
-	vs->packet_count = 0;
-	vs->transport_error_count = 0;
-	vs->network_error_count = 0;
-	vs->sequence_error_count = 0;
-	vs->overflow_error_count = 0;
+	/* Datagrams discarded by the consumer for HDHOMERUN_VIDEO_OVERFLOW_DROP_OLDEST. */
+	counters->overflow_error_count += vs->skip_count;
+}
+
+void hdhomerun_video_flush(struct hdhomerun_video_sock_t *vs)
+{
+	/* Discard what has been committed so far; the receive thread discards the rest of its batch (see flush_ack). */
+	hdhomerun_video_release(vs);
+	size_t head = thread_atomic_load_acquire_size(&vs->head);
+	thread_atomic_store_release_size(&vs->tail, head);
+	vs->advance = 0;
+	thread_atomic_store_release_size(&vs->skip_ack, thread_atomic_load_acquire_size(&vs->skip_request));
 
+	thread_mutex_lock(&vs->lock);
+	hdhomerun_video_counters_snapshot(vs, &vs->stats_baseline);
 	thread_mutex_unlock(&vs->lock);
+
+	/* Sequence tracking is owned by the receive thread - request a reset. */
+	thread_atomic_store_release_size(&vs->flush_request, vs->flush_request + 1);
 }
 
 void hdhomerun_video_debug_print_stats(struct hdhomerun_video_sock_t *vs)
 {
 	struct hdhomerun_video_stats_t stats;
-	hdhomerun_video_get_stats(vs, &stats);
+	hdhomerun_video_get_stats_ex(vs, &stats, sizeof(stats));
 
-	hdhomerun_debug_printf(vs->dbg, "video sock: pkt=%u net=%u te=%u miss=%u drop=%u\n",
+	hdhomerun_debug_printf(vs->dbg, "video sock: pkt=%u net=%u te=%u miss=%u drop=%u recv=%u reorder=%u late=%u dup=%u\n",
 		(unsigned int)stats.packet_count, (unsigned int)stats.network_error_count,
 		(unsigned int)stats.transport_error_count, (unsigned int)stats.sequence_error_count,
-		(unsigned int)stats.overflow_error_count
+		(unsigned int)stats.overflow_error_count, (unsigned int)stats.recv_syscall_count,
+		(unsigned int)stats.reordered_count, (unsigned int)stats.late_drop_count, (unsigned int)stats.duplicate_count
 	);
 }
 
+size_t hdhomerun_video_get_pid_stats(struct hdhomerun_video_sock_t *vs, struct hdhomerun_video_pid_stats_t stats[], size_t max_count)
+{
+	struct hdhomerun_video_pid_table_t *table = vs->pid_table;
+	if (!table) {
+		return 0;
+	}
+
+	uint64_t current_time = getcurrenttime();
+
+	while (1) {
+		size_t seq = thread_atomic_load_acquire_size(&table->seq);
+		if (seq & 1) {
+			thread_yield();
+			continue;
+		}
+
+		size_t count = table->active_count;
+		if (count > max_count) {
+			count = max_count;
+		}
+
+		size_t i;
+		for (i = 0; i < count; i++) {
+			const struct hdhomerun_video_pid_entry_t *entry = &table->entries[i];
+			stats[i].pid = entry->pid;
+			stats[i].packet_count = entry->packet_count;
+			stats[i].transport_error_count = entry->transport_error_count;
+			stats[i].sequence_error_count = entry->sequence_error_count;
+			stats[i].scrambled_count = entry->scrambled_count;
+			stats[i].bitrate = entry->bitrate;
+
+			/* The average is only folded while data arrives - a PID not seen for a whole window has no rate. */
+			if (current_time > entry->last_seen_time + VIDEO_PID_BITRATE_WINDOW) {
+				stats[i].bitrate = 0;
+			}
+		}
+
+		thread_atomic_fence();
+		if (table->seq == seq) {
+			return count;
+		}
+	}
+}
+
 void hdhomerun_video_get_stats(struct hdhomerun_video_sock_t *vs, struct hdhomerun_video_stats_t *stats)
 {
-	memset(stats, 0, sizeof(struct hdhomerun_video_stats_t));
+	hdhomerun_video_get_stats_ex(vs, stats, HDHOMERUN_VIDEO_STATS_SIZE_V1);
+}
 
+void hdhomerun_video_get_stats_ex(struct hdhomerun_video_sock_t *vs, struct hdhomerun_video_stats_t *stats, size_t stats_size)
+{
+	/* Snapshot under lock so a concurrent flush cannot move the baseline past the snapshot. */
+	struct hdhomerun_video_counters_t counters;
 	thread_mutex_lock(&vs->lock);
+	hdhomerun_video_counters_snapshot(vs, &counters);
+	struct hdhomerun_video_counters_t baseline = vs->stats_baseline;
+	thread_mutex_unlock(&vs->lock);
+
+	struct hdhomerun_video_stats_t current;
+	memset(&current, 0, sizeof(current));
+
+	current.packet_count = counters.packet_count - baseline.packet_count;
+	current.network_error_count = counters.network_error_count - baseline.network_error_count;
+	current.transport_error_count = counters.transport_error_count - baseline.transport_error_count;
+	current.sequence_error_count = counters.sequence_error_count - baseline.sequence_error_count;
+	current.overflow_error_count = counters.overflow_error_count - baseline.overflow_error_count;
+	current.recv_syscall_count = counters.recv_syscall_count - baseline.recv_syscall_count;
+	current.reordered_count = counters.reordered_count - baseline.reordered_count;
+	current.late_drop_count = counters.late_drop_count - baseline.late_drop_count;
+	current.duplicate_count = counters.duplicate_count - baseline.duplicate_count;
+	current.stripped_bytes = counters.stripped_bytes - baseline.stripped_bytes;
+
+	int bucket;
+	for (bucket = 0; bucket < HDHOMERUN_VIDEO_JITTER_BUCKETS; bucket++) {
+		current.jitter_histogram[bucket] = counters.jitter_histogram[bucket] - baseline.jitter_histogram[bucket];
+	}
+
+	/* A caller built against a newer header may pass a larger structure. */
+	if (stats_size > sizeof(current)) {
+		memset((uint8_t *)stats + sizeof(current), 0, stats_size - sizeof(current));
+		stats_size = sizeof(current);
+	}
+	memcpy(stats, &current, stats_size);
+}
+
+struct hdhomerun_psi_t *hdhomerun_video_get_psi(struct hdhomerun_video_sock_t *vs)
+{
+	return vs->psi;
+}
 
-	stats->packet_count = vs->packet_count;
-	stats->network_error_count = vs->network_error_count;
-	stats->transport_error_count = vs->transport_error_count;
-	stats->sequence_error_count = vs->sequence_error_count;
-	stats->overflow_error_count = vs->overflow_error_count;
+void hdhomerun_video_set_callback(struct hdhomerun_video_sock_t *vs, hdhomerun_video_data_callback_t callback, void *callback_arg, size_t min_batch_size, uint32_t max_delay_ms)
+{
+	/* A batch larger than half the ring would overflow before it could be delivered. */
+	size_t max_batch_size = ((vs->buffer_size - vs->slot_size) / 2 / vs->slot_size) * vs->slot_size;
+	if (min_batch_size > max_batch_size) {
+		min_batch_size = max_batch_size;
+	}
+
+	thread_mutex_lock(&vs->callback_lock);
+	vs->data_callback = callback;
+	vs->data_callback_arg = callback_arg;
+	vs->data_callback_min_size = min_batch_size;
+	vs->data_callback_max_delay = max_delay_ms;
+	vs->callback_enabled = (callback != NULL);
+	thread_mutex_unlock(&vs->callback_lock);
+
+	/* Data already buffered may now have a delivery deadline. */
+	if (vs->engine_worker && callback && (max_delay_ms > 0)) {
+		hdhomerun_video_engine_reschedule(vs);
+	}
+}
 
+void hdhomerun_video_set_strip_pid_bitmap(struct hdhomerun_video_sock_t *vs, const uint8_t pid_bitmap[HDHOMERUN_VIDEO_PID_BITMAP_SIZE])
+{
+	thread_mutex_lock(&vs->lock);
+	vs->strip_pending_filter = (pid_bitmap != NULL);
+	if (pid_bitmap) {
+		memcpy(vs->strip_pending, pid_bitmap, HDHOMERUN_VIDEO_PID_BITMAP_SIZE);
+	}
+	vs->strip_request++;
 	thread_mutex_unlock(&vs->lock);
 }
+
+void hdhomerun_video_get_occupancy(struct hdhomerun_video_sock_t *vs, struct hdhomerun_video_occupancy_t *occupancy)
+{
+	size_t head = thread_atomic_load_acquire_size(&vs->head);
+	size_t tail = vs->tail;
+
+	/* Data returned by the previous recv call has been read. */
+	size_t unread = tail + vs->advance;
+	if (unread >= vs->buffer_size) {
+		unread -= vs->buffer_size;
+	}
+
+	occupancy->buffer_size = vs->buffer_size - vs->slot_size;
+	occupancy->used_size = hdhomerun_video_used_size(vs, head, unread);
+	occupancy->peak_used_size = vs->peak_used_size;
+	if (occupancy->peak_used_size < occupancy->used_size) {
+		occupancy->peak_used_size = occupancy->used_size;
+	}
+	vs->peak_reset_request++;
+
+	occupancy->oldest_age = 0;
+	if (unread != head) {
+		uint64_t current_time = getcurrenttime();
+		uint64_t arrival_time = vs->slot_time[unread / vs->slot_size];
+		if (current_time > arrival_time) {
+			occupancy->oldest_age = current_time - arrival_time;
+		}
+	}
+}
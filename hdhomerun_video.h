@@ -22,13 +22,45 @@ extern "C" {
 #endif
 
 struct hdhomerun_video_sock_t;
+struct hdhomerun_video_engine_t;
+struct hdhomerun_video_subscription_t;
+struct hdhomerun_video_reader_t;
 
+#define HDHOMERUN_VIDEO_JITTER_BUCKETS 16
+
+/*
+ * New fields are only ever appended. See hdhomerun_video_get_stats_ex.
+ */
 struct hdhomerun_video_stats_t {
 	uint32_t packet_count;
 	uint32_t network_error_count;
 	uint32_t transport_error_count;
 	uint32_t sequence_error_count;
 	uint32_t overflow_error_count;
+	uint32_t recv_syscall_count; /* packet_count / recv_syscall_count = packets received per syscall */
+	uint32_t reordered_count; /* out-of-order datagrams put back in sequence by the reorder window */
+	uint32_t late_drop_count; /* datagrams that arrived after their sequence number was given up as missing */
+	uint32_t duplicate_count;
+	uint32_t jitter_histogram[HDHOMERUN_VIDEO_JITTER_BUCKETS]; /* see HDHOMERUN_VIDEO_OPTION_RECV_TIMESTAMPS */
+	uint64_t stripped_bytes; /* see HDHOMERUN_VIDEO_OPTION_STRIP */
+};
+
+#define HDHOMERUN_VIDEO_STATS_SIZE_V1 (5 * sizeof(uint32_t)) /* packet_count - overflow_error_count */
+
+struct hdhomerun_video_occupancy_t {
+	size_t buffer_size; /* usable ring capacity in bytes */
+	size_t used_size; /* data not yet returned by hdhomerun_video_recv */
+	size_t peak_used_size; /* since the previous hdhomerun_video_get_occupancy call, including data returned but not yet released */
+	uint64_t oldest_age; /* ms the oldest unread data has been in the ring, 0 if empty */
+};
+
+struct hdhomerun_video_pid_stats_t {
+	uint16_t pid;
+	uint64_t packet_count;
+	uint64_t transport_error_count;
+	uint64_t sequence_error_count;
+	uint64_t scrambled_count;
+	uint32_t bitrate; /* bits per second, moving average updated once per second; 0 once the PID is not seen for a second */
 };
 
 #define TS_PACKET_SIZE 188
@@ -37,6 +69,137 @@ struct hdhomerun_video_stats_t {
 
 #define VIDEO_RTP_DATA_PACKET_SIZE ((188 * 7) + 12)
 
+/*
+ * Options for hdhomerun_video_create_with_options. Zero-initialize for defaults.
+ *
+ * HDHOMERUN_VIDEO_OPTION_MIRRORED_BUFFER: Map the ring buffer twice back-to-back so that
+ *		hdhomerun_video_recv always returns all available data as a single contiguous block.
+ *		The buffer size is rounded up to a multiple of the page size. If the platform does not
+ *		support mirrored mappings the standard buffer is used.
+ *
+ * HDHOMERUN_VIDEO_OPTION_PID_STATS: Track per-PID packet, error and bitrate stats, read with
+ *		hdhomerun_video_get_pid_stats. Disabled by default.
+ *
+ * HDHOMERUN_VIDEO_OPTION_HUGE_PAGES: Back the ring buffer with huge pages (MAP_HUGETLB / MEM_LARGE_PAGES)
+ *		if available, otherwise advise transparent huge pages. A standard buffer is rounded up to a
+ *		whole number of huge pages; a mirrored buffer only receives the advice.
+ *
+ * HDHOMERUN_VIDEO_OPTION_PREFAULT: Touch every page of the ring buffer at creation so the receive
+ *		thread does not take page faults on its first lap.
+ *
+ * HDHOMERUN_VIDEO_OPTION_LOCK_MEMORY: Lock the ring buffer in memory (mlock / VirtualLock). Failure
+ *		(for example RLIMIT_MEMLOCK) is logged and the buffer is used unlocked.
+ *
+ * HDHOMERUN_VIDEO_OPTION_RECV_TIMESTAMPS: Record the kernel receive time of each datagram (SO_TIMESTAMPNS),
+ *		returned by hdhomerun_video_recv_ex, and count datagram inter-arrival times in
+ *		jitter_histogram: bucket 0 counts gaps under 16us, bucket n gaps of [2^(n+3), 2^(n+4)) us
+ *		and the last bucket anything longer. Where kernel timestamps are not supported the time
+ *		the datagram was processed is used and the histogram is not updated.
+ *
+ * HDHOMERUN_VIDEO_OPTION_IO_URING: Receive with an io_uring multishot recv into provided buffers so that
+ *		datagram arrival needs no syscall per datagram (Linux 5.19+). Falls back to recvmmsg if the
+ *		kernel does not support it. Kernel receive timestamps are not available on this path. For
+ *		sockets attached to an engine see HDHOMERUN_VIDEO_ENGINE_OPTION_IO_URING instead.
+ *
+ * HDHOMERUN_VIDEO_OPTION_PSI: Reassemble PAT/PMT sections on the receive thread and keep a live program map,
+ *		read with hdhomerun_video_get_psi. The map is cleared by hdhomerun_video_flush.
+ *
+ * HDHOMERUN_VIDEO_OPTION_STRIP: Drop null packets (PID 0x1FFF), and packets whose PID is not set in
+ *		strip_pid_bitmap if one is given, before they are stored, and pack the remaining TS packets
+ *		densely in the ring. hdhomerun_video_recv and related functions then return multiples of
+ *		TS_PACKET_SIZE (188) rather than VIDEO_DATA_PACKET_SIZE. Stats, PSI and subscriptions still see
+ *		every packet. Dropped bytes are counted in stripped_bytes.
+ *
+ * strip_pid_bitmap: PIDs to keep with HDHOMERUN_VIDEO_OPTION_STRIP (HDHOMERUN_VIDEO_PID_BITMAP_SIZE bytes,
+ *		bit (pid & 7) of byte pid / 8). Copied at creation; change with hdhomerun_video_set_strip_pid_bitmap.
+ *		NULL to keep every PID.
+ *
+ * engine: Service the socket from a shared engine (see hdhomerun_video_engine_create) instead of a
+ *		dedicated thread. NULL for a dedicated thread. Callbacks of sockets serviced by an engine run on
+ *		the worker thread with the worker locked; they must not create or destroy video sockets attached
+ *		to the same engine or call hdhomerun_video_set_keepalive or hdhomerun_video_set_callback on them.
+ *
+ * reorder_packets, reorder_ms: Hold out-of-order RTP datagrams for up to reorder_packets datagrams
+ *		(max HDHOMERUN_VIDEO_REORDER_MAX, default 32 if only reorder_ms is set) and release them in
+ *		sequence order. A missing datagram is given up when the window fills or, if reorder_ms is set,
+ *		when the oldest held datagram has waited reorder_ms. Only datagrams given up are counted as
+ *		network errors. Disabled when both are zero. Sockets serviced by an engine check the timeout
+ *		on the engine timer, so it may be exceeded by up to 64ms.
+ *
+ * overflow_policy: What is discarded when the ring is full.
+ *		HDHOMERUN_VIDEO_OVERFLOW_DROP_NEWEST (default): incoming datagrams.
+ *		HDHOMERUN_VIDEO_OVERFLOW_DROP_OLDEST: data not yet returned by hdhomerun_video_recv, so that the
+ *			reader resumes with current data. The space is reclaimed on the next recv call; datagrams
+ *			arriving before then are also discarded.
+ *		HDHOMERUN_VIDEO_OVERFLOW_DROP_TO_PUSI: incoming datagrams until there is room and a TS packet
+ *			with payload_unit_start (any PID) arrives. Packets ahead of it in that datagram are
+ *			replaced with null packets.
+ *		Discarded datagrams are counted in overflow_error_count.
+ *
+ * high_watermark, watermark_callback: Called from the receive thread when the ring fill reaches
+ *		high_watermark bytes. Re-armed once the fill drops below high_watermark. Must not block.
+ *
+ * thread_attr: CPU affinity, scheduling policy, nice value and name for the dedicated receive thread
+ *		(see thread_task_create_ex). If the attributes cannot be applied (for example real-time
+ *		scheduling without privilege) the failure is logged and the thread is started with defaults.
+ *		The thread is named "hdhr-video" unless a name is given. Ignored when engine is set.
+ *
+ * busy_poll_us: Busy poll the device queue for up to busy_poll_us microseconds on each receive
+ *		(SO_BUSY_POLL, Linux only) to reduce wakeup latency at the cost of CPU. 0 to disable.
+ */
+#define HDHOMERUN_VIDEO_OPTION_MIRRORED_BUFFER 0x00000001
+#define HDHOMERUN_VIDEO_OPTION_PID_STATS 0x00000002
+#define HDHOMERUN_VIDEO_OPTION_HUGE_PAGES 0x00000004
+#define HDHOMERUN_VIDEO_OPTION_PREFAULT 0x00000008
+#define HDHOMERUN_VIDEO_OPTION_LOCK_MEMORY 0x00000010
+#define HDHOMERUN_VIDEO_OPTION_RECV_TIMESTAMPS 0x00000020
+#define HDHOMERUN_VIDEO_OPTION_IO_URING 0x00000040
+#define HDHOMERUN_VIDEO_OPTION_PSI 0x00000080
+#define HDHOMERUN_VIDEO_OPTION_STRIP 0x00000100
+
+#define HDHOMERUN_VIDEO_REORDER_MAX 64
+
+#define HDHOMERUN_VIDEO_OVERFLOW_DROP_NEWEST 0
+#define HDHOMERUN_VIDEO_OVERFLOW_DROP_OLDEST 1
+#define HDHOMERUN_VIDEO_OVERFLOW_DROP_TO_PUSI 2
+
+typedef void (*hdhomerun_video_watermark_callback_t)(void *arg, size_t used_size);
+
+struct hdhomerun_video_options_t {
+	uint32_t flags;
+	struct hdhomerun_video_engine_t *engine;
+	uint32_t reorder_packets;
+	uint32_t reorder_ms;
+	uint32_t overflow_policy;
+	size_t high_watermark;
+	hdhomerun_video_watermark_callback_t watermark_callback;
+	void *watermark_callback_arg;
+	const struct thread_task_attr_t *thread_attr;
+	uint32_t busy_poll_us;
+	const uint8_t *strip_pid_bitmap;
+};
+
+/*
+ * Create a shared receive engine.
+ *
+ * uint32_t worker_count: Number of worker threads (1-64). Each video socket attached to the engine is
+ *		serviced by the least loaded worker, which waits on all of its sockets at once and sends their
+ *		keepalives from a timer wheel. Workers sleep until data arrives or a keepalive is due.
+ *
+ * Returns NULL if the platform does not support socket readiness polling (currently Linux only).
+ *
+ * All video sockets attached to the engine must be destroyed before the engine is destroyed.
+ *
+ * HDHOMERUN_VIDEO_ENGINE_OPTION_IO_URING (hdhomerun_video_engine_create_ex): Each worker waits on one io_uring
+ *		with a multishot recv per socket instead of epoll, so one thread can receive every tuner without a
+ *		syscall per datagram. Falls back to epoll if the kernel does not support it.
+ */
+#define HDHOMERUN_VIDEO_ENGINE_OPTION_IO_URING 0x00000001
+
+extern LIBHDHOMERUN_API struct hdhomerun_video_engine_t *hdhomerun_video_engine_create(uint32_t worker_count, struct hdhomerun_debug_t *dbg);
+extern LIBHDHOMERUN_API struct hdhomerun_video_engine_t *hdhomerun_video_engine_create_ex(uint32_t worker_count, uint32_t flags, struct hdhomerun_debug_t *dbg);
+extern LIBHDHOMERUN_API void hdhomerun_video_engine_destroy(struct hdhomerun_video_engine_t *engine);
+
 /*
  * Create a video/data socket.
  *
@@ -50,6 +213,7 @@ struct hdhomerun_video_stats_t {
  */
 extern LIBHDHOMERUN_API struct hdhomerun_video_sock_t *hdhomerun_video_create(uint16_t listen_port, bool allow_port_reuse, size_t buffer_size, struct hdhomerun_debug_t *dbg);
 extern LIBHDHOMERUN_API struct hdhomerun_video_sock_t *hdhomerun_video_create_ex(const struct sockaddr *listen_addr, bool allow_port_reuse, size_t buffer_size, struct hdhomerun_debug_t *dbg);
+extern LIBHDHOMERUN_API struct hdhomerun_video_sock_t *hdhomerun_video_create_with_options(const struct sockaddr *listen_addr, bool allow_port_reuse, size_t buffer_size, const struct hdhomerun_video_options_t *options, struct hdhomerun_debug_t *dbg);
 extern LIBHDHOMERUN_API void hdhomerun_video_destroy(struct hdhomerun_video_sock_t *vs);
 
 /*
@@ -85,13 +249,118 @@ extern LIBHDHOMERUN_API void hdhomerun_video_leave_multicast_group_ex(struct hdh
  *
  * The amount of data returned will always be a multiple of VIDEO_DATA_PACKET_SIZE (1316).
  * Attempting to read a single TS frame (188 bytes) will not return data as it is less than
- * the minimum size.
+ * the minimum size. With HDHOMERUN_VIDEO_OPTION_STRIP the granularity is TS_PACKET_SIZE (188).
  *
  * The buffer is implemented as a ring buffer. It is possible for this function to return a small
- * amount of data when more is available due to the wrap-around case.
+ * amount of data when more is available due to the wrap-around case, unless the socket was created
+ * with HDHOMERUN_VIDEO_OPTION_MIRRORED_BUFFER.
+ *
+ * The ring is lock-free with the video thread as the single producer. hdhomerun_video_recv and
+ * hdhomerun_video_flush form the single consumer and must not be called concurrently from
+ * different threads.
  */
 extern LIBHDHOMERUN_API uint8_t *hdhomerun_video_recv(struct hdhomerun_video_sock_t *vs, size_t max_size, size_t *pactual_size);
 
+/*
+ * As hdhomerun_video_recv, also returning the receive time (ns since the epoch) of each VIDEO_DATA_PACKET_SIZE
+ * datagram returned. timestamps must have room for max_size / VIDEO_DATA_PACKET_SIZE entries. Timestamps are
+ * 0 unless the socket was created with HDHOMERUN_VIDEO_OPTION_RECV_TIMESTAMPS.
+ */
+extern LIBHDHOMERUN_API uint8_t *hdhomerun_video_recv_ex(struct hdhomerun_video_sock_t *vs, size_t max_size, size_t *pactual_size, uint64_t timestamps[]);
+
+/*
+ * As hdhomerun_video_recv, returning a multiple of TS_PACKET_SIZE (188) regardless of
+ * HDHOMERUN_VIDEO_OPTION_STRIP. Without it a datagram may be split across calls.
+ */
+extern LIBHDHOMERUN_API uint8_t *hdhomerun_video_recv_ts(struct hdhomerun_video_sock_t *vs, size_t max_size, size_t *pactual_size);
+
+/*
+ * Wait for data then read it from the buffer.
+ *
+ * size_t max_size: The maximum amount of data to be returned.
+ * size_t min_size: Sleep until at least this much data is buffered. Rounded up to a multiple of
+ *		VIDEO_DATA_PACKET_SIZE (minimum one packet) and limited to max_size and the buffer size.
+ * uint64_t timeout: Maximum time to wait in milliseconds.
+ * size_t *pactual_size: Updated to contain the amount of data available to the caller.
+ *
+ * Data returned by a previous call to hdhomerun_video_recv or hdhomerun_video_recv_wait is released
+ * before waiting. On timeout any data that is available is returned, which may be less than min_size.
+ * Without HDHOMERUN_VIDEO_OPTION_MIRRORED_BUFFER the wrap-around case can also return less than min_size.
+ *
+ * Returns a pointer to the data, or NULL if no data is available.
+ */
+extern LIBHDHOMERUN_API uint8_t *hdhomerun_video_recv_wait(struct hdhomerun_video_sock_t *vs, size_t max_size, size_t min_size, uint64_t timeout, size_t *pactual_size);
+
+/*
+ * Get a handle that can be used to wait for data in an external event loop.
+ *
+ * POSIX: a file descriptor that polls readable. Windows: an event handle.
+ *
+ * The handle is signaled when data becomes available after hdhomerun_video_recv has returned NULL.
+ * After each wakeup call hdhomerun_video_recv until it returns NULL. The handle is owned by the video
+ * object and must not be closed by the caller.
+ *
+ * Returns THREAD_NOTIFY_HANDLE_INVALID if a handle could not be created.
+ */
+extern LIBHDHOMERUN_API thread_notify_handle_t hdhomerun_video_get_notify_handle(struct hdhomerun_video_sock_t *vs);
+
+/*
+ * Subscribe to a subset of PIDs.
+ *
+ * const uint8_t pid_bitmap[]: One bit per PID (bit (pid & 7) of byte pid >> 3).
+ * size_t buffer_size: Size of the subscription ring buffer (ring mode).
+ * hdhomerun_video_subscribe_callback_t callback: If set, matching TS packets are passed to the callback on the
+ *		receive thread instead of being queued. The packets are only valid during the callback. The callback
+ *		must not block or call hdhomerun_video_subscribe/hdhomerun_video_unsubscribe.
+ *
+ * The receive thread routes matching TS packets while it walks each datagram, including datagrams that
+ * overflow the main buffer, so consumers that only use subscriptions may ignore hdhomerun_video_recv.
+ *
+ * In ring mode call hdhomerun_video_subscription_recv to read the packets. It follows the same rules as
+ * hdhomerun_video_recv with sizes in multiples of TS_PACKET_SIZE (188) and one consumer per subscription.
+ *
+ * Returns a subscription handle, or NULL on error. Subscriptions are released by hdhomerun_video_unsubscribe
+ * or when the video socket is destroyed.
+ */
+#define HDHOMERUN_VIDEO_PID_BITMAP_SIZE (0x2000 / 8)
+
+typedef void (*hdhomerun_video_subscribe_callback_t)(void *arg, const uint8_t *ts_packets, size_t packet_count);
+
+extern LIBHDHOMERUN_API struct hdhomerun_video_subscription_t *hdhomerun_video_subscribe(struct hdhomerun_video_sock_t *vs, const uint8_t pid_bitmap[HDHOMERUN_VIDEO_PID_BITMAP_SIZE], size_t buffer_size, hdhomerun_video_subscribe_callback_t callback, void *callback_arg);
+extern LIBHDHOMERUN_API void hdhomerun_video_unsubscribe(struct hdhomerun_video_sock_t *vs, struct hdhomerun_video_subscription_t *sub);
+extern LIBHDHOMERUN_API uint8_t *hdhomerun_video_subscription_recv(struct hdhomerun_video_subscription_t *sub, size_t max_size, size_t *pactual_size);
+extern LIBHDHOMERUN_API void hdhomerun_video_subscription_get_stats(struct hdhomerun_video_subscription_t *sub, uint64_t *ppacket_count, uint64_t *poverflow_error_count);
+
+/*
+ * Additional reader cursors over the main ring.
+ *
+ * Each reader tracks its own position in the same ring as hdhomerun_video_recv, so one stream can feed a
+ * recorder, a live preview and an analyzer without copying. A reader starts at the newest data and follows the
+ * same rules as hdhomerun_video_recv: data remains valid until the next call on that reader, and each reader
+ * has one consumer thread. Readers poll; there is no wait or notify support.
+ *
+ * By default the slowest reader, including the hdhomerun_video_recv consumer, bounds the ring: when it falls a
+ * full buffer behind, new datagrams are dropped and counted in overflow_error_count. The overflow_policy
+ * option only applies to the hdhomerun_video_recv consumer.
+ *
+ * HDHOMERUN_VIDEO_READER_OPTION_DETACH_ON_LAG: The reader does not hold back the ring. If the receive thread
+ *		needs space the reader has not yet read, the reader is detached: hdhomerun_video_reader_recv
+ *		returns NULL and hdhomerun_video_reader_is_detached returns true until hdhomerun_video_reader_flush
+ *		is called. Data returned before the reader was detached may have been overwritten.
+ *
+ * hdhomerun_video_reader_flush: Discard unread data and continue with new data, reattaching a detached reader.
+ *
+ * Applications that only use readers should use hdhomerun_video_recv for one of them. Readers still attached
+ * when the video socket is destroyed are destroyed with it.
+ */
+#define HDHOMERUN_VIDEO_READER_OPTION_DETACH_ON_LAG 0x00000001
+
+extern LIBHDHOMERUN_API struct hdhomerun_video_reader_t *hdhomerun_video_reader_create(struct hdhomerun_video_sock_t *vs, uint32_t flags);
+extern LIBHDHOMERUN_API void hdhomerun_video_reader_destroy(struct hdhomerun_video_reader_t *reader);
+extern LIBHDHOMERUN_API uint8_t *hdhomerun_video_reader_recv(struct hdhomerun_video_reader_t *reader, size_t max_size, size_t *pactual_size);
+extern LIBHDHOMERUN_API void hdhomerun_video_reader_flush(struct hdhomerun_video_reader_t *reader);
+extern LIBHDHOMERUN_API bool hdhomerun_video_reader_is_detached(struct hdhomerun_video_reader_t *reader);
+
 /*
  * Flush the buffer.
  */
@@ -101,7 +370,71 @@ extern LIBHDHOMERUN_API void hdhomerun_video_flush(struct hdhomerun_video_sock_t
  * Debug print internal stats.
  */
 extern LIBHDHOMERUN_API void hdhomerun_video_debug_print_stats(struct hdhomerun_video_sock_t *vs);
+
+/*
+ * Get stats since the last flush. May be called from any thread; the counters are read as of the end of a
+ * receive batch.
+ *
+ * hdhomerun_video_get_stats fills only the first five counters (HDHOMERUN_VIDEO_STATS_SIZE_V1 bytes), the layout
+ * of the structure before the other fields were added, so callers built against an older header are not overrun.
+ *
+ * hdhomerun_video_get_stats_ex fills stats_size bytes, normally sizeof(struct hdhomerun_video_stats_t). Fields
+ * beyond what this library version knows are zeroed.
+ */
 extern LIBHDHOMERUN_API void hdhomerun_video_get_stats(struct hdhomerun_video_sock_t *vs, struct hdhomerun_video_stats_t *stats);
+extern LIBHDHOMERUN_API void hdhomerun_video_get_stats_ex(struct hdhomerun_video_sock_t *vs, struct hdhomerun_video_stats_t *stats, size_t stats_size);
+
+/*
+ * Copy per-PID stats for the PIDs seen since the last flush, in the order they were first seen.
+ * Requires HDHOMERUN_VIDEO_OPTION_PID_STATS. Packets with the transport error indicator set are counted
+ * against the PID in their (possibly corrupt) header.
+ *
+ * Returns the number of entries copied.
+ */
+extern LIBHDHOMERUN_API size_t hdhomerun_video_get_pid_stats(struct hdhomerun_video_sock_t *vs, struct hdhomerun_video_pid_stats_t stats[], size_t max_count);
+
+/*
+ * Program map maintained by the receive thread (see hdhomerun_psi_get_programs and
+ * hdhomerun_psi_get_program_pid_bitmap). Requires HDHOMERUN_VIDEO_OPTION_PSI, otherwise returns NULL.
+ * Owned by the video socket.
+ */
+extern LIBHDHOMERUN_API struct hdhomerun_psi_t *hdhomerun_video_get_psi(struct hdhomerun_video_sock_t *vs);
+
+/*
+ * Push delivery from the receive thread.
+ *
+ * Once set, the receive thread is the consumer of the ring: committed data is passed to the callback in place,
+ * then released when the callback returns. The application must not call hdhomerun_video_recv or related
+ * functions while a callback is set. Readers and subscriptions are unaffected.
+ *
+ * size_t min_batch_size: Coalesce datagrams until at least this many bytes are buffered. Limited to half the
+ *		ring. 0 to deliver every batch as it is received.
+ * uint32_t max_delay_ms: Deliver a smaller batch once its oldest data has waited this long. Checked each
+ *		time the receive thread wakes (at least every 25ms for a dedicated thread). Sockets serviced by an
+ *		engine check it on the engine timer, so it may be exceeded by up to 64ms. 0 to wait for
+ *		min_batch_size.
+ *
+ * The callback may be invoked more than once per batch when the data wraps around the end of a ring created
+ * without HDHOMERUN_VIDEO_OPTION_MIRRORED_BUFFER. It must not block for long, as the ring fills meanwhile, and
+ * must not call hdhomerun_video_set_callback. Sockets serviced by an engine have further restrictions (see
+ * engine in hdhomerun_video_options_t). Once hdhomerun_video_set_callback returns the previous callback is no
+ * longer running and will not be called again. NULL to stop push delivery; undelivered data remains in the
+ * ring for hdhomerun_video_recv.
+ */
+typedef void (*hdhomerun_video_data_callback_t)(void *arg, const uint8_t *data, size_t size);
+
+extern LIBHDHOMERUN_API void hdhomerun_video_set_callback(struct hdhomerun_video_sock_t *vs, hdhomerun_video_data_callback_t callback, void *callback_arg, size_t min_batch_size, uint32_t max_delay_ms);
+
+/*
+ * Replace the PID filter used by HDHOMERUN_VIDEO_OPTION_STRIP (see strip_pid_bitmap). The bitmap is copied and
+ * applied by the receive thread from the next datagram. NULL to keep every PID except nulls.
+ */
+extern LIBHDHOMERUN_API void hdhomerun_video_set_strip_pid_bitmap(struct hdhomerun_video_sock_t *vs, const uint8_t pid_bitmap[HDHOMERUN_VIDEO_PID_BITMAP_SIZE]);
+
+/*
+ * Ring occupancy. Must be called from the thread that calls hdhomerun_video_recv.
+ */
+extern LIBHDHOMERUN_API void hdhomerun_video_get_occupancy(struct hdhomerun_video_sock_t *vs, struct hdhomerun_video_occupancy_t *occupancy);
 
 /*
  * Internal use only.
@@ -0,0 +1,393 @@
+/*
+ * video_ring_stress.c
+ *
+ * Copyright © 2006-2022 Silicondust USA Inc. <www.silicondust.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Producer/consumer stress test for the video ring.
+ *
+ * A sender thread streams numbered RTP datagrams to a video socket over loopback. The consumer reads with
+ * random sizes and random stalls so the small ring overflows regularly, and checks that every datagram it
+ * gets is intact and newer than the previous one. A third thread polls the stats and checks that each
+ * snapshot is self-consistent. Without flushes, every datagram the receive thread counted must either have
+ * been read or be counted as an overflow.
+ *
+ * The engine cases repeatedly destroy and recreate engine-attached sockets with keepalive and reordering enabled
+ * while traffic is arriving, so the worker is mid poll cycle or has the socket on its timer wheel when it goes away.
+ */
+
+#include "hdhomerun.h"
+
+#define STRESS_DATAGRAM_COUNT 50000
+#define STRESS_RING_DATAGRAMS 64
+#define STRESS_PID 0x0100
+#define STRESS_RTP_HEADER_SIZE (VIDEO_RTP_DATA_PACKET_SIZE - VIDEO_DATA_PACKET_SIZE)
+#define STRESS_ENGINE_SOCK_COUNT 8
+#define STRESS_ENGINE_CYCLE_COUNT 2000
+
+struct stress_t {
+	struct hdhomerun_video_sock_t *vs;
+	uint16_t port;
+	volatile bool sender_done;
+	volatile bool poller_stop;
+	bool poll_monotonic;
+	volatile uint32_t stats_error_count;
+};
+
+struct stress_engine_t {
+	struct hdhomerun_video_sock_t *vs[STRESS_ENGINE_SOCK_COUNT];
+	volatile uint16_t port[STRESS_ENGINE_SOCK_COUNT];
+	volatile bool sender_stop;
+};
+
+static uint32_t stress_random(uint32_t *state)
+{
+	*state = *state * 1103515245 + 12345;
+	return *state >> 8;
+}
+
+static void stress_build_datagram(uint8_t *buffer, uint32_t datagram)
+{
+	memset(buffer, 0, STRESS_RTP_HEADER_SIZE);
+	buffer[0] = 0x80;
+	buffer[1] = 33;
+	buffer[2] = (uint8_t)(datagram >> 8);
+	buffer[3] = (uint8_t)(datagram >> 0);
+
+	int i;
+	for (i = 0; i < 7; i++) {
+		uint8_t *pkt = buffer + STRESS_RTP_HEADER_SIZE + TS_PACKET_SIZE * i;
+		uint32_t n = datagram * 7 + i;
+
+		pkt[0] = 0x47;
+		pkt[1] = (uint8_t)(STRESS_PID >> 8);
+		pkt[2] = (uint8_t)(STRESS_PID >> 0);
+		pkt[3] = 0x10 | (n & 0x0F);
+		pkt[4] = (uint8_t)(n >> 24);
+		pkt[5] = (uint8_t)(n >> 16);
+		pkt[6] = (uint8_t)(n >> 8);
+		pkt[7] = (uint8_t)(n >> 0);
+		memset(pkt + 8, (uint8_t)n, TS_PACKET_SIZE - 8);
+	}
+}
+
+static void stress_sender(void *arg)
+{
+	struct stress_t *stress = (struct stress_t *)arg;
+	struct hdhomerun_sock_t *sock = hdhomerun_sock_create_udp();
+	uint8_t buffer[VIDEO_RTP_DATA_PACKET_SIZE];
+
+	uint32_t datagram;
+	for (datagram = 0; datagram < STRESS_DATAGRAM_COUNT; datagram++) {
+		stress_build_datagram(buffer, datagram);
+		hdhomerun_sock_sendto(sock, 0x7F000001, stress->port, buffer, sizeof(buffer), 100);
+
+		/* Stay within the kernel socket buffer so loss is in the ring, not the kernel. */
+		if ((datagram & 31) == 31) {
+			msleep_approx(1);
+		}
+	}
+
+	hdhomerun_sock_destroy(sock);
+	stress->sender_done = true;
+}
+
+static void stress_poller(void *arg)
+{
+	struct stress_t *stress = (struct stress_t *)arg;
+	struct hdhomerun_video_stats_t previous;
+	memset(&previous, 0, sizeof(previous));
+
+	while (!stress->poller_stop) {
+		struct hdhomerun_video_stats_t stats;
+		hdhomerun_video_get_stats_ex(stress->vs, &stats, sizeof(stats));
+
+		/* Every overflow is for a datagram already counted; each receive call makes at most three syscalls. */
+		if ((stats.overflow_error_count > stats.packet_count) || (stats.recv_syscall_count > stats.packet_count * 3)) {
+			stress->stats_error_count++;
+		}
+		if (stress->poll_monotonic && ((stats.packet_count < previous.packet_count) || (stats.overflow_error_count < previous.overflow_error_count))) {
+			stress->stats_error_count++;
+		}
+
+		previous = stats;
+	}
+}
+
+/*
+ * Returns the datagram number, or -1 if the datagram is torn.
+ */
+static int64_t stress_check_datagram(const uint8_t *ptr)
+{
+	uint32_t n0 = ((uint32_t)ptr[4] << 24) | ((uint32_t)ptr[5] << 16) | ((uint32_t)ptr[6] << 8) | (uint32_t)ptr[7];
+	if (n0 % 7 != 0) {
+		return -1;
+	}
+
+	int i;
+	for (i = 0; i < 7; i++) {
+		const uint8_t *pkt = ptr + TS_PACKET_SIZE * i;
+		uint32_t n = ((uint32_t)pkt[4] << 24) | ((uint32_t)pkt[5] << 16) | ((uint32_t)pkt[6] << 8) | (uint32_t)pkt[7];
+		if ((pkt[0] != 0x47) || (n != n0 + i) || (pkt[8] != (uint8_t)n) || (pkt[TS_PACKET_SIZE - 1] != (uint8_t)n)) {
+			return -1;
+		}
+	}
+
+	return (int64_t)(n0 / 7);
+}
+
+static bool stress_run(const char *name, uint32_t flags, uint32_t overflow_policy, uint32_t flush_interval)
+{
+	struct stress_t stress;
+	memset(&stress, 0, sizeof(stress));
+	stress.poll_monotonic = (flush_interval == 0);
+
+	struct sockaddr_in listen_addr;
+	memset(&listen_addr, 0, sizeof(listen_addr));
+	listen_addr.sin_family = AF_INET;
+	listen_addr.sin_addr.s_addr = htonl(0x7F000001);
+
+	struct hdhomerun_video_options_t options;
+	memset(&options, 0, sizeof(options));
+	options.flags = flags;
+	options.overflow_policy = overflow_policy;
+
+	stress.vs = hdhomerun_video_create_with_options((const struct sockaddr *)&listen_addr, false, VIDEO_DATA_PACKET_SIZE * STRESS_RING_DATAGRAMS, &options, NULL);
+	if (!stress.vs) {
+		fprintf(stderr, "%s: failed to create video socket\n", name);
+		return false;
+	}
+	stress.port = hdhomerun_video_get_local_port(stress.vs);
+
+	thread_task_t sender_thread, poller_thread;
+	thread_task_create(&poller_thread, stress_poller, &stress);
+	thread_task_create(&sender_thread, stress_sender, &stress);
+
+	uint32_t rng = 1;
+	uint32_t delivered = 0;
+	uint32_t torn = 0;
+	uint32_t out_of_order = 0;
+	uint32_t flush_count = 0;
+	int64_t last_datagram = -1;
+	uint64_t idle_start = 0;
+
+	while (1) {
+		size_t actual_size;
+		uint8_t *ptr = hdhomerun_video_recv(stress.vs, VIDEO_DATA_PACKET_SIZE * (1 + stress_random(&rng) % 20), &actual_size);
+		if (!ptr) {
+			/* Drained once the sender has finished and nothing has arrived for 200ms. */
+			if (stress.sender_done) {
+				uint64_t current_time = getcurrenttime();
+				if (idle_start == 0) {
+					idle_start = current_time;
+				}
+				if (current_time >= idle_start + 200) {
+					break;
+				}
+			}
+			msleep_approx(1);
+			continue;
+		}
+
+		idle_start = 0;
+
+		size_t offset;
+		for (offset = 0; offset < actual_size; offset += VIDEO_DATA_PACKET_SIZE) {
+			int64_t datagram = stress_check_datagram(ptr + offset);
+			if (datagram < 0) {
+				torn++;
+				continue;
+			}
+			if (datagram <= last_datagram) {
+				out_of_order++;
+			}
+			last_datagram = datagram;
+			delivered++;
+		}
+
+		/* Stall now and then so the ring overflows. */
+		if (stress_random(&rng) % 4 == 0) {
+			msleep_approx(stress_random(&rng) % 4);
+		}
+
+		if ((flush_interval > 0) && (stress_random(&rng) % flush_interval == 0)) {
+			hdhomerun_video_flush(stress.vs);
+			flush_count++;
+		}
+	}
+
+	thread_task_join(sender_thread);
+	stress.poller_stop = true;
+	thread_task_join(poller_thread);
+
+	struct hdhomerun_video_stats_t stats;
+	hdhomerun_video_get_stats_ex(stress.vs, &stats, sizeof(stats));
+	hdhomerun_video_destroy(stress.vs);
+
+	bool success = (torn == 0) && (out_of_order == 0) && (stress.stats_error_count == 0) && (delivered > 0);
+	if (flush_interval == 0) {
+		success = success && (stats.packet_count == delivered + stats.overflow_error_count);
+	}
+
+	printf("%-24s %s: received=%u read=%u overflow=%u torn=%u out_of_order=%u stats_errors=%u flushes=%u\n",
+		name, success ? "ok  " : "FAIL", (unsigned int)stats.packet_count, (unsigned int)delivered,
+		(unsigned int)stats.overflow_error_count, (unsigned int)torn, (unsigned int)out_of_order,
+		(unsigned int)stress.stats_error_count, (unsigned int)flush_count
+	);
+	return success;
+}
+
+static void stress_engine_sender(void *arg)
+{
+	struct stress_engine_t *stress = (struct stress_engine_t *)arg;
+	struct hdhomerun_sock_t *sock = hdhomerun_sock_create_udp();
+	uint8_t buffer[VIDEO_RTP_DATA_PACKET_SIZE];
+	uint32_t datagram = 0;
+
+	while (!stress->sender_stop) {
+		int i;
+		for (i = 0; i < STRESS_ENGINE_SOCK_COUNT; i++) {
+			uint16_t port = stress->port[i];
+			if (port == 0) {
+				continue;
+			}
+
+			/* Skip a sequence number now and then so the reorder window holds datagrams on the timer. */
+			datagram += ((datagram & 15) == 15) ? 2 : 1;
+			stress_build_datagram(buffer, datagram);
+			hdhomerun_sock_sendto(sock, 0x7F000001, port, buffer, sizeof(buffer), 100);
+		}
+
+		if ((datagram & 63) < STRESS_ENGINE_SOCK_COUNT) {
+			msleep_approx(1);
+		}
+	}
+
+	hdhomerun_sock_destroy(sock);
+}
+
+static struct hdhomerun_video_sock_t *stress_engine_create_sock(struct hdhomerun_video_engine_t *engine)
+{
+	struct sockaddr_in listen_addr;
+	memset(&listen_addr, 0, sizeof(listen_addr));
+	listen_addr.sin_family = AF_INET;
+	listen_addr.sin_addr.s_addr = htonl(0x7F000001);
+
+	struct hdhomerun_video_options_t options;
+	memset(&options, 0, sizeof(options));
+	options.engine = engine;
+	options.reorder_packets = 8;
+	options.reorder_ms = 5;
+
+	struct hdhomerun_video_sock_t *vs = hdhomerun_video_create_with_options((const struct sockaddr *)&listen_addr, false, VIDEO_DATA_PACKET_SIZE * STRESS_RING_DATAGRAMS, &options, NULL);
+	if (!vs) {
+		return NULL;
+	}
+
+	/* Keepalives go to the socket itself, which discards them. */
+	hdhomerun_video_set_keepalive(vs, 0x7F000001, hdhomerun_video_get_local_port(vs), 0);
+	return vs;
+}
+
+static bool stress_engine_run(const char *name, uint32_t engine_flags)
+{
+	struct hdhomerun_video_engine_t *engine = hdhomerun_video_engine_create_ex(2, engine_flags, NULL);
+	if (!engine) {
+		fprintf(stderr, "%s: failed to create engine\n", name);
+		return false;
+	}
+
+	struct stress_engine_t stress;
+	memset(&stress, 0, sizeof(stress));
+
+	bool success = true;
+	int i;
+	for (i = 0; i < STRESS_ENGINE_SOCK_COUNT; i++) {
+		stress.vs[i] = stress_engine_create_sock(engine);
+		if (!stress.vs[i]) {
+			success = false;
+			break;
+		}
+		stress.port[i] = hdhomerun_video_get_local_port(stress.vs[i]);
+	}
+
+	thread_task_t sender_thread;
+	thread_task_create(&sender_thread, stress_engine_sender, &stress);
+
+	uint32_t rng = 1;
+	uint32_t cycle_count = 0;
+	uint64_t packet_count = 0;
+
+	while (success && (cycle_count < STRESS_ENGINE_CYCLE_COUNT)) {
+		int index = (int)(stress_random(&rng) % STRESS_ENGINE_SOCK_COUNT);
+		struct hdhomerun_video_sock_t *vs = stress.vs[index];
+
+		size_t actual_size;
+		hdhomerun_video_recv(vs, VIDEO_DATA_PACKET_SIZE * STRESS_RING_DATAGRAMS, &actual_size);
+
+		struct hdhomerun_video_stats_t stats;
+		hdhomerun_video_get_stats_ex(vs, &stats, sizeof(stats));
+		packet_count += stats.packet_count;
+
+		stress.port[index] = 0;
+		hdhomerun_video_destroy(vs);
+
+		stress.vs[index] = stress_engine_create_sock(engine);
+		if (!stress.vs[index]) {
+			success = false;
+			break;
+		}
+		stress.port[index] = hdhomerun_video_get_local_port(stress.vs[index]);
+		cycle_count++;
+
+		if (stress_random(&rng) % 8 == 0) {
+			msleep_approx(1);
+		}
+	}
+
+	stress.sender_stop = true;
+	thread_task_join(sender_thread);
+
+	for (i = 0; i < STRESS_ENGINE_SOCK_COUNT; i++) {
+		if (stress.vs[i]) {
+			hdhomerun_video_destroy(stress.vs[i]);
+		}
+	}
+
+	hdhomerun_video_engine_destroy(engine);
+
+	success = success && (packet_count > 0);
+
+	printf("%-24s %s: cycles=%u received=%llu\n", name, success ? "ok  " : "FAIL", (unsigned int)cycle_count, (unsigned long long)packet_count);
+	return success;
+}
+
+int main(int argc, char *argv[])
+{
+	bool success = true;
+
+	success &= stress_run("drop-newest", 0, HDHOMERUN_VIDEO_OVERFLOW_DROP_NEWEST, 0);
+	success &= stress_run("drop-newest mirrored", HDHOMERUN_VIDEO_OPTION_MIRRORED_BUFFER, HDHOMERUN_VIDEO_OVERFLOW_DROP_NEWEST, 0);
+	success &= stress_run("drop-oldest", 0, HDHOMERUN_VIDEO_OVERFLOW_DROP_OLDEST, 0);
+	success &= stress_run("drop-oldest mirrored", HDHOMERUN_VIDEO_OPTION_MIRRORED_BUFFER, HDHOMERUN_VIDEO_OVERFLOW_DROP_OLDEST, 0);
+	success &= stress_run("flush", 0, HDHOMERUN_VIDEO_OVERFLOW_DROP_NEWEST, 50);
+	success &= stress_engine_run("engine destroy", 0);
+	success &= stress_engine_run("engine destroy io_uring", HDHOMERUN_VIDEO_ENGINE_OPTION_IO_URING);
+
+	return success ? 0 : 1;
+}
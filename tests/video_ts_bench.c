@@ -0,0 +1,227 @@
+/*
+ * video_ts_bench.c
+ *
+ * Copyright © 2006-2022 Silicondust USA Inc. <www.silicondust.com>.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Microbenchmark for the per-datagram TS header checks.
+ *
+ * Compares the per-packet path (7 calls to hdhomerun_video_stats_ts_pkt) against each uniform prefix kernel on
+ * a single-PID stream and on a mixed stream with PID changes, null packets, TEI, adaptation-only packets and
+ * continuity jumps. Every kernel must produce the same counters as the per-packet path.
+ *
+ * Built against hdhomerun_video.c directly so the static kernels can be selected.
+ */
+
+#include "hdhomerun_video.c"
+
+#define BENCH_DATAGRAM_COUNT 4096
+#define BENCH_REPEAT_COUNT 500
+#define BENCH_RUN_COUNT 5
+
+struct bench_kernel_t {
+	const char *name;
+	hdhomerun_video_ts_uniform_func_t func;
+};
+
+static uint32_t bench_random(uint32_t *state)
+{
+	*state = *state * 1103515245 + 12345;
+	return *state >> 8;
+}
+
+static void bench_build_single(uint8_t *datagrams)
+{
+	uint8_t cc = 0;
+
+	int k;
+	for (k = 0; k < BENCH_DATAGRAM_COUNT; k++) {
+		int i;
+		for (i = 0; i < 7; i++) {
+			uint8_t *pkt = datagrams + VIDEO_DATA_PACKET_SIZE * k + TS_PACKET_SIZE * i;
+			memset(pkt, 0, TS_PACKET_SIZE);
+			pkt[0] = 0x47;
+			pkt[1] = 0x01;
+			pkt[2] = 0x00;
+			pkt[3] = 0x10 | (cc++ & 0x0F);
+		}
+	}
+}
+
+static void bench_build_mixed(uint8_t *datagrams)
+{
+	uint32_t rng = 1;
+	uint8_t cc[4];
+	memset(cc, 0, sizeof(cc));
+
+	int k;
+	for (k = 0; k < BENCH_DATAGRAM_COUNT; k++) {
+		/* Half the datagrams are uniform, the rest have one kind of irregularity. */
+		uint32_t mode = bench_random(&rng) % 10;
+		uint16_t pid0 = (uint16_t)(bench_random(&rng) % 4);
+
+		int i;
+		for (i = 0; i < 7; i++) {
+			uint8_t *pkt = datagrams + VIDEO_DATA_PACKET_SIZE * k + TS_PACKET_SIZE * i;
+			uint16_t pid = pid0;
+			if (mode == 1) {
+				pid = (uint16_t)(bench_random(&rng) % 4);
+			}
+			if ((mode == 2) && (i == 3)) {
+				pid = 0x1FFF;
+			}
+
+			memset(pkt, 0, TS_PACKET_SIZE);
+			pkt[0] = 0x47;
+			pkt[1] = (uint8_t)(pid >> 8);
+			pkt[2] = (uint8_t)(pid >> 0);
+			if ((mode == 3) && (i == 5)) {
+				pkt[1] |= 0x80;
+			}
+
+			uint8_t afc = ((bench_random(&rng) & 7) == 0) ? 0x30 : 0x10;
+			if ((mode == 4) && (i == 2)) {
+				afc = 0x20;
+			}
+
+			uint8_t *counter = &cc[pid & 3];
+			if (afc & 0x10) {
+				*counter = (*counter + 1) & 0x0F;
+			}
+			if ((mode == 5) && (i == 4)) {
+				*counter = (*counter + 3) & 0x0F;
+			}
+
+			pkt[3] = afc | ((pid == 0x1FFF) ? 0 : *counter);
+		}
+	}
+}
+
+static void bench_process(struct hdhomerun_video_sock_t *vs, uint8_t *datagrams, hdhomerun_video_ts_uniform_func_t func, int repeat_count)
+{
+	int repeat;
+	for (repeat = 0; repeat < repeat_count; repeat++) {
+		int k;
+		for (k = 0; k < BENCH_DATAGRAM_COUNT; k++) {
+			uint8_t *ptr = datagrams + VIDEO_DATA_PACKET_SIZE * k;
+
+			if (!func) {
+				int i;
+				for (i = 0; i < 7; i++) {
+					hdhomerun_video_stats_ts_pkt(vs, ptr + TS_PACKET_SIZE * i);
+				}
+				continue;
+			}
+
+			hdhomerun_video_stats_datagram(vs, ptr);
+		}
+	}
+}
+
+/*
+ * Returns the best time of several runs in ns per datagram, and the counters of the first run.
+ */
+static double bench_run(uint8_t *datagrams, hdhomerun_video_ts_uniform_func_t func, uint32_t *transport_error_count, uint32_t *sequence_error_count)
+{
+	struct hdhomerun_video_sock_t *vs = (struct hdhomerun_video_sock_t *)calloc(1, sizeof(struct hdhomerun_video_sock_t));
+	if (!vs) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	if (func) {
+		hdhomerun_video_ts_uniform = func;
+	}
+
+	hdhomerun_video_sequence_reset(vs);
+	bench_process(vs, datagrams, func, 1);
+	*transport_error_count = vs->transport_error_count;
+	*sequence_error_count = vs->sequence_error_count;
+
+	double best = 0.0;
+	int run;
+	for (run = 0; run < BENCH_RUN_COUNT; run++) {
+		uint64_t start = timer_get_hires_ticks();
+		bench_process(vs, datagrams, func, BENCH_REPEAT_COUNT);
+		uint64_t ticks = timer_get_hires_ticks() - start;
+
+		double ns = (double)ticks * 1000000000.0 / (double)timer_get_hires_frequency() / (double)(BENCH_REPEAT_COUNT * BENCH_DATAGRAM_COUNT);
+		if ((run == 0) || (ns < best)) {
+			best = ns;
+		}
+	}
+
+	free(vs);
+	return best;
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench_kernel_t kernels[2];
+	int kernel_count = 0;
+
+	kernels[kernel_count].name = "generic";
+	kernels[kernel_count].func = hdhomerun_video_ts_uniform_generic;
+	kernel_count++;
+#if defined(VIDEO_TS_AVX2)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		kernels[kernel_count].name = "avx2";
+		kernels[kernel_count].func = hdhomerun_video_ts_uniform_avx2;
+		kernel_count++;
+	}
+#endif
+
+	uint8_t *datagrams = (uint8_t *)malloc(VIDEO_DATA_PACKET_SIZE * BENCH_DATAGRAM_COUNT);
+	if (!datagrams) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	bool success = true;
+
+	int stream;
+	for (stream = 0; stream < 2; stream++) {
+		if (stream == 0) {
+			bench_build_single(datagrams);
+		} else {
+			bench_build_mixed(datagrams);
+		}
+
+		uint32_t ref_transport_error_count, ref_sequence_error_count;
+		double ref_ns = bench_run(datagrams, NULL, &ref_transport_error_count, &ref_sequence_error_count);
+		printf("%-10s per-packet %5.1f ns/datagram", (stream == 0) ? "single-PID" : "mixed", ref_ns);
+
+		int index;
+		for (index = 0; index < kernel_count; index++) {
+			uint32_t transport_error_count, sequence_error_count;
+			double ns = bench_run(datagrams, kernels[index].func, &transport_error_count, &sequence_error_count);
+			printf(", %s %5.1f", kernels[index].name, ns);
+
+			if ((transport_error_count != ref_transport_error_count) || (sequence_error_count != ref_sequence_error_count)) {
+				printf(" (MISMATCH te=%u/%u seq=%u/%u)", (unsigned int)transport_error_count, (unsigned int)ref_transport_error_count, (unsigned int)sequence_error_count, (unsigned int)ref_sequence_error_count);
+				success = false;
+			}
+		}
+
+		printf("\n");
+	}
+
+	free(datagrams);
+	return success ? 0 : 1;
+}